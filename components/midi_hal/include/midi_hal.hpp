@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef ESP_PLATFORM
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <atomic>
+#endif
+
+// Platform layer under the MIDI components: clock, tasks, queues, locks,
+// timers and the UART. The ESP-IDF backend maps each call straight onto
+// FreeRTOS, esp_timer and the UART driver; the POSIX backend runs the same
+// code on a host with threads and a virtual UART (see virtual_uart.hpp).
+
+namespace midi
+{
+    namespace hal
+    {
+#ifdef ESP_PLATFORM
+        using Pin = gpio_num_t;
+        using UartPort = uart_port_t;
+        constexpr unsigned kMaxPriority = configMAX_PRIORITIES;
+#else
+        using Pin = int;
+        using UartPort = int;
+        constexpr unsigned kMaxPriority = 25;
+#endif
+        constexpr Pin kNoPin = static_cast<Pin>(-1);
+
+        // Timeouts are in milliseconds, rounded up to the scheduler tick
+        constexpr uint32_t kForever = UINT32_MAX;
+
+        // Microseconds since boot (esp_timer_get_time on the device)
+        uint64_t nowUs();
+
+        // ---- Tasks ----------------------------------------------------
+
+        // Tasks never end: on the device they run until reset, on the host
+        // they are detached threads that run until the process exits.
+        // Whatever a task touches must outlive it, so on the host create
+        // the objects that own tasks (MidiIn, MidiOut and what their
+        // callbacks use) with new and never destroy them. Exit-time
+        // destructors would free queues and locks a task still waits on.
+        using TaskHandle = void *;
+        using TaskEntry = void (*)(void *arg);
+
+        TaskHandle startTask(TaskEntry entry, void *arg, const char *name, uint32_t stack_bytes, unsigned priority);
+        TaskHandle currentTask();
+        void sleepMs(uint32_t ms);
+
+        // Counting task notification: notify() adds one, waitForNotify()
+        // takes all of them. Returns false on timeout.
+        void notify(TaskHandle task);
+        bool waitForNotify(uint32_t timeout_ms);
+
+        // ---- Synchronisation -------------------------------------------
+
+        // Fixed-size item FIFO that copies items in and out
+        class Queue
+        {
+        public:
+            Queue() = default;
+            Queue(const Queue &) = delete;
+            Queue &operator=(const Queue &) = delete;
+            ~Queue();
+
+            void create(size_t length, size_t item_size);
+            bool send(const void *item, uint32_t timeout_ms = 0);
+            bool receive(void *item, uint32_t timeout_ms = 0);
+            void reset();
+            size_t waiting() const; // Items in the queue right now
+
+        private:
+            void *handle = nullptr;
+        };
+
+        // Blocking mutex for task context
+        class Mutex
+        {
+        public:
+            Mutex() = default;
+            Mutex(const Mutex &) = delete;
+            Mutex &operator=(const Mutex &) = delete;
+            ~Mutex();
+
+            void create();
+            void lock();
+            void unlock();
+
+        private:
+            void *handle = nullptr;
+        };
+
+        // Binary semaphore: give() from one task wakes one take()
+        class Signal
+        {
+        public:
+            Signal() = default;
+            Signal(const Signal &) = delete;
+            Signal &operator=(const Signal &) = delete;
+            ~Signal();
+
+            void create();
+            void give();
+            bool take(uint32_t timeout_ms);
+
+        private:
+            void *handle = nullptr;
+        };
+
+        // Short critical section around a few loads and stores. Never
+        // block or call out while holding it.
+        class CriticalSection
+        {
+        public:
+#ifdef ESP_PLATFORM
+            void lock() { taskENTER_CRITICAL(&mux); }
+            void unlock() { taskEXIT_CRITICAL(&mux); }
+
+        private:
+            portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#else
+            void lock()
+            {
+                while (flag.test_and_set(std::memory_order_acquire))
+                {
+                }
+            }
+            void unlock() { flag.clear(std::memory_order_release); }
+
+        private:
+            std::atomic_flag flag = ATOMIC_FLAG_INIT;
+#endif
+        };
+
+        // ---- Timers ----------------------------------------------------
+
+        // One-shot or periodic callback, run on the shared timer task
+        class Timer
+        {
+        public:
+            using Callback = void (*)(void *arg);
+
+            Timer() = default;
+            Timer(const Timer &) = delete;
+            Timer &operator=(const Timer &) = delete;
+            // Stops the timer and waits for a callback that is running,
+            // unless the callback itself destroys its timer
+            ~Timer();
+
+            // skip_missed: a periodic timer that fell behind fires once,
+            // not once per missed period
+            void create(Callback callback, void *arg, const char *name, bool skip_missed = true);
+            // Starting an armed timer re-arms it with the new delay
+            void startOnce(uint64_t delay_us);
+            void startPeriodic(uint64_t period_us);
+            void stop();
+            bool active() const;
+
+        private:
+            void *handle = nullptr;
+        };
+
+        // ---- UART ------------------------------------------------------
+
+        struct UartConfig
+        {
+            UartPort port;
+            Pin tx_pin = kNoPin;
+            Pin rx_pin = kNoPin;
+            size_t rx_buffer_size = 256;
+            size_t tx_buffer_size = 0;    // 0 = writes block until the bytes are in the FIFO
+            size_t event_queue_size = 0;  // 0 = no RX events (waitEvent unavailable)
+            uint8_t rx_full_threshold = 0;    // Bytes in the FIFO that raise an RX event, 0 = driver default
+            uint8_t rx_timeout_threshold = 0; // Idle byte times that raise an RX event, 0 = driver default
+        };
+
+        enum class UartEventType : uint8_t
+        {
+            Data,     // `size` bytes are ready to read
+            Overflow, // Received bytes were lost
+            Other,
+        };
+
+        struct UartEvent
+        {
+            UartEventType type;
+            size_t size;
+        };
+
+        // A MIDI UART (31250 baud, 8N1)
+        class Uart
+        {
+        public:
+            Uart() = default;
+            Uart(const Uart &) = delete;
+            Uart &operator=(const Uart &) = delete;
+
+            void open(const UartConfig &config);
+
+            // Read up to `max` buffered bytes, waiting up to `timeout_ms`
+            // for them. Returns the count, or -1 on error.
+            int read(uint8_t *data, size_t max, uint32_t timeout_ms);
+
+            // Hand bytes to the driver. Returns the count taken, or -1.
+            int write(const uint8_t *data, size_t length);
+
+            // Bytes received and not read yet
+            size_t buffered() const;
+
+            void flushInput();
+            bool waitEvent(UartEvent &event, uint32_t timeout_ms);
+            void resetEvents();
+
+        private:
+            UartPort port = static_cast<UartPort>(0);
+            void *events = nullptr;
+        };
+    }
+}
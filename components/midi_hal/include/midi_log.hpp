@@ -0,0 +1,31 @@
+#pragma once
+
+// ESP_LOGx on the device, stderr on a host. Host builds print warnings and
+// errors only unless MIDI_HOST_LOG_LEVEL is raised (3 = info, 4 = debug).
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+
+#define MIDI_LOGE(tag, format, ...) ESP_LOGE(tag, format, ##__VA_ARGS__)
+#define MIDI_LOGW(tag, format, ...) ESP_LOGW(tag, format, ##__VA_ARGS__)
+#define MIDI_LOGI(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+#define MIDI_LOGD(tag, format, ...) ESP_LOGD(tag, format, ##__VA_ARGS__)
+#else
+#include <cstdio>
+
+#ifndef MIDI_HOST_LOG_LEVEL
+#define MIDI_HOST_LOG_LEVEL 2
+#endif
+
+#define MIDI_HOST_LOG(level, letter, tag, format, ...)                                \
+    do                                                                                \
+    {                                                                                 \
+        if (MIDI_HOST_LOG_LEVEL >= level)                                             \
+            std::fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__);    \
+    } while (0)
+
+#define MIDI_LOGE(tag, format, ...) MIDI_HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define MIDI_LOGW(tag, format, ...) MIDI_HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define MIDI_LOGI(tag, format, ...) MIDI_HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define MIDI_LOGD(tag, format, ...) MIDI_HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#endif
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "midi_hal.hpp"
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+// Binary trace of the MIDI hot paths.
+//
+// MIDI_TRACE(Event, a, b, c) stores a fixed-size record (32-bit
+// microsecond time, event id, up to 3 data bytes; 12 bytes of RAM with its
+// sequence word) in a ring: no formatting, no lock, no blocking, from any
+// task. Formatting happens
+// later, in a low-priority dumper task or in the host decoder
+// (host/trace_decode). Enabled by CONFIG_MIDI_TRACE (menuconfig on the
+// device, -DMIDI_TRACE=ON on the host); without it MIDI_TRACE compiles to
+// nothing.
+#if defined(CONFIG_MIDI_TRACE) && CONFIG_MIDI_TRACE
+#define MIDI_TRACE_ENABLED 1
+#else
+#define MIDI_TRACE_ENABLED 0
+#endif
+
+#ifndef CONFIG_MIDI_TRACE_RECORDS
+#define CONFIG_MIDI_TRACE_RECORDS 1024
+#endif
+
+namespace midi
+{
+    namespace trace
+    {
+        enum class Event : uint8_t
+        {
+            UartData = 1, // a, b: byte count (little endian)
+            UartOverflow, // Driver RX overflow, input flushed
+            RxMessage,    // Parsed on the UART task: status, data1, data2
+            RxDispatch,   // Handed to the MidiCallback: status, data1, data2
+            RxUnknown,    // MidiInParser found no handler: status, data1, data2
+            TxQueued,     // Entered the TX queue: status, data1, data2
+            TxWrite,      // Written to the UART: a, b = length (little endian), c = bytes accepted (max 255)
+            RxSysEx,      // SysEx chunk delivered: a, b = length (little endian), c = SysExFlags
+            Count
+        };
+
+        struct Record
+        {
+            uint32_t time_us; // Low 32 bits of hal::nowUs(), wraps every ~71 minutes
+            Event event;
+            uint8_t data[3];
+        };
+
+        static constexpr size_t kRecords = CONFIG_MIDI_TRACE_RECORDS;
+        static_assert((kRecords & (kRecords - 1)) == 0, "CONFIG_MIDI_TRACE_RECORDS must be a power of two");
+
+        // Overwriting ring: the newest kRecords records survive. Writers
+        // claim a slot with one fetch_add and publish it through the slot's
+        // sequence word; a reader that finds the sequence changed under it
+        // drops the record as overwritten.
+        class Ring
+        {
+        public:
+            void record(Event event, uint8_t a, uint8_t b, uint8_t c)
+            {
+                uint32_t index = head.fetch_add(1, std::memory_order_relaxed);
+                Slot &slot = slots[index & (kRecords - 1)];
+                slot.sequence.store(0, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                slot.time_us.store(static_cast<uint32_t>(hal::nowUs()), std::memory_order_relaxed);
+                slot.payload.store(static_cast<uint32_t>(event) | a << 8 | b << 16 | static_cast<uint32_t>(c) << 24,
+                                   std::memory_order_relaxed);
+                slot.sequence.store(index + 1, std::memory_order_release);
+            }
+
+            // Copies records from `cursor` on into `out` and advances it.
+            // Records already overwritten (the reader fell more than
+            // kRecords behind) are skipped and counted in `lost`; reading
+            // stops early at one still being written. A slot that still
+            // holds an older lap's record belongs to a writer that claimed
+            // it and has not started; rather than wait on a writer that may
+            // stay preempted while others lap the ring, that record counts
+            // as lost too.
+            size_t read(uint32_t &cursor, Record *out, size_t max, uint32_t &lost) const
+            {
+                uint32_t end = head.load(std::memory_order_acquire);
+                if (end - cursor > kRecords)
+                {
+                    lost += end - cursor - kRecords;
+                    cursor = end - kRecords;
+                }
+
+                size_t count = 0;
+                for (; cursor != end && count < max; ++cursor)
+                {
+                    const Slot &slot = slots[cursor & (kRecords - 1)];
+                    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+                    if (sequence != cursor + 1)
+                    {
+                        if (sequence == 0)
+                            break; // still being written: pick it up next time
+                        lost++;    // overwritten, or its writer stalled behind a lap
+                        continue;
+                    }
+                    uint32_t time_us = slot.time_us.load(std::memory_order_relaxed);
+                    uint32_t payload = slot.payload.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot.sequence.load(std::memory_order_relaxed) != cursor + 1)
+                    {
+                        lost++;
+                        continue;
+                    }
+                    out[count++] = Record{time_us, static_cast<Event>(payload & 0xFF),
+                                          {static_cast<uint8_t>(payload >> 8), static_cast<uint8_t>(payload >> 16),
+                                           static_cast<uint8_t>(payload >> 24)}};
+                }
+                return count;
+            }
+
+            // Index of the next record to be written; start a reader here to
+            // see only what comes next
+            uint32_t position() const { return head.load(std::memory_order_relaxed); }
+
+        private:
+            struct Slot
+            {
+                std::atomic<uint32_t> sequence{0}; // Index + 1 once written, 0 while being written
+                std::atomic<uint32_t> time_us{0};
+                std::atomic<uint32_t> payload{0};  // Event | a << 8 | b << 16 | c << 24
+            };
+
+            std::atomic<uint32_t> head{0};
+            Slot slots[kRecords];
+        };
+
+#if MIDI_TRACE_ENABLED
+        extern Ring ring;
+
+        namespace detail
+        {
+            inline void emit(Event event, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0)
+            {
+                ring.record(event, a, b, c);
+            }
+        }
+#endif
+
+        const char *eventName(Event event);
+
+        // Human-readable text for `record`, e.g. "rx 90 3C 64". Returns the
+        // length written (truncated to fit `size`).
+        size_t format(const Record &record, char *buffer, size_t size);
+
+        // Fixed-width hex for logs ("MT " and 16 hex digits) and back. The
+        // host decoder picks these out of a captured console log.
+        size_t toHex(const Record &record, char *buffer, size_t size);
+        bool fromHex(const char *text, Record &record);
+
+        enum class DumpFormat : uint8_t
+        {
+            Text, // Formatted on the device
+            Hex,  // Cheapest; decode with host/trace_decode
+        };
+
+        // Starts a task that drains the ring every `period_ms` and logs each
+        // record (MIDI_LOGI, tag "MidiTrace"). Give it the lowest priority
+        // that still keeps up. Does nothing without CONFIG_MIDI_TRACE.
+        void startDumper(DumpFormat format = DumpFormat::Hex, unsigned priority = 1, uint32_t period_ms = 100);
+    }
+}
+
+#if MIDI_TRACE_ENABLED
+#define MIDI_TRACE(event, ...) ::midi::trace::detail::emit(::midi::trace::Event::event, ##__VA_ARGS__)
+#else
+#define MIDI_TRACE(event, ...) ((void)0)
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "midi_hal.hpp"
+
+namespace midi
+{
+    namespace hal
+    {
+        // Host only: the POSIX backend's virtual UARTs.
+        //
+        // Every port has a TX line and an RX side. A byte written to a TX
+        // line starts when the line is free and lands on the connected RX
+        // one MIDI_BYTE_TIME_US later, so a burst takes exactly as long as
+        // it would on a 31.25 kbaud cable. The RX side raises Data events
+        // like the ESP driver: once rx_full_threshold bytes are waiting, or
+        // when the line has been idle for rx_timeout_threshold byte times.
+        // Unread bytes beyond rx_buffer_size are dropped with an Overflow.
+
+        // A byte on a wire, stamped with the time its stop bit ended
+        struct WireByte
+        {
+            uint8_t byte;
+            uint64_t time_us;
+        };
+
+        // Deliver `tx_port`'s output to `rx_port` (the same port for
+        // loopback). A port's output is also kept for captureUart().
+        void connectUarts(UartPort tx_port, UartPort rx_port);
+        void disconnectUart(UartPort tx_port);
+
+        // Bytes arriving on `port` from outside, at wire speed from now
+        void injectUart(UartPort port, const uint8_t *data, size_t length);
+
+        // Move bytes that have finished leaving `port` into `out`. Returns
+        // how many were taken.
+        size_t captureUart(UartPort port, WireByte *out, size_t max);
+
+        // Time the last byte written to `port` has left the wire
+        uint64_t uartIdleAt(UartPort port);
+    }
+}
@@ -0,0 +1,299 @@
+#include "midi_hal.hpp"
+#include <atomic>
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <soc/uart_reg.h>
+
+using namespace midi;
+
+namespace
+{
+    // esp_timer handle plus what ~Timer needs to wait out a running callback
+    struct EspTimer
+    {
+        esp_timer_handle_t timer = nullptr;
+        hal::Timer::Callback callback = nullptr;
+        void *arg = nullptr;
+        std::atomic<bool> running{false};
+        std::atomic<bool> deleting{false};
+        TaskHandle_t runningTask = nullptr; // The esp_timer task, once a callback has run
+    };
+
+    TickType_t toTicks(uint32_t timeout_ms)
+    {
+        if (timeout_ms == hal::kForever)
+            return portMAX_DELAY;
+        // Round up, so a short wait never turns into no wait at all
+        return static_cast<TickType_t>((static_cast<uint64_t>(timeout_ms) * configTICK_RATE_HZ + 999) / 1000);
+    }
+}
+
+uint64_t hal::nowUs()
+{
+    return static_cast<uint64_t>(esp_timer_get_time());
+}
+
+hal::TaskHandle hal::startTask(TaskEntry entry, void *arg, const char *name, uint32_t stack_bytes, unsigned priority)
+{
+    TaskHandle_t task = nullptr;
+    xTaskCreate(entry, name, stack_bytes, arg, priority, &task);
+    return task;
+}
+
+hal::TaskHandle hal::currentTask()
+{
+    return xTaskGetCurrentTaskHandle();
+}
+
+void hal::sleepMs(uint32_t ms)
+{
+    vTaskDelay(toTicks(ms));
+}
+
+void hal::notify(TaskHandle task)
+{
+    xTaskNotifyGive(static_cast<TaskHandle_t>(task));
+}
+
+bool hal::waitForNotify(uint32_t timeout_ms)
+{
+    return ulTaskNotifyTake(pdTRUE, toTicks(timeout_ms)) > 0;
+}
+
+hal::Queue::~Queue()
+{
+    if (handle)
+        vQueueDelete(static_cast<QueueHandle_t>(handle));
+}
+
+void hal::Queue::create(size_t length, size_t item_size)
+{
+    handle = xQueueCreate(length, item_size);
+}
+
+bool hal::Queue::send(const void *item, uint32_t timeout_ms)
+{
+    return xQueueSend(static_cast<QueueHandle_t>(handle), item, toTicks(timeout_ms)) == pdTRUE;
+}
+
+bool hal::Queue::receive(void *item, uint32_t timeout_ms)
+{
+    return xQueueReceive(static_cast<QueueHandle_t>(handle), item, toTicks(timeout_ms)) == pdTRUE;
+}
+
+void hal::Queue::reset()
+{
+    xQueueReset(static_cast<QueueHandle_t>(handle));
+}
+
+size_t hal::Queue::waiting() const
+{
+    return uxQueueMessagesWaiting(static_cast<QueueHandle_t>(handle));
+}
+
+hal::Mutex::~Mutex()
+{
+    if (handle)
+        vSemaphoreDelete(static_cast<SemaphoreHandle_t>(handle));
+}
+
+void hal::Mutex::create()
+{
+    handle = xSemaphoreCreateMutex();
+}
+
+void hal::Mutex::lock()
+{
+    xSemaphoreTake(static_cast<SemaphoreHandle_t>(handle), portMAX_DELAY);
+}
+
+void hal::Mutex::unlock()
+{
+    xSemaphoreGive(static_cast<SemaphoreHandle_t>(handle));
+}
+
+hal::Signal::~Signal()
+{
+    if (handle)
+        vSemaphoreDelete(static_cast<SemaphoreHandle_t>(handle));
+}
+
+void hal::Signal::create()
+{
+    handle = xSemaphoreCreateBinary();
+}
+
+void hal::Signal::give()
+{
+    xSemaphoreGive(static_cast<SemaphoreHandle_t>(handle));
+}
+
+bool hal::Signal::take(uint32_t timeout_ms)
+{
+    return xSemaphoreTake(static_cast<SemaphoreHandle_t>(handle), toTicks(timeout_ms)) == pdTRUE;
+}
+
+hal::Timer::~Timer()
+{
+    auto *timer = static_cast<EspTimer *>(handle);
+    if (!timer)
+        return;
+    // Either the callback sees `deleting` and skips, or we see it running
+    // and wait (both sequentially consistent)
+    timer->deleting.store(true);
+    esp_timer_stop(timer->timer);
+    while (timer->running.load() && timer->runningTask != xTaskGetCurrentTaskHandle())
+        vTaskDelay(1);
+    esp_timer_delete(timer->timer);
+    delete timer;
+}
+
+void hal::Timer::create(Callback callback, void *arg, const char *name, bool skip_missed)
+{
+    auto *timer = new EspTimer();
+    timer->callback = callback;
+    timer->arg = arg;
+    const esp_timer_create_args_t timer_args = {
+        .callback = [](void *self)
+        {
+            auto *timer = static_cast<EspTimer *>(self);
+            timer->runningTask = xTaskGetCurrentTaskHandle();
+            timer->running.store(true);
+            if (!timer->deleting.load())
+                timer->callback(timer->arg);
+            timer->running.store(false);
+        },
+        .arg = timer,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = name,
+        .skip_unhandled_events = skip_missed,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer->timer));
+    handle = timer;
+}
+
+// esp_timer refuses to start an armed timer (ESP_ERR_INVALID_STATE);
+// stop it and start again, as the POSIX backend re-arms
+void hal::Timer::startOnce(uint64_t delay_us)
+{
+    esp_timer_handle_t timer = static_cast<EspTimer *>(handle)->timer;
+    if (esp_timer_start_once(timer, delay_us) == ESP_ERR_INVALID_STATE)
+    {
+        esp_timer_stop(timer);
+        esp_timer_start_once(timer, delay_us);
+    }
+}
+
+void hal::Timer::startPeriodic(uint64_t period_us)
+{
+    esp_timer_handle_t timer = static_cast<EspTimer *>(handle)->timer;
+    if (esp_timer_start_periodic(timer, period_us) == ESP_ERR_INVALID_STATE)
+    {
+        esp_timer_stop(timer);
+        esp_timer_start_periodic(timer, period_us);
+    }
+}
+
+void hal::Timer::stop()
+{
+    esp_timer_stop(static_cast<EspTimer *>(handle)->timer);
+}
+
+bool hal::Timer::active() const
+{
+    return esp_timer_is_active(static_cast<EspTimer *>(handle)->timer);
+}
+
+void hal::Uart::open(const UartConfig &config)
+{
+    port = config.port;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+    // 31250 baud, 8N1
+    uart_config_t uart_cfg = {
+        .baud_rate = 31250,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE};
+#pragma GCC diagnostic pop
+
+    ESP_ERROR_CHECK(uart_param_config(port, &uart_cfg));
+    ESP_ERROR_CHECK(uart_set_pin(port, config.tx_pin, config.rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    QueueHandle_t queue = nullptr;
+    ESP_ERROR_CHECK(uart_driver_install(port,
+                                        config.rx_buffer_size,
+                                        config.tx_buffer_size,
+                                        config.event_queue_size,
+                                        config.event_queue_size ? &queue : nullptr,
+                                        0));
+    events = queue;
+
+    if (config.rx_full_threshold || config.rx_timeout_threshold)
+    {
+        uart_intr_config_t intr_conf = {
+            .intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M,
+            .rx_timeout_thresh = config.rx_timeout_threshold,
+            .txfifo_empty_intr_thresh = 10,
+            .rxfifo_full_thresh = config.rx_full_threshold,
+        };
+        ESP_ERROR_CHECK(uart_intr_config(port, &intr_conf));
+    }
+
+    ESP_ERROR_CHECK(uart_flush(port));
+}
+
+int hal::Uart::read(uint8_t *data, size_t max, uint32_t timeout_ms)
+{
+    return uart_read_bytes(port, data, max, toTicks(timeout_ms));
+}
+
+int hal::Uart::write(const uint8_t *data, size_t length)
+{
+    return uart_write_bytes(port, data, length);
+}
+
+size_t hal::Uart::buffered() const
+{
+    size_t length = 0;
+    if (uart_get_buffered_data_len(port, &length) != ESP_OK)
+        return 0;
+    return length;
+}
+
+void hal::Uart::flushInput()
+{
+    uart_flush_input(port);
+}
+
+bool hal::Uart::waitEvent(UartEvent &event, uint32_t timeout_ms)
+{
+    uart_event_t raw;
+    if (!events || !xQueueReceive(static_cast<QueueHandle_t>(events), &raw, toTicks(timeout_ms)))
+        return false;
+
+    switch (raw.type)
+    {
+    case UART_DATA:
+        event.type = UartEventType::Data;
+        break;
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+        event.type = UartEventType::Overflow;
+        break;
+    default:
+        event.type = UartEventType::Other;
+        break;
+    }
+    event.size = raw.size;
+    return true;
+}
+
+void hal::Uart::resetEvents()
+{
+    if (events)
+        xQueueReset(static_cast<QueueHandle_t>(events));
+}
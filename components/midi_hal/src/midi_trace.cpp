@@ -0,0 +1,155 @@
+#include "midi_trace.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include "midi_log.hpp"
+
+using namespace midi;
+
+#if MIDI_TRACE_ENABLED
+trace::Ring trace::ring;
+#endif
+
+namespace
+{
+    const char *const kEventNames[] = {
+        "?",
+        "uart",
+        "overflow",
+        "rx",
+        "dispatch",
+        "unknown",
+        "tx queued",
+        "tx write",
+        "sysex",
+    };
+    static_assert(sizeof(kEventNames) / sizeof(kEventNames[0]) == static_cast<size_t>(trace::Event::Count),
+                  "one name per trace event");
+
+    size_t clampLength(int written, size_t size)
+    {
+        if (written < 0 || size == 0)
+            return 0;
+        return static_cast<size_t>(written) < size ? static_cast<size_t>(written) : size - 1;
+    }
+}
+
+const char *trace::eventName(Event event)
+{
+    size_t index = static_cast<size_t>(event);
+    return index < static_cast<size_t>(Event::Count) ? kEventNames[index] : kEventNames[0];
+}
+
+size_t trace::format(const Record &record, char *buffer, size_t size)
+{
+    const uint8_t *d = record.data;
+    const char *name = eventName(record.event);
+    int written;
+    switch (record.event)
+    {
+    case Event::UartData:
+        written = std::snprintf(buffer, size, "%s %u bytes", name, static_cast<unsigned>(d[0] | d[1] << 8));
+        break;
+    case Event::UartOverflow:
+        written = std::snprintf(buffer, size, "%s", name);
+        break;
+    case Event::TxWrite:
+        written = std::snprintf(buffer, size, "%s len=%u wrote=%u", name, static_cast<unsigned>(d[0] | d[1] << 8), d[2]);
+        break;
+    case Event::RxSysEx:
+        written = std::snprintf(buffer, size, "%s len=%u%s%s%s", name, static_cast<unsigned>(d[0] | d[1] << 8),
+                                d[2] & 0x01 ? " start" : "", d[2] & 0x02 ? " end" : "", d[2] & 0x04 ? " aborted" : "");
+        break;
+    default:
+        written = std::snprintf(buffer, size, "%s %02X %02X %02X", name, d[0], d[1], d[2]);
+        break;
+    }
+    return clampLength(written, size);
+}
+
+size_t trace::toHex(const Record &record, char *buffer, size_t size)
+{
+    int written = std::snprintf(buffer, size, "MT %08X%02X%02X%02X%02X", static_cast<unsigned>(record.time_us),
+                                static_cast<unsigned>(record.event), record.data[0], record.data[1], record.data[2]);
+    return clampLength(written, size);
+}
+
+bool trace::fromHex(const char *text, Record &record)
+{
+    if (text[0] != 'M' || text[1] != 'T' || text[2] != ' ')
+        return false;
+
+    char digits[17];
+    for (size_t i = 0; i < 16; ++i)
+    {
+        char c = text[3 + i];
+        bool hex = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+        if (!hex)
+            return false;
+        digits[i] = c;
+    }
+    digits[16] = '\0';
+
+    uint64_t value = std::strtoull(digits, nullptr, 16);
+    record.time_us = static_cast<uint32_t>(value >> 32);
+    record.event = static_cast<Event>((value >> 24) & 0xFF);
+    record.data[0] = static_cast<uint8_t>(value >> 16);
+    record.data[1] = static_cast<uint8_t>(value >> 8);
+    record.data[2] = static_cast<uint8_t>(value);
+    return true;
+}
+
+#if MIDI_TRACE_ENABLED
+namespace
+{
+    const char *TAG = "MidiTrace";
+
+    struct DumperConfig
+    {
+        trace::DumpFormat format;
+        uint32_t period_ms;
+    };
+
+    void dumpLoop(void *arg)
+    {
+        DumperConfig config = *static_cast<DumperConfig *>(arg);
+        delete static_cast<DumperConfig *>(arg);
+
+        uint32_t cursor = trace::ring.position();
+        trace::Record records[32];
+        char line[48];
+        while (true)
+        {
+            uint32_t lost = 0;
+            size_t count;
+            while ((count = trace::ring.read(cursor, records, 32, lost)) > 0)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (config.format == trace::DumpFormat::Hex)
+                    {
+                        trace::toHex(records[i], line, sizeof(line));
+                        MIDI_LOGI(TAG, "%s", line);
+                    }
+                    else
+                    {
+                        trace::format(records[i], line, sizeof(line));
+                        MIDI_LOGI(TAG, "%10u %s", static_cast<unsigned>(records[i].time_us), line);
+                    }
+                }
+            }
+            if (lost)
+                MIDI_LOGW(TAG, "%u records overwritten before they were dumped", static_cast<unsigned>(lost));
+            hal::sleepMs(config.period_ms);
+        }
+    }
+}
+
+void trace::startDumper(DumpFormat format, unsigned priority, uint32_t period_ms)
+{
+    hal::startTask(dumpLoop, new DumperConfig{format, period_ms}, "midi_trace", 3072, priority);
+}
+#else
+void trace::startDumper(DumpFormat, unsigned, uint32_t)
+{
+}
+#endif
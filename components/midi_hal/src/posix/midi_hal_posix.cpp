@@ -0,0 +1,399 @@
+#include "midi_hal.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace midi;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    const Clock::time_point kBoot = Clock::now();
+
+    Clock::time_point atUs(uint64_t time_us)
+    {
+        return kBoot + std::chrono::microseconds(time_us);
+    }
+
+    // Waits on `cv` until `ready()` or the timeout; true when ready
+    template <typename Ready>
+    bool waitFor(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, uint32_t timeout_ms, Ready ready)
+    {
+        if (timeout_ms == hal::kForever)
+        {
+            cv.wait(lock, ready);
+            return true;
+        }
+        return cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+    }
+
+    struct PosixTask
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        uint32_t notifications = 0;
+    };
+
+    thread_local PosixTask *currentPosixTask = nullptr;
+
+    PosixTask &self()
+    {
+        // Threads the HAL did not start (e.g. main) get a record on first use
+        if (!currentPosixTask)
+            currentPosixTask = new PosixTask();
+        return *currentPosixTask;
+    }
+
+    struct PosixQueue
+    {
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+        std::vector<uint8_t> storage;
+        size_t itemSize = 0;
+        size_t length = 0;
+        size_t head = 0;
+        size_t count = 0;
+    };
+
+    struct PosixSignal
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool given = false;
+    };
+
+    struct PosixTimer
+    {
+        hal::Timer::Callback callback = nullptr;
+        void *arg = nullptr;
+        bool skipMissed = true;
+        bool armed = false;
+        uint64_t due_us = 0;
+        uint64_t period_us = 0; // 0 = one-shot
+    };
+
+    // Runs every timer callback on one thread, like the esp_timer task
+    class TimerService
+    {
+    public:
+        static TimerService &instance()
+        {
+            static TimerService *service = new TimerService();
+            return *service;
+        }
+
+        void add(PosixTimer *timer)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            timers.push_back(timer);
+        }
+
+        // Once this returns the callback is not running and won't run
+        // again, unless it is the callback itself that removes its timer
+        void remove(PosixTimer *timer)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (auto it = timers.begin(); it != timers.end(); ++it)
+            {
+                if (*it == timer)
+                {
+                    timers.erase(it);
+                    break;
+                }
+            }
+            if (std::this_thread::get_id() != serviceThread)
+                idle.wait(lock, [&]
+                          { return running != timer; });
+        }
+
+        void arm(PosixTimer *timer, uint64_t delay_us, uint64_t period_us)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            timer->due_us = hal::nowUs() + delay_us;
+            timer->period_us = period_us;
+            timer->armed = true;
+            cv.notify_one();
+        }
+
+        void disarm(PosixTimer *timer)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            timer->armed = false;
+        }
+
+        bool armed(const PosixTimer *timer)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return timer->armed;
+        }
+
+    private:
+        TimerService()
+        {
+            std::thread service([this]
+                                { run(); });
+            serviceThread = service.get_id();
+            service.detach();
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                PosixTimer *next = nullptr;
+                for (PosixTimer *timer : timers)
+                {
+                    if (timer->armed && (!next || timer->due_us < next->due_us))
+                        next = timer;
+                }
+
+                if (!next)
+                {
+                    cv.wait(lock);
+                    continue;
+                }
+
+                uint64_t now_us = hal::nowUs();
+                if (next->due_us > now_us)
+                {
+                    cv.wait_until(lock, atUs(next->due_us));
+                    continue;
+                }
+
+                if (next->period_us)
+                {
+                    next->due_us += next->period_us;
+                    if (next->skipMissed && next->due_us <= now_us)
+                        next->due_us = now_us + next->period_us;
+                }
+                else
+                {
+                    next->armed = false;
+                }
+
+                hal::Timer::Callback callback = next->callback;
+                void *arg = next->arg;
+                running = next;
+                lock.unlock();
+                callback(arg);
+                lock.lock();
+                running = nullptr;
+                idle.notify_all();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::condition_variable idle; // A callback has returned
+        std::vector<PosixTimer *> timers;
+        PosixTimer *running = nullptr; // Whose callback is running
+        std::thread::id serviceThread;
+    };
+}
+
+uint64_t hal::nowUs()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - kBoot).count());
+}
+
+hal::TaskHandle hal::startTask(TaskEntry entry, void *arg, const char *, uint32_t, unsigned)
+{
+    auto *task = new PosixTask();
+    std::thread([task, entry, arg]
+                {
+                    currentPosixTask = task;
+                    entry(arg); })
+        .detach();
+    return task;
+}
+
+hal::TaskHandle hal::currentTask()
+{
+    return &self();
+}
+
+void hal::sleepMs(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void hal::notify(TaskHandle handle)
+{
+    auto *task = static_cast<PosixTask *>(handle);
+    {
+        std::lock_guard<std::mutex> guard(task->mutex);
+        task->notifications++;
+    }
+    task->cv.notify_one();
+}
+
+bool hal::waitForNotify(uint32_t timeout_ms)
+{
+    PosixTask &task = self();
+    std::unique_lock<std::mutex> lock(task.mutex);
+    if (!waitFor(task.cv, lock, timeout_ms, [&]
+                 { return task.notifications > 0; }))
+        return false;
+    task.notifications = 0;
+    return true;
+}
+
+hal::Queue::~Queue()
+{
+    delete static_cast<PosixQueue *>(handle);
+}
+
+void hal::Queue::create(size_t length, size_t item_size)
+{
+    auto *queue = new PosixQueue();
+    queue->storage.resize(length * item_size);
+    queue->itemSize = item_size;
+    queue->length = length;
+    handle = queue;
+}
+
+bool hal::Queue::send(const void *item, uint32_t timeout_ms)
+{
+    auto &queue = *static_cast<PosixQueue *>(handle);
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!waitFor(queue.notFull, lock, timeout_ms, [&]
+                 { return queue.count < queue.length; }))
+        return false;
+
+    size_t slot = (queue.head + queue.count) % queue.length;
+    std::memcpy(&queue.storage[slot * queue.itemSize], item, queue.itemSize);
+    queue.count++;
+    lock.unlock();
+    queue.notEmpty.notify_one();
+    return true;
+}
+
+bool hal::Queue::receive(void *item, uint32_t timeout_ms)
+{
+    auto &queue = *static_cast<PosixQueue *>(handle);
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!waitFor(queue.notEmpty, lock, timeout_ms, [&]
+                 { return queue.count > 0; }))
+        return false;
+
+    std::memcpy(item, &queue.storage[queue.head * queue.itemSize], queue.itemSize);
+    queue.head = (queue.head + 1) % queue.length;
+    queue.count--;
+    lock.unlock();
+    queue.notFull.notify_one();
+    return true;
+}
+
+void hal::Queue::reset()
+{
+    auto &queue = *static_cast<PosixQueue *>(handle);
+    {
+        std::lock_guard<std::mutex> guard(queue.mutex);
+        queue.head = 0;
+        queue.count = 0;
+    }
+    queue.notFull.notify_all();
+}
+
+size_t hal::Queue::waiting() const
+{
+    auto &queue = *static_cast<PosixQueue *>(handle);
+    std::lock_guard<std::mutex> guard(queue.mutex);
+    return queue.count;
+}
+
+hal::Mutex::~Mutex()
+{
+    delete static_cast<std::mutex *>(handle);
+}
+
+void hal::Mutex::create()
+{
+    handle = new std::mutex();
+}
+
+void hal::Mutex::lock()
+{
+    static_cast<std::mutex *>(handle)->lock();
+}
+
+void hal::Mutex::unlock()
+{
+    static_cast<std::mutex *>(handle)->unlock();
+}
+
+hal::Signal::~Signal()
+{
+    delete static_cast<PosixSignal *>(handle);
+}
+
+void hal::Signal::create()
+{
+    handle = new PosixSignal();
+}
+
+void hal::Signal::give()
+{
+    auto &signal = *static_cast<PosixSignal *>(handle);
+    {
+        std::lock_guard<std::mutex> guard(signal.mutex);
+        signal.given = true;
+    }
+    signal.cv.notify_one();
+}
+
+bool hal::Signal::take(uint32_t timeout_ms)
+{
+    auto &signal = *static_cast<PosixSignal *>(handle);
+    std::unique_lock<std::mutex> lock(signal.mutex);
+    if (!waitFor(signal.cv, lock, timeout_ms, [&]
+                 { return signal.given; }))
+        return false;
+    signal.given = false;
+    return true;
+}
+
+hal::Timer::~Timer()
+{
+    if (!handle)
+        return;
+    auto *timer = static_cast<PosixTimer *>(handle);
+    TimerService::instance().disarm(timer);
+    TimerService::instance().remove(timer);
+    delete timer;
+}
+
+void hal::Timer::create(Callback callback, void *arg, const char *, bool skip_missed)
+{
+    auto *timer = new PosixTimer();
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->skipMissed = skip_missed;
+    TimerService::instance().add(timer);
+    handle = timer;
+}
+
+void hal::Timer::startOnce(uint64_t delay_us)
+{
+    TimerService::instance().arm(static_cast<PosixTimer *>(handle), delay_us, 0);
+}
+
+void hal::Timer::startPeriodic(uint64_t period_us)
+{
+    TimerService::instance().arm(static_cast<PosixTimer *>(handle), period_us, period_us);
+}
+
+void hal::Timer::stop()
+{
+    TimerService::instance().disarm(static_cast<PosixTimer *>(handle));
+}
+
+bool hal::Timer::active() const
+{
+    return TimerService::instance().armed(static_cast<const PosixTimer *>(handle));
+}
@@ -0,0 +1,275 @@
+#include "virtual_uart.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+using namespace midi;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    constexpr uint64_t kByteTimeUs = 10 * 1000000 / 31250; // 8N1 frame at MIDI speed
+    constexpr size_t kCaptureLimit = 65536;                // Oldest captured bytes are dropped past this
+    constexpr uint8_t kDefaultFullThreshold = 120;         // ESP driver defaults
+    constexpr uint8_t kDefaultTimeoutThreshold = 10;
+
+    struct Port
+    {
+        bool open = false;
+        size_t rxCapacity = 256;
+        uint8_t fullThreshold = kDefaultFullThreshold;
+        uint8_t timeoutThreshold = kDefaultTimeoutThreshold;
+
+        // Receive side
+        std::deque<hal::WireByte> inFlight; // Still on the wire, in arrival order
+        std::deque<uint8_t> rx;             // Landed, not read yet
+        size_t unreported = 0;              // Landed since the last Data event
+        bool overflowed = false;
+        uint64_t lastLanded_us = 0;
+        uint64_t injectFree_us = 0;         // Inbound line busy until
+        std::condition_variable cv;
+
+        // Transmit side
+        bool connected = false;
+        hal::UartPort peer = 0;
+        uint64_t txFree_us = 0;
+        std::deque<hal::WireByte> captured;
+    };
+
+    // Never destroyed: UART tasks may still wait on a port at exit
+    std::mutex &portsMutex = *new std::mutex(); // Guards every port
+    std::map<hal::UartPort, Port> &ports = *new std::map<hal::UartPort, Port>();
+
+    Port &portFor(hal::UartPort port)
+    {
+        return ports[port];
+    }
+
+    Clock::time_point atUs(uint64_t time_us)
+    {
+        return Clock::now() + std::chrono::microseconds(time_us - hal::nowUs());
+    }
+
+    // Lands every byte whose stop bit has ended by `now_us`
+    void settle(Port &port, uint64_t now_us)
+    {
+        while (!port.inFlight.empty() && port.inFlight.front().time_us <= now_us)
+        {
+            const hal::WireByte &byte = port.inFlight.front();
+            if (port.rx.size() >= port.rxCapacity)
+            {
+                port.overflowed = true;
+            }
+            else
+            {
+                port.rx.push_back(byte.byte);
+                port.unreported++;
+            }
+            port.lastLanded_us = byte.time_us;
+            port.inFlight.pop_front();
+        }
+    }
+
+    void deliver(Port &port, uint8_t byte, uint64_t time_us)
+    {
+        // Keep arrival order even if two sources share one RX
+        auto it = port.inFlight.end();
+        while (it != port.inFlight.begin() && (it - 1)->time_us > time_us)
+            --it;
+        port.inFlight.insert(it, hal::WireByte{byte, time_us});
+        port.cv.notify_all();
+    }
+
+    // Earliest time the RX side has something new to report
+    uint64_t nextWake(const Port &port)
+    {
+        uint64_t wake = UINT64_MAX;
+        if (!port.inFlight.empty())
+            wake = port.inFlight.front().time_us;
+        if (port.unreported)
+        {
+            uint64_t idle = port.lastLanded_us + port.timeoutThreshold * kByteTimeUs;
+            if (idle < wake)
+                wake = idle;
+        }
+        return wake;
+    }
+}
+
+void hal::connectUarts(UartPort tx_port, UartPort rx_port)
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &port = portFor(tx_port);
+    portFor(rx_port);
+    port.connected = true;
+    port.peer = rx_port;
+}
+
+void hal::disconnectUart(UartPort tx_port)
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    portFor(tx_port).connected = false;
+}
+
+void hal::injectUart(UartPort port_num, const uint8_t *data, size_t length)
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &port = portFor(port_num);
+    uint64_t now_us = nowUs();
+    uint64_t start_us = port.injectFree_us > now_us ? port.injectFree_us : now_us;
+    for (size_t i = 0; i < length; ++i)
+    {
+        start_us += kByteTimeUs;
+        deliver(port, data[i], start_us);
+    }
+    port.injectFree_us = start_us;
+}
+
+size_t hal::captureUart(UartPort port_num, WireByte *out, size_t max)
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &port = portFor(port_num);
+    uint64_t now_us = nowUs();
+    size_t count = 0;
+    while (count < max && !port.captured.empty() && port.captured.front().time_us <= now_us)
+    {
+        out[count++] = port.captured.front();
+        port.captured.pop_front();
+    }
+    return count;
+}
+
+uint64_t hal::uartIdleAt(UartPort port_num)
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    return portFor(port_num).txFree_us;
+}
+
+void hal::Uart::open(const UartConfig &config)
+{
+    port = config.port;
+
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &state = portFor(port);
+    state.open = true;
+    state.rxCapacity = config.rx_buffer_size ? config.rx_buffer_size : 256;
+    state.fullThreshold = config.rx_full_threshold ? config.rx_full_threshold : kDefaultFullThreshold;
+    state.timeoutThreshold = config.rx_timeout_threshold ? config.rx_timeout_threshold : kDefaultTimeoutThreshold;
+    state.rx.clear();
+    state.unreported = 0;
+    state.overflowed = false;
+}
+
+int hal::Uart::read(uint8_t *data, size_t max, uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(portsMutex);
+    Port &state = portFor(port);
+    uint64_t deadline_us = timeout_ms == kForever ? UINT64_MAX : nowUs() + static_cast<uint64_t>(timeout_ms) * 1000;
+
+    while (true)
+    {
+        uint64_t now_us = nowUs();
+        settle(state, now_us);
+        if (!state.rx.empty() || now_us >= deadline_us)
+            break;
+        uint64_t wake = state.inFlight.empty() ? deadline_us : state.inFlight.front().time_us;
+        if (wake > deadline_us)
+            wake = deadline_us;
+        if (wake == UINT64_MAX)
+            state.cv.wait(lock);
+        else
+            state.cv.wait_until(lock, atUs(wake));
+    }
+
+    size_t count = 0;
+    while (count < max && !state.rx.empty())
+    {
+        data[count++] = state.rx.front();
+        state.rx.pop_front();
+    }
+    return static_cast<int>(count);
+}
+
+int hal::Uart::write(const uint8_t *data, size_t length)
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &state = portFor(port);
+    uint64_t now_us = nowUs();
+    uint64_t end_us = state.txFree_us > now_us ? state.txFree_us : now_us;
+    for (size_t i = 0; i < length; ++i)
+    {
+        end_us += kByteTimeUs;
+        if (state.captured.size() >= kCaptureLimit)
+            state.captured.pop_front();
+        state.captured.push_back(WireByte{data[i], end_us});
+        if (state.connected)
+            deliver(portFor(state.peer), data[i], end_us);
+    }
+    state.txFree_us = end_us;
+    return static_cast<int>(length);
+}
+
+size_t hal::Uart::buffered() const
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &state = portFor(port);
+    settle(state, nowUs());
+    return state.rx.size();
+}
+
+void hal::Uart::flushInput()
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &state = portFor(port);
+    settle(state, nowUs());
+    state.rx.clear();
+    state.unreported = 0;
+}
+
+bool hal::Uart::waitEvent(UartEvent &event, uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(portsMutex);
+    Port &state = portFor(port);
+    uint64_t deadline_us = timeout_ms == kForever ? UINT64_MAX : nowUs() + static_cast<uint64_t>(timeout_ms) * 1000;
+
+    while (true)
+    {
+        uint64_t now_us = nowUs();
+        settle(state, now_us);
+
+        if (state.overflowed)
+        {
+            state.overflowed = false;
+            event = UartEvent{UartEventType::Overflow, 0};
+            return true;
+        }
+        if (state.unreported &&
+            (state.unreported >= state.fullThreshold ||
+             now_us >= state.lastLanded_us + state.timeoutThreshold * kByteTimeUs))
+        {
+            event = UartEvent{UartEventType::Data, state.unreported};
+            state.unreported = 0;
+            return true;
+        }
+        if (now_us >= deadline_us)
+            return false;
+
+        uint64_t wake = nextWake(state);
+        if (wake > deadline_us)
+            wake = deadline_us;
+        if (wake == UINT64_MAX)
+            state.cv.wait(lock);
+        else
+            state.cv.wait_until(lock, atUs(wake));
+    }
+}
+
+void hal::Uart::resetEvents()
+{
+    std::lock_guard<std::mutex> guard(portsMutex);
+    Port &state = portFor(port);
+    state.unreported = 0;
+    state.overflowed = false;
+}
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <functional>
+#include "tempo_estimator.hpp"
 
 namespace midi
 {
@@ -10,28 +11,42 @@ namespace midi
     public:
         using BpmCallback = std::function<void(uint8_t bpm)>;
 
+        // Every tick once the estimator has locked: Q16.16 BPM and 0–100 confidence
+        using TempoCallback = std::function<void(BpmQ16 bpm, uint8_t confidence)>;
+
+        // What update() produced
+        enum UpdateFlags : uint8_t
+        {
+            TempoUpdated = 1, // bpmQ16() and confidence() are fresh
+            BpmChanged = 2,   // bpm() changed
+        };
+
         BpmCounter();
 
         void setCallback(BpmCallback callback);
+        void setTempoCallback(TempoCallback callback);
         void onClockTick(uint64_t timestamp_us); // call this on each 0xF8 clock tick
+
+        // Same tick bookkeeping without the callbacks. Returns UpdateFlags.
+        uint8_t update(uint64_t timestamp_us);
+
+        // Whole BPM (saturates at 255), reported once a full beat is in the
+        // window and moved only when the tempo leaves the current value by
+        // more than kBpmHysteresis
+        uint8_t bpm() const { return currentBpm; }
+        BpmQ16 bpmQ16() const { return estimator.bpm(); }
+        uint8_t confidence() const { return estimator.confidence(); }
         void stop();
         void start();
 
     private:
+        static constexpr BpmQ16 kBpmHysteresis = bpmToQ16(0.6f);
+
         BpmCallback bpmCallback;
-        uint64_t lastBeatTimestamp = 0;
-        uint8_t clockCount = 0;
+        TempoCallback tempoCallback;
+        TempoEstimator estimator;
         uint8_t currentBpm = 0;
-
-        static constexpr uint8_t clocksPerBeat = 24;
         bool isActive = true;
-        uint8_t historyCount = 0; // number of BPM samples collected so far
-
-        // Moving average smoothing
-        static constexpr size_t kAvgWindow = 4;
-        float bpmHistory[kAvgWindow] = {0.0f};
-        float bpmSum = 0.0f;
-        uint8_t bpmIndex = 0;
     };
 
 } // namespace midi_module
@@ -1,29 +1,72 @@
 #pragma once
 
-#include "driver/gpio.h"
-#include "driver/uart.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include <atomic>
 #include <functional>
 #include <array>
+#include "latency_histogram.hpp"
+#include "midi_hal.hpp"
+#include "midi_protocol.hpp"
+#include "midi_stream_parser.hpp"
+#include "note_tracker.hpp"
+#include "spsc_ring.hpp"
 
 // MIDI UART and task parameters (fixed)
 
 namespace midi
 {
 
-    // Callback invoked for each received MIDI byte
-    using Packet4 = std::array<uint8_t, 4>;
+    // Callback invoked for each complete received MIDI message, with the
+    // arrival time (hal::nowUs microseconds) of its first byte
+    using MidiCallback = std::function<void(Packet4, uint64_t timestamp_us)>;
 
-    using MidiCallback = std::function<void(Packet4)>;
+    // Sees every received message on the UART task, before it is queued
+    // for the consumer. Must be quick and must not block (e.g. MidiThru).
+    using MidiEventHook = std::function<void(const MidiEvent &)>;
+
+    // The sender stopped Active Sensing: nothing arrived for the timeout
+    // after a 0xFE. Release held notes here. With a MidiCallback it runs on
+    // the dispatch task after the messages before it, so it may touch what
+    // the callback feeds (e.g. MidiInParser::releaseHeldNotes()); without
+    // one, on the UART task.
+    using MidiSensingLostCallback = std::function<void(uint64_t timestamp_us)>;
 
     // Configuration for the MIDI input component
     struct MidiInConfig
     {
-        gpio_num_t receivePin;                              // RX pin
-        uart_port_t uart_num;        // UART port to use
+        hal::Pin receivePin;                              // RX pin
+        hal::UartPort uart_num;      // UART port to use
         size_t rx_buffer_size = 256; // UART RX buffer
-        TickType_t rx_timeout = pdMS_TO_TICKS(20);
+        uint32_t rx_timeout_ms = 20;
+        bool chunked_read = true;    // Drain the RX buffer in chunks instead of byte by byte
+        unsigned dispatch_priority = hal::kMaxPriority - 6; // Task running the MidiCallback
+        uint32_t active_sensing_timeout_ms = 300; // Silence after a 0xFE that counts as lost, 0 = ignore
+        bool latency_probes = true;  // Fill the histograms behind getLatency()
+        uint8_t cable = 0;           // USB MIDI cable number (0–15) in byte 0 of every packet
+    };
+
+    // Read path counters, to see how well UART reads are batched
+    struct MidiInStats
+    {
+        uint32_t reads = 0; // UART reads that returned data
+        uint32_t bytes = 0; // Bytes received
+        uint32_t sysex_dropped = 0; // SysEx messages cut short, chunk pool empty
+        uint32_t ring_high_water = 0; // Most events waiting for the consumer at once
+        uint32_t ring_overflows = 0;  // Events lost because the consumer fell behind
+        uint32_t sensing_lost = 0;    // Active Sensing timeouts
+        uint32_t parse_errors = 0;    // Malformed bytes, see MidiStreamParser::parseErrors
+        uint32_t uart_overflows = 0;  // Driver RX buffer overflows (input flushed)
+
+        float bytesPerRead() const { return reads ? static_cast<float>(bytes) / reads : 0.0f; }
+    };
+
+    // Where received messages spend their time. Arrival is the message
+    // timestamp: the UART event time, back-dated one byte time per byte
+    // still behind it.
+    struct MidiInLatency
+    {
+        LatencyHistogram::Snapshot parse;    // UART event until the message is parsed and queued
+        LatencyHistogram::Snapshot delivery; // Arrival until read() or the dispatch task takes it
+        LatencyHistogram::Snapshot callback; // Time spent in the MidiCallback
     };
 
     class MidiIn
@@ -32,16 +75,76 @@ namespace midi
         // Construct with config (but does not start I/O until init)
         explicit MidiIn(const MidiInConfig &config);
 
-        // Set the callback and start the MIDI input task
+        // Start the MIDI input task. The UART task only parses and publishes
+        // events to a lock-free ring; with a callback, a separate dispatch
+        // task drains the ring and runs it. With nullptr, drain with read().
         void init(MidiCallback cb);
 
+        // Move up to `max` received events into `events`, waiting up to
+        // `timeout_ms` (hal::kForever to block) for the first one. The ring
+        // has a single consumer: use this only from one task, and only when
+        // init() got no callback (with one, the dispatch task consumes).
+        size_t read(MidiEvent *events, size_t max, uint32_t timeout_ms);
+
+        // Receive SysEx as chunks from a fixed pool (start/continue/end flags).
+        // Call before init(); without it SysEx is skipped.
+        void setSysExCallback(SysExCallback cb);
+
+        // Forward each message as soon as it is parsed (MIDI thru). Call
+        // before init(). SysEx is not passed to the hook.
+        void setThruHook(MidiEventHook hook);
+
+        // Called when Active Sensing times out (see MidiInConfig). Call
+        // before init(). Typically: midiOut.releaseHeldNotes() and
+        // parser.releaseHeldNotes(timestamp_us).
+        void setSensingLostCallback(MidiSensingLostCallback cb);
+
+        MidiInStats getStats() const;
+
+        // Lock-free copy of the latency histograms (needs latency_probes);
+        // callable from any task
+        MidiInLatency getLatency() const;
+
     private:
+        static constexpr size_t kRxChunkSize = 64;
+        static constexpr size_t kEventRingSize = 128;
+        static constexpr size_t kDispatchBatch = 16;
+
         void taskLoop();
+        void dispatchLoop();
+        void readPerByte(uint64_t event_us, size_t event_size);
+        void readChunked(size_t available);
+        void publish(const MidiEvent &event);
+        void publishParserCounters();
+        uint32_t sensingWait() const;
 
         MidiInConfig config;   // UART and timing configuration
-        MidiCallback callback; // User callback for each byte
-        TaskHandle_t task_handle = nullptr;
-        QueueHandle_t uart_queue = nullptr;
+        MidiCallback callback; // User callback for each message
+        MidiEventHook thruHook; // Runs on the UART task
+        MidiSensingLostCallback sensingLost; // Runs on the dispatch task, if any
+        std::atomic<uint64_t> sensingLostAt{0}; // UART task to dispatch task, 0 = none
+        ActiveSensingWatch sensing;
+        MidiStreamParser streamParser; // Byte-level state, kept across UART events
+        hal::TaskHandle task_handle = nullptr;
+        hal::TaskHandle dispatch_handle = nullptr;
+        std::atomic<hal::TaskHandle> consumer{nullptr}; // Task woken when events are published
+        hal::Uart uart;
+        SpscRing<MidiEvent, kEventRingSize> events;
+        uint8_t rxChunk[kRxChunkSize];
+        SysExChunkPool sysexPool;
+
+        // Written by the UART task, read by getStats() from any task
+        std::atomic<uint32_t> uartReads{0};
+        std::atomic<uint32_t> rxBytes{0};
+        std::atomic<uint32_t> sensingLostCount{0};
+        std::atomic<uint32_t> uartOverflows{0};
+        std::atomic<uint32_t> parseErrors{0};  // Copied from streamParser after each read
+        std::atomic<uint32_t> sysexDropped{0}; // Likewise
+
+        uint64_t uartEvent_us = 0;      // Current UART event, for the parse probe
+        LatencyHistogram parseLatency;    // Written by the UART task
+        LatencyHistogram deliveryLatency; // Written by the consumer
+        LatencyHistogram callbackLatency; // Written by the dispatch task
     };
 
 } // namespace midi_in
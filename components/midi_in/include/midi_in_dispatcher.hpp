@@ -0,0 +1,360 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include "bpm_counter.hpp"
+#include "controller_aggregator.hpp"
+#include "midi_protocol.hpp"
+#include "note_tracker.hpp"
+#include "usb_midi.hpp"
+
+namespace midi
+{
+    namespace detail
+    {
+        // Detects whether Handler implements a given hook
+        template <typename H, typename = void>
+        struct HasOnNote : std::false_type {};
+        template <typename H>
+        struct HasOnNote<H, std::void_t<decltype(std::declval<H &>().onNote(std::declval<const NoteMessage &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnControllerChange : std::false_type {};
+        template <typename H>
+        struct HasOnControllerChange<H, std::void_t<decltype(std::declval<H &>().onControllerChange(std::declval<const ControllerChange &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnPolyAftertouch : std::false_type {};
+        template <typename H>
+        struct HasOnPolyAftertouch<H, std::void_t<decltype(std::declval<H &>().onPolyAftertouch(std::declval<const PolyAftertouch &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnProgramChange : std::false_type {};
+        template <typename H>
+        struct HasOnProgramChange<H, std::void_t<decltype(std::declval<H &>().onProgramChange(std::declval<const ProgramChange &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnChannelPressure : std::false_type {};
+        template <typename H>
+        struct HasOnChannelPressure<H, std::void_t<decltype(std::declval<H &>().onChannelPressure(std::declval<const ChannelPressure &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnPitchBend : std::false_type {};
+        template <typename H>
+        struct HasOnPitchBend<H, std::void_t<decltype(std::declval<H &>().onPitchBend(std::declval<const PitchBend &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnHighResController : std::false_type {};
+        template <typename H>
+        struct HasOnHighResController<H, std::void_t<decltype(std::declval<H &>().onHighResController(std::declval<const HighResController &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnParameterChange : std::false_type {};
+        template <typename H>
+        struct HasOnParameterChange<H, std::void_t<decltype(std::declval<H &>().onParameterChange(std::declval<const ParameterChange &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnSongPosition : std::false_type {};
+        template <typename H>
+        struct HasOnSongPosition<H, std::void_t<decltype(std::declval<H &>().onSongPosition(std::declval<const SongPosition &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnTransport : std::false_type {};
+        template <typename H>
+        struct HasOnTransport<H, std::void_t<decltype(std::declval<H &>().onTransport(std::declval<const TransportEvent &>(), uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnTimingClock : std::false_type {};
+        template <typename H>
+        struct HasOnTimingClock<H, std::void_t<decltype(std::declval<H &>().onTimingClock(uint64_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnBpm : std::false_type {};
+        template <typename H>
+        struct HasOnBpm<H, std::void_t<decltype(std::declval<H &>().onBpm(uint8_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnTempo : std::false_type {};
+        template <typename H>
+        struct HasOnTempo<H, std::void_t<decltype(std::declval<H &>().onTempo(BpmQ16{}, uint8_t{}))>> : std::true_type {};
+
+        template <typename H, typename = void>
+        struct HasOnUnknown : std::false_type {};
+        template <typename H>
+        struct HasOnUnknown<H, std::void_t<decltype(std::declval<H &>().onUnknown(std::declval<const uint8_t *>(), uint64_t{}))>> : std::true_type {};
+    }
+
+    // Compile-time dispatch of USB MIDI packets to a handler object.
+    //
+    // Handler implements any subset of:
+    //   void onNote(const NoteMessage &, uint64_t timestamp_us);
+    //   void onControllerChange(const ControllerChange &, uint64_t timestamp_us);
+    //   void onHighResController(const HighResController &, uint64_t timestamp_us);
+    //   void onParameterChange(const ParameterChange &, uint64_t timestamp_us); // NRPN/RPN
+    //   void onPolyAftertouch(const PolyAftertouch &, uint64_t timestamp_us);
+    //   void onProgramChange(const ProgramChange &, uint64_t timestamp_us);
+    //   void onChannelPressure(const ChannelPressure &, uint64_t timestamp_us);
+    //   void onPitchBend(const PitchBend &, uint64_t timestamp_us);
+    //   void onSongPosition(const SongPosition &, uint64_t timestamp_us);
+    //   void onTransport(const TransportEvent &, uint64_t timestamp_us);
+    //   void onTimingClock(uint64_t timestamp_us);
+    //   void onBpm(uint8_t bpm);
+    //   void onTempo(BpmQ16 bpm, uint8_t confidence); // every clock tick once locked
+    //   void onUnknown(const uint8_t packet[4], uint64_t timestamp_us);
+    //
+    // Calls are direct and inlinable. Message types the handler does not
+    // implement are not decoded at all. With onHighResController or
+    // onParameterChange, CCs also run through a ControllerAggregator;
+    // onControllerChange still sees every raw CC. With onNote, the notes
+    // handed out are tracked: a Stop is followed by a Note Off for each
+    // one still held, and releaseHeldNotes() does the same on demand.
+    template <typename Handler>
+    class MidiInDispatcher
+    {
+    public:
+        explicit MidiInDispatcher(Handler &handler) : handler(handler) {}
+
+        // Dispatch on the Code Index Number in byte 0: the compiler turns
+        // the switch over its 16 values into a jump table, and the CIN
+        // already tells the message class, so the status byte is only read
+        // for its channel or, for single bytes, which real-time message it
+        // is. Packets with CIN 0 (byte 0 left zero by older producers) go
+        // through feedStatus(). The cable number is not looked at: route on
+        // usbCable() first, e.g. one dispatcher per cable.
+        void feed(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            switch (static_cast<UsbCin>(packet[0] & 0x0F))
+            {
+            case UsbCin::NoteOff:
+            case UsbCin::NoteOn:
+                return dispatchNote(packet, timestamp_us);
+            case UsbCin::PolyAftertouch:
+                return dispatchPolyAftertouch(packet, timestamp_us);
+            case UsbCin::ControlChange:
+                if constexpr (detail::HasOnControllerChange<Handler>::value || kAggregates)
+                    decodeControllerChange(packet, timestamp_us);
+                return;
+            case UsbCin::ProgramChange:
+                return dispatchProgramChange(packet, timestamp_us);
+            case UsbCin::ChannelPressure:
+                return dispatchChannelPressure(packet, timestamp_us);
+            case UsbCin::PitchBend:
+                return dispatchPitchBend(packet, timestamp_us);
+            case UsbCin::Byte:
+                if (packet[1] == 0xF8)
+                    return dispatchTimingClock(timestamp_us);
+                if (packet[1] >= 0xFA && packet[1] <= 0xFC)
+                    return dispatchTransport(packet, timestamp_us);
+                return dispatchUnknown(packet, timestamp_us);
+            case UsbCin::SystemCommon3:
+                if (packet[1] == 0xF2)
+                    return dispatchSongPosition(packet, timestamp_us);
+                return dispatchUnknown(packet, timestamp_us);
+            case UsbCin::Misc:
+                return feedStatus(packet, timestamp_us);
+            default:
+                return dispatchUnknown(packet, timestamp_us); // SysEx, other System Common, reserved
+            }
+        }
+
+        // Hand the handler a Note Off for every note this input still
+        // holds, e.g. when it lost Active Sensing
+        void releaseHeldNotes(uint64_t timestamp_us)
+        {
+            if constexpr (kTracksNotes)
+                heldNotes.releaseAll([&](const NoteMessage &msg)
+                                     { handler.onNote(msg, timestamp_us); });
+        }
+
+        // Several packets that arrived together, in one call
+        void feed(const Packet4 *packets, size_t count, uint64_t timestamp_us)
+        {
+            for (size_t i = 0; i < count; ++i)
+                feed(packets[i].data(), timestamp_us);
+        }
+
+        // Several timestamped packets, e.g. straight from MidiIn::read()
+        void feed(const MidiEvent *events, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                feed(events[i].packet.data(), events[i].timestamp_us);
+        }
+
+        // Dispatch on the status byte alone, ignoring byte 0
+        void feedStatus(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            const uint8_t status = packet[1];
+
+            switch (statusInfo(status).type)
+            {
+            case MidiMessageType::Start:
+            case MidiMessageType::Continue:
+            case MidiMessageType::Stop:
+                return dispatchTransport(packet, timestamp_us);
+
+            case MidiMessageType::TimingClock:
+                return dispatchTimingClock(timestamp_us);
+
+            case MidiMessageType::SongPosition:
+                return dispatchSongPosition(packet, timestamp_us);
+
+            case MidiMessageType::ControlChange:
+                if constexpr (detail::HasOnControllerChange<Handler>::value || kAggregates)
+                    decodeControllerChange(packet, timestamp_us);
+                return;
+
+            case MidiMessageType::PolyAftertouch:
+                return dispatchPolyAftertouch(packet, timestamp_us);
+
+            case MidiMessageType::ProgramChange:
+                return dispatchProgramChange(packet, timestamp_us);
+
+            case MidiMessageType::ChannelPressure:
+                return dispatchChannelPressure(packet, timestamp_us);
+
+            case MidiMessageType::PitchBend:
+                return dispatchPitchBend(packet, timestamp_us);
+
+            case MidiMessageType::NoteOn:
+            case MidiMessageType::NoteOff:
+                return dispatchNote(packet, timestamp_us);
+
+            default:
+                return dispatchUnknown(packet, timestamp_us);
+            }
+        }
+
+    private:
+        static constexpr bool kTracksTempo = detail::HasOnBpm<Handler>::value || detail::HasOnTempo<Handler>::value;
+        static constexpr bool kTracksNotes = detail::HasOnNote<Handler>::value;
+        static constexpr bool kAggregates = detail::HasOnHighResController<Handler>::value || detail::HasOnParameterChange<Handler>::value;
+
+        // Hands aggregated events to the handler, stamped with the CC that completed them
+        struct AggregateSink
+        {
+            Handler &handler;
+            uint64_t timestamp_us;
+
+            void onHighResController(const HighResController &msg)
+            {
+                if constexpr (detail::HasOnHighResController<Handler>::value)
+                    handler.onHighResController(msg, timestamp_us);
+            }
+
+            void onParameterChange(const ParameterChange &msg)
+            {
+                if constexpr (detail::HasOnParameterChange<Handler>::value)
+                    handler.onParameterChange(msg, timestamp_us);
+            }
+        };
+
+        void dispatchNote(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnNote<Handler>::value)
+            {
+                NoteMessage msg;
+                msg.channel = packet[1] & 0x0F;
+                msg.note = packet[2];
+                msg.velocity = packet[3];
+                msg.on = (packet[1] & 0xF0) == 0x90 && msg.velocity > 0;
+                heldNotes.onNote(msg);
+                handler.onNote(msg, timestamp_us);
+            }
+        }
+
+        void dispatchPolyAftertouch(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnPolyAftertouch<Handler>::value)
+                handler.onPolyAftertouch(PolyAftertouch{static_cast<uint8_t>(packet[1] & 0x0F), packet[2], packet[3]}, timestamp_us);
+        }
+
+        void dispatchProgramChange(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnProgramChange<Handler>::value)
+                handler.onProgramChange(ProgramChange{static_cast<uint8_t>(packet[1] & 0x0F), packet[2]}, timestamp_us);
+        }
+
+        void dispatchChannelPressure(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnChannelPressure<Handler>::value)
+                handler.onChannelPressure(ChannelPressure{static_cast<uint8_t>(packet[1] & 0x0F), packet[2]}, timestamp_us);
+        }
+
+        void dispatchPitchBend(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnPitchBend<Handler>::value)
+                handler.onPitchBend(PitchBend{static_cast<uint8_t>(packet[1] & 0x0F), static_cast<uint16_t>((packet[3] << 7) | packet[2])}, timestamp_us);
+        }
+
+        void dispatchSongPosition(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnSongPosition<Handler>::value)
+                handler.onSongPosition(SongPosition{static_cast<uint16_t>((packet[3] << 7) | packet[2])}, timestamp_us);
+        }
+
+        void dispatchTransport(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (kTracksTempo)
+            {
+                // A stopped clock's ticks say nothing about the one that resumes
+                if (packet[1] == static_cast<uint8_t>(TransportCommand::Stop))
+                    bpmCounter.stop();
+                else
+                    bpmCounter.start();
+            }
+            if constexpr (detail::HasOnTransport<Handler>::value)
+                handler.onTransport(TransportEvent{static_cast<TransportCommand>(packet[1])}, timestamp_us);
+            if (packet[1] == static_cast<uint8_t>(TransportCommand::Stop))
+                releaseHeldNotes(timestamp_us);
+        }
+
+        void dispatchTimingClock(uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnTimingClock<Handler>::value)
+                handler.onTimingClock(timestamp_us);
+            if constexpr (kTracksTempo)
+            {
+                uint8_t flags = bpmCounter.update(timestamp_us);
+                if constexpr (detail::HasOnTempo<Handler>::value)
+                {
+                    if (flags & BpmCounter::TempoUpdated)
+                        handler.onTempo(bpmCounter.bpmQ16(), bpmCounter.confidence());
+                }
+                if constexpr (detail::HasOnBpm<Handler>::value)
+                {
+                    if (flags & BpmCounter::BpmChanged)
+                        handler.onBpm(bpmCounter.bpm());
+                }
+            }
+        }
+
+        void dispatchUnknown(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            if constexpr (detail::HasOnUnknown<Handler>::value)
+                handler.onUnknown(packet, timestamp_us);
+        }
+
+        void decodeControllerChange(const uint8_t packet[4], uint64_t timestamp_us)
+        {
+            ControllerChange msg;
+            msg.channel = packet[1] & 0x0F;
+            msg.controller = packet[2];
+            msg.value = packet[3];
+
+            if constexpr (detail::HasOnControllerChange<Handler>::value)
+                handler.onControllerChange(msg, timestamp_us);
+
+            if constexpr (kAggregates)
+                aggregator.feed(msg, AggregateSink{handler, timestamp_us});
+        }
+
+        struct Empty {};
+
+        Handler &handler;
+        BpmCounter bpmCounter;
+        std::conditional_t<kAggregates, ControllerAggregator, Empty> aggregator;
+        std::conditional_t<kTracksNotes, NoteTracker, Empty> heldNotes;
+    };
+}
@@ -1,61 +1,125 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
-#include <esp_timer.h>
-#include <esp_log.h>
 #include "bpm_counter.hpp"
+#include "midi_hal.hpp"
+#include "midi_in_dispatcher.hpp"
 #include "midi_protocol.hpp"
 
 namespace midi
 {
 
-    using MidiControllerCallback = std::function<void(const ControllerChange &)>;
+    // Every callback receives the arrival time of the message (hal::nowUs microseconds)
 
-    using MidiSongPositionCallback = std::function<void(const SongPosition &)>;
+    using MidiControllerCallback = std::function<void(const ControllerChange &, uint64_t timestamp_us)>;
 
-    using MidiNoteMessageCallback = std::function<void(const NoteMessage &)>;
+    using MidiHighResControllerCallback = std::function<void(const HighResController &, uint64_t timestamp_us)>;
 
-    using MidiTransportCallback = std::function<void(const TransportEvent &)>;
+    using MidiParameterChangeCallback = std::function<void(const ParameterChange &, uint64_t timestamp_us)>;
 
+    using MidiPolyAftertouchCallback = std::function<void(const PolyAftertouch &, uint64_t timestamp_us)>;
+
+    using MidiProgramChangeCallback = std::function<void(const ProgramChange &, uint64_t timestamp_us)>;
+
+    using MidiChannelPressureCallback = std::function<void(const ChannelPressure &, uint64_t timestamp_us)>;
+
+    using MidiPitchBendCallback = std::function<void(const PitchBend &, uint64_t timestamp_us)>;
+
+    using MidiSongPositionCallback = std::function<void(const SongPosition &, uint64_t timestamp_us)>;
+
+    using MidiNoteMessageCallback = std::function<void(const NoteMessage &, uint64_t timestamp_us)>;
+
+    using MidiTransportCallback = std::function<void(const TransportEvent &, uint64_t timestamp_us)>;
+
+    using MidiTimingClockCallback = std::function<void(uint64_t timestamp_us)>;
+
+    // std::function front-end over MidiInDispatcher, for code that wants to
+    // register callbacks at run time. Prefer MidiInDispatcher<YourHandler>
+    // on hot paths: it inlines the handlers and skips unused message types.
     class MidiInParser
     {
     private:
-        MidiControllerCallback controllerCallback;
-        MidiSongPositionCallback songPositionCallback;
-        MidiNoteMessageCallback noteMessageCallback;
-        MidiTransportCallback transportCallback;
-        BpmCounter bpmCounter;
-
-        void parseControllerChange(const uint8_t packet[4]);
-        void parseSongPosition(const uint8_t packet[4]);
-        void parseNoteMessage(const uint8_t packet[4], bool on);
-        void parseTransportCommand(const uint8_t packet[4]);
-        void parseTimingClock(const uint8_t packet[4]); // new use of BpmCounter
+        struct CallbackHandler
+        {
+            MidiControllerCallback controllerCallback;
+            MidiHighResControllerCallback highResControllerCallback;
+            MidiParameterChangeCallback parameterChangeCallback;
+            MidiPolyAftertouchCallback polyAftertouchCallback;
+            MidiProgramChangeCallback programChangeCallback;
+            MidiChannelPressureCallback channelPressureCallback;
+            MidiPitchBendCallback pitchBendCallback;
+            MidiSongPositionCallback songPositionCallback;
+            MidiNoteMessageCallback noteMessageCallback;
+            MidiTransportCallback transportCallback;
+            MidiTimingClockCallback timingClockCallback;
+            BpmCounter::BpmCallback bpmCallback;
+            BpmCounter::TempoCallback tempoCallback;
+
+            void onControllerChange(const ControllerChange &msg, uint64_t timestamp_us);
+            void onHighResController(const HighResController &msg, uint64_t timestamp_us);
+            void onParameterChange(const ParameterChange &msg, uint64_t timestamp_us);
+            void onPolyAftertouch(const PolyAftertouch &msg, uint64_t timestamp_us);
+            void onProgramChange(const ProgramChange &msg, uint64_t timestamp_us);
+            void onChannelPressure(const ChannelPressure &msg, uint64_t timestamp_us);
+            void onPitchBend(const PitchBend &msg, uint64_t timestamp_us);
+            void onSongPosition(const SongPosition &msg, uint64_t timestamp_us);
+            void onNote(const NoteMessage &msg, uint64_t timestamp_us);
+            void onTransport(const TransportEvent &msg, uint64_t timestamp_us);
+            void onTimingClock(uint64_t timestamp_us);
+            void onBpm(uint8_t bpm);
+            void onTempo(BpmQ16 bpm, uint8_t confidence);
+            void onUnknown(const uint8_t packet[4], uint64_t timestamp_us);
+        };
+
+        CallbackHandler callbacks;
+        MidiInDispatcher<CallbackHandler> dispatcher{callbacks};
 
     public:
         MidiInParser();
+        MidiInParser(const MidiInParser &) = delete; // dispatcher refers to our own callbacks
+        MidiInParser &operator=(const MidiInParser &) = delete;
+
+        // Feed a 4-byte USB MIDI packet (USB MIDI format) that arrived at timestamp_us
+        void feed(const uint8_t packet[4], uint64_t timestamp_us) { dispatcher.feed(packet, timestamp_us); }
 
-        // Feed a 4-byte USB MIDI packet (USB MIDI format)
-        void feed(const uint8_t packet[4]);
+        // Same, stamped with the current time (for packets without an arrival time)
+        void feed(const uint8_t packet[4]) { feed(packet, hal::nowUs()); }
+
+        // Several packets in one call, e.g. a USB transfer, all arrived at timestamp_us
+        void feed(const Packet4 *packets, size_t count, uint64_t timestamp_us) { dispatcher.feed(packets, count, timestamp_us); }
+        void feed(const Packet4 *packets, size_t count) { feed(packets, count, hal::nowUs()); }
+
+        // Several timestamped packets, e.g. from MidiIn::read()
+        void feed(const MidiEvent *events, size_t count) { dispatcher.feed(events, count); }
+
+        // Note Offs to the note callback for every note still held (a Stop
+        // does this by itself), e.g. from MidiIn's sensing-lost callback
+        void releaseHeldNotes(uint64_t timestamp_us) { dispatcher.releaseHeldNotes(timestamp_us); }
 
         // Register callback for MIDI CC messages
-        void setControllerCallback(MidiControllerCallback cb) { this->controllerCallback = cb; };
-        void setSongPositionCallback(MidiSongPositionCallback cb) { this->songPositionCallback = cb; };
-        void setNoteMessageCallback(MidiNoteMessageCallback cb) { this->noteMessageCallback = cb; };
-        void setTransportCallback(MidiTransportCallback cb) { this->transportCallback = cb; };
-        void setBpmCallback(BpmCounter::BpmCallback callback) { this->bpmCounter.setCallback(callback); };
+        void setControllerCallback(MidiControllerCallback cb) { callbacks.controllerCallback = cb; };
+        // 14-bit CC pairs (0–31 with 32–63) as one value
+        void setHighResControllerCallback(MidiHighResControllerCallback cb) { callbacks.highResControllerCallback = cb; };
+        // NRPN/RPN select + data entry sequences as one value
+        void setParameterChangeCallback(MidiParameterChangeCallback cb) { callbacks.parameterChangeCallback = cb; };
+        void setPolyAftertouchCallback(MidiPolyAftertouchCallback cb) { callbacks.polyAftertouchCallback = cb; };
+        void setProgramChangeCallback(MidiProgramChangeCallback cb) { callbacks.programChangeCallback = cb; };
+        void setChannelPressureCallback(MidiChannelPressureCallback cb) { callbacks.channelPressureCallback = cb; };
+        void setPitchBendCallback(MidiPitchBendCallback cb) { callbacks.pitchBendCallback = cb; };
+        void setSongPositionCallback(MidiSongPositionCallback cb) { callbacks.songPositionCallback = cb; };
+        void setNoteMessageCallback(MidiNoteMessageCallback cb) { callbacks.noteMessageCallback = cb; };
+        void setTransportCallback(MidiTransportCallback cb) { callbacks.transportCallback = cb; };
+        void setTimingClockCallback(MidiTimingClockCallback cb) { callbacks.timingClockCallback = cb; };
+        void setBpmCallback(BpmCounter::BpmCallback callback) { callbacks.bpmCallback = callback; };
+        void setTempoCallback(BpmCounter::TempoCallback callback) { callbacks.tempoCallback = callback; };
     };
 
-  
 
     inline MidiMessageType getMidiMessageType(uint8_t statusByte)
     {
-        if (statusByte >= 0xF0)
-        {
-            return static_cast<MidiMessageType>(statusByte);
-        }
-        return static_cast<MidiMessageType>(statusByte & 0xF0);
+        return statusInfo(statusByte).type;
     }
 
     
@@ -1,5 +1,4 @@
 #include "bpm_counter.hpp"
-static const char *TAG = "BPM_COUNTER";
 
 namespace midi
 {
@@ -11,63 +10,61 @@ void BpmCounter::setCallback(BpmCallback callback)
     bpmCallback = callback;
 }
 
+void BpmCounter::setTempoCallback(TempoCallback callback)
+{
+    tempoCallback = callback;
+}
+
 void BpmCounter::stop()
 {
     isActive = false;
-    lastBeatTimestamp = 0;
-    clockCount = 0;
-    // leave currentBpm and history intact
+    // leave currentBpm intact
 }
 
 void BpmCounter::start()
 {
     isActive = true;
-    lastBeatTimestamp = 0;
-    clockCount = 0;
-    // resume using existing history and currentBpm
+    // the clock paused, so old ticks say nothing about the new ones
+    estimator.reset();
 }
 
 void BpmCounter::onClockTick(uint64_t timestamp_us)
 {
-    if (!bpmCallback || !isActive)
+    if (!bpmCallback && !tempoCallback)
         return;
 
-    clockCount++;
-    if (clockCount < clocksPerBeat)
-        return;
-
-    clockCount = 0;
-    if (lastBeatTimestamp == 0) {
-        lastBeatTimestamp = timestamp_us;
-        return;
-    }
+    uint8_t flags = update(timestamp_us);
+    if ((flags & TempoUpdated) && tempoCallback)
+        tempoCallback(estimator.bpm(), estimator.confidence());
+    if ((flags & BpmChanged) && bpmCallback)
+        bpmCallback(currentBpm);
+}
 
-    uint64_t delta_us = timestamp_us - lastBeatTimestamp;
-    lastBeatTimestamp = timestamp_us;
-    if (delta_us == 0)
-        return;
+uint8_t BpmCounter::update(uint64_t timestamp_us)
+{
+    if (!isActive)
+        return 0;
 
-    float instBpm = 60000000.0f / static_cast<float>(delta_us);
+    if (!estimator.addTick(timestamp_us))
+        return 0;
 
-    // moving average
-    bpmSum -= bpmHistory[bpmIndex];
-    bpmHistory[bpmIndex] = instBpm;
-    bpmSum += instBpm;
-    bpmIndex = (bpmIndex + 1) % kAvgWindow;
-    if (historyCount < kAvgWindow)
-        ++historyCount;
+    uint8_t flags = TempoUpdated;
+    if (estimator.ticksInWindow() < TempoEstimator::kWindow)
+        return flags;
 
-    if (historyCount < kAvgWindow)
-        return;
+    BpmQ16 bpm = estimator.bpm();
+    BpmQ16 current = static_cast<BpmQ16>(currentBpm) << 16;
+    BpmQ16 distance = bpm > current ? bpm - current : current - bpm;
+    if (currentBpm != 0 && distance <= kBpmHysteresis)
+        return flags;
 
-    float avgBpm = bpmSum / static_cast<float>(kAvgWindow);
-    int roundedBpm = static_cast<int>(avgBpm + 0.5f);
+    uint32_t rounded = (bpm + 0x8000) >> 16;
+    uint8_t newBpm = static_cast<uint8_t>(rounded > 255 ? 255 : rounded);
+    if (newBpm == currentBpm)
+        return flags;
 
-    if (roundedBpm != static_cast<int>(currentBpm)) {
-        currentBpm = roundedBpm;
-        
-        bpmCallback(currentBpm);
-    }
+    currentBpm = newBpm;
+    return flags | BpmChanged;
 }
 
 } // namespace midi_module
@@ -1,120 +1,284 @@
 #include "midi_in.hpp"
 #include "midi_protocol.hpp"
-#include "esp_log.h"
-#include <soc/uart_reg.h>
+#include "midi_log.hpp"
+#include "midi_trace.hpp"
 
 using namespace midi;
 static const char *TAG = "MidiReceives";
 
 MidiIn::MidiIn(const MidiInConfig &config)
-    : config(config), callback(nullptr), task_handle(nullptr)
+    : config(config), callback(nullptr), sensing(config.active_sensing_timeout_ms * 1000), task_handle(nullptr)
 {
+    streamParser.setCable(config.cable);
+}
+
+void MidiIn::setSysExCallback(SysExCallback cb)
+{
+    streamParser.setSysExHandler(&sysexPool, cb);
+}
+
+void MidiIn::setThruHook(MidiEventHook hook)
+{
+    thruHook = hook;
+}
+
+void MidiIn::setSensingLostCallback(MidiSensingLostCallback cb)
+{
+    sensingLost = cb;
+}
+
+MidiInStats MidiIn::getStats() const
+{
+    MidiInStats snapshot;
+    snapshot.reads = uartReads.load(std::memory_order_relaxed);
+    snapshot.bytes = rxBytes.load(std::memory_order_relaxed);
+    snapshot.sysex_dropped = sysexDropped.load(std::memory_order_relaxed);
+    snapshot.ring_high_water = events.highWaterMark();
+    snapshot.ring_overflows = events.overflows();
+    snapshot.sensing_lost = sensingLostCount.load(std::memory_order_relaxed);
+    snapshot.parse_errors = parseErrors.load(std::memory_order_relaxed);
+    snapshot.uart_overflows = uartOverflows.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+MidiInLatency MidiIn::getLatency() const
+{
+    auto backoff = []
+    { hal::sleepMs(1); };
+    return MidiInLatency{parseLatency.snapshot(backoff), deliveryLatency.snapshot(backoff),
+                         callbackLatency.snapshot(backoff)};
 }
 
 void MidiIn::init(MidiCallback cb)
 {
     callback = cb;
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
-    // 1) Configure UART parameters (8N1, MIDI baud)
-    uart_config_t uart_cfg = {
-        .baud_rate = MIDI_BAUD_RATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE};
-#pragma GCC diagnostic pop
-
-    ESP_ERROR_CHECK(uart_param_config(config.uart_num, &uart_cfg));
-
-    // 2) Set UART pins (TX unused)
-    ESP_ERROR_CHECK(uart_set_pin(config.uart_num,
-                                 UART_PIN_NO_CHANGE,
-                                 config.receivePin,
-                                 UART_PIN_NO_CHANGE,
-                                 UART_PIN_NO_CHANGE));
-
-    // 3) Install UART driver with RX buffer
-    ESP_ERROR_CHECK(uart_driver_install(config.uart_num,
-                                        config.rx_buffer_size * 2,
-                                        0,
-                                        10, // queue size
-                                        &uart_queue,
-                                        0));
-    uart_intr_config_t intr_conf = {
-        .intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M,
-        .rx_timeout_thresh = 2, // ~2 character durations (for idle detection)
-        .txfifo_empty_intr_thresh = 10,
-        .rxfifo_full_thresh = 3, // Trigger interrupt on every byte
-    };
-    ESP_ERROR_CHECK(uart_intr_config(config.uart_num, &intr_conf));
-
-    // 4) Launch MIDI reader task
-    xTaskCreate(
+    // 1) UART at MIDI speed, RX only, with an event raised on every few
+    //    bytes and after ~2 idle character times
+    hal::UartConfig uart_cfg;
+    uart_cfg.port = config.uart_num;
+    uart_cfg.rx_pin = config.receivePin;
+    uart_cfg.rx_buffer_size = config.rx_buffer_size * 2;
+    uart_cfg.event_queue_size = 10;
+    uart_cfg.rx_full_threshold = 3;
+    uart_cfg.rx_timeout_threshold = 2;
+    uart.open(uart_cfg);
+
+    // 2) Launch the consumer first, so the reader never publishes to nobody
+    if (callback)
+    {
+        dispatch_handle = hal::startTask(
+            [](void *arg)
+            {
+                auto *self = static_cast<MidiIn *>(arg);
+                self->dispatchLoop();
+            },
+            this,
+            "midi_in_dispatch",
+            4098,
+            config.dispatch_priority);
+        consumer.store(dispatch_handle);
+    }
+
+    // 3) Launch MIDI reader task
+    task_handle = hal::startTask(
         [](void *arg)
         {
             auto *self = static_cast<MidiIn *>(arg);
             self->taskLoop();
         },
+        this,
         "midi_in_task",
         4098,
-        this,
-        configMAX_PRIORITIES - 5,
-        &task_handle);
+        hal::kMaxPriority - 5);
 }
 
 void MidiIn::taskLoop()
 {
-    uart_event_t event;
-    uint8_t midi_packet[3];
+    hal::UartEvent event;
 
     while (true)
     {
-        if (xQueueReceive(uart_queue, &event, portMAX_DELAY))
+        if (!uart.waitEvent(event, sensingWait()))
         {
-            ESP_LOGI(TAG, "Event %d", static_cast<int>(event.type));
-
-            if (event.type == UART_DATA)
+            uint64_t now_us = hal::nowUs();
+            if (sensing.expired(now_us))
             {
-                uint8_t byte;
-                int midi_index = 0;
-                int expected_length = 0;
-                while (uart_read_bytes(config.uart_num, &byte, 1, 0) == 1)
+                sensingLostCount.fetch_add(1, std::memory_order_relaxed);
+                MIDI_LOGW(TAG, "Active Sensing lost");
+                if (dispatch_handle)
+                {
+                    // After the messages already queued, on the task that handles them
+                    sensingLostAt.store(now_us, std::memory_order_release);
+                    hal::notify(dispatch_handle);
+                }
+                else if (sensingLost)
                 {
-                    if (byte & 0x80) // Status byte
-                    {
-                        midi_index = 0;
-                        midi_packet[midi_index++] = byte;
-
-                        // Determine expected message length
-                        auto type = getMessageType(byte);
-                        expected_length = getMidiMessageSize(type);
-                        if (expected_length <= 0)
-                        {
-                            ESP_LOGW(TAG, "Skipping unsupported/variable-length MIDI msg: 0x%02X", byte);
-                            midi_index = 0;
-                            expected_length = 0;
-                        }
-                    }
-                    else if (midi_index > 0 && midi_index < 3) // Data byte
-                    {
-                        midi_packet[midi_index++] = byte;
-                    }
-
-                    if (midi_index == expected_length)
-                    {
-                        ESP_LOGI(TAG, "Receiving: %02X %02X %02X", midi_packet[0], midi_packet[1], midi_packet[2]);
-
-                        Packet4 pkt = {0, midi_packet[0], midi_packet[1], midi_packet[2]};
-                        if (callback)
-                            callback(pkt);
-
-                        midi_index = 0;
-                        expected_length = 0;
-                    }
+                    sensingLost(now_us);
                 }
             }
         }
+        else
+        {
+            // Stamp before anything else (logging included) can add latency
+            uint64_t event_us = hal::nowUs();
+            uartEvent_us = event_us;
+
+            if (event.type == hal::UartEventType::Data)
+            {
+                MIDI_TRACE(UartData, static_cast<uint8_t>(event.size), static_cast<uint8_t>(event.size >> 8));
+                sensing.onActivity(event_us); // SysEx bytes count as life too
+                if (config.chunked_read)
+                    readChunked(event.size);
+                else
+                    readPerByte(event_us, event.size);
+                publishParserCounters();
+
+                // One wake-up per UART event; the consumer drains in batches
+                hal::TaskHandle task = consumer.load(std::memory_order_acquire);
+                if (task && !events.empty())
+                    hal::notify(task);
+            }
+            else if (event.type == hal::UartEventType::Overflow)
+            {
+                // Bytes were lost; whatever was being assembled is garbage now
+                uartOverflows.fetch_add(1, std::memory_order_relaxed);
+                MIDI_TRACE(UartOverflow);
+                MIDI_LOGW(TAG, "UART RX overflow, flushing input");
+                uart.flushInput();
+                uart.resetEvents();
+                streamParser.reset();
+            }
+        }
+    }
+}
+
+void MidiIn::readPerByte(uint64_t event_us, size_t event_size)
+{
+    // The event's bytes ended at event_us; anything read past them is newer
+    uint64_t timestamp_us = event_us - static_cast<uint64_t>(event_size ? event_size - 1 : 0) * MIDI_BYTE_TIME_US;
+    uint8_t byte;
+    MidiEvent out;
+    size_t index = 0;
+    while (uart.read(&byte, 1, 0) == 1)
+    {
+        uartReads.fetch_add(1, std::memory_order_relaxed);
+        rxBytes.fetch_add(1, std::memory_order_relaxed);
+        if (++index > event_size)
+            timestamp_us = hal::nowUs();
+
+        if (streamParser.feed(byte, timestamp_us, out))
+            publish(out);
+
+        timestamp_us += MIDI_BYTE_TIME_US;
+    }
+}
+
+void MidiIn::readChunked(size_t available)
+{
+    // event.size may lag behind what the driver has buffered by now; take it all
+    size_t buffered = uart.buffered();
+    if (buffered > available)
+        available = buffered;
+
+    while (available > 0)
+    {
+        size_t want = available < kRxChunkSize ? available : kRxChunkSize;
+        int len = uart.read(rxChunk, want, 0);
+        if (len <= 0)
+            break;
+
+        // The last byte still in the driver arrived just now; back-compute
+        // this chunk's last byte from what is left behind it
+        uint64_t now_us = hal::nowUs();
+        available = uart.buffered();
+
+        uartReads.fetch_add(1, std::memory_order_relaxed);
+        rxBytes.fetch_add(static_cast<uint32_t>(len), std::memory_order_relaxed);
+        streamParser.feed(rxChunk, static_cast<size_t>(len), now_us - available * MIDI_BYTE_TIME_US,
+                          [this](const MidiEvent &event)
+                          { publish(event); });
+    }
+}
+
+// The parser's counters are plain fields of the UART task; getStats() reads these copies
+void MidiIn::publishParserCounters()
+{
+    parseErrors.store(streamParser.parseErrors(), std::memory_order_relaxed);
+    sysexDropped.store(streamParser.sysExDropped(), std::memory_order_relaxed);
+}
+
+// How long the UART task may sleep before Active Sensing must be checked
+uint32_t MidiIn::sensingWait() const
+{
+    if (config.active_sensing_timeout_ms == 0 || !sensing.armed())
+        return hal::kForever;
+
+    uint64_t now_us = hal::nowUs();
+    uint64_t deadline_us = sensing.deadline();
+    if (deadline_us <= now_us)
+        return 0;
+    return static_cast<uint32_t>((deadline_us - now_us + 999) / 1000);
+}
+
+void MidiIn::publish(const MidiEvent &event)
+{
+    if (config.active_sensing_timeout_ms)
+        sensing.onMessage(event.packet[1], event.timestamp_us);
+
+    MIDI_TRACE(RxMessage, event.packet[1], event.packet[2], event.packet[3]);
+    if (thruHook)
+        thruHook(event);
+
+    // Overflow is counted by the ring; never wait on a slow consumer here
+    events.push(event);
+
+    if (config.latency_probes)
+        parseLatency.record(hal::nowUs() - uartEvent_us);
+}
+
+size_t MidiIn::read(MidiEvent *out, size_t max, uint32_t timeout_ms)
+{
+    if (!consumer.load(std::memory_order_relaxed))
+        consumer.store(hal::currentTask(), std::memory_order_release);
+
+    size_t count = events.pop(out, max);
+    if (count == 0 && hal::waitForNotify(timeout_ms))
+        count = events.pop(out, max);
+
+    if (config.latency_probes && count > 0)
+    {
+        uint64_t now_us = hal::nowUs();
+        for (size_t i = 0; i < count; ++i)
+            deliveryLatency.record(now_us > out[i].timestamp_us ? now_us - out[i].timestamp_us : 0);
+    }
+    return count;
+}
+
+void MidiIn::dispatchLoop()
+{
+    MidiEvent batch[kDispatchBatch];
+    while (true)
+    {
+        size_t count = read(batch, kDispatchBatch, hal::kForever);
+        uint64_t entry_us = config.latency_probes ? hal::nowUs() : 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const MidiEvent &event = batch[i];
+            MIDI_TRACE(RxDispatch, event.packet[1], event.packet[2], event.packet[3]);
+            callback(event.packet, event.timestamp_us);
+
+            if (config.latency_probes)
+            {
+                // One clock read per callback: its exit is the next one's entry
+                uint64_t exit_us = hal::nowUs();
+                callbackLatency.record(exit_us - entry_us);
+                entry_us = exit_us;
+            }
+        }
+
+        uint64_t lost_us = sensingLostAt.exchange(0, std::memory_order_acq_rel);
+        if (lost_us && sensingLost)
+            sensingLost(lost_us);
     }
 }
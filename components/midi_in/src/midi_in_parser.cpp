@@ -1,140 +1,116 @@
 #include "midi_in_parser.hpp"
-#include "esp_log.h"
+#include "midi_trace.hpp"
 
 using namespace midi;
 
-static const char *TAG = "MIDI_PARSER";
-
 MidiInParser::MidiInParser() = default;
 
-void MidiInParser::feed(const uint8_t packet[4])
+void MidiInParser::CallbackHandler::onControllerChange(const ControllerChange &msg, uint64_t timestamp_us)
 {
-    uint8_t status = packet[1];
-    uint8_t type = status & 0xF0;
-    // uint8_t channel = status & 0x0F;  // we are not checking for channel here, but inside parse note, controller, etc
-
-    MidiMessageType message = static_cast<MidiMessageType>(status);
-    MidiMessageType baseType = static_cast<MidiMessageType>(type);
-
-    switch (message)
+    if (controllerCallback)
     {
-    case MidiMessageType::Start:
-    case MidiMessageType::Continue:
-    case MidiMessageType::Stop:
-        parseTransportCommand(packet);
-        break;
-
-    case MidiMessageType::TimingClock:
-        parseTimingClock(packet);
-        break;
-
-    case MidiMessageType::SongPosition:
-        parseSongPosition(packet);
-        break;
-
-    default:
-        switch (baseType)
-        {
-        case MidiMessageType::ControlChange:
-            parseControllerChange(packet);
-            break;
-
-        case MidiMessageType::NoteOn:
-            parseNoteMessage(packet, true);
-            break;
-
-        case MidiMessageType::NoteOff:
-            parseNoteMessage(packet, false);
-            break;
-
-        default:
-            ESP_LOGI(TAG, "Unknown MIDI message: %s, %d, %d, %d, %d",
-                     to_string(message), packet[0], packet[1], packet[2], packet[3]);
-            break;
-        }
-        break;
+        controllerCallback(msg, timestamp_us);
     }
 }
 
-void MidiInParser::parseTimingClock(const uint8_t packet[4])
+void MidiInParser::CallbackHandler::onHighResController(const HighResController &msg, uint64_t timestamp_us)
 {
-    bpmCounter.onClockTick(esp_timer_get_time());
+    if (highResControllerCallback)
+    {
+        highResControllerCallback(msg, timestamp_us);
+    }
 }
 
-void MidiInParser::parseControllerChange(const uint8_t packet[4])
+void MidiInParser::CallbackHandler::onParameterChange(const ParameterChange &msg, uint64_t timestamp_us)
 {
-    uint8_t status = packet[1];
-    uint8_t channel = status & 0x0F;
-
-    ControllerChange msg;
-    msg.channel = channel;
-    msg.controller = packet[2];
-    msg.value = packet[3];
+    if (parameterChangeCallback)
+    {
+        parameterChangeCallback(msg, timestamp_us);
+    }
+}
 
-    if (msg.controller == static_cast<uint8_t>(MidiMessageType::Stop) && msg.value == 0)
+void MidiInParser::CallbackHandler::onPolyAftertouch(const PolyAftertouch &msg, uint64_t timestamp_us)
+{
+    if (polyAftertouchCallback)
     {
-        bpmCounter.stop();
+        polyAftertouchCallback(msg, timestamp_us);
     }
-    else if (msg.controller == static_cast<uint8_t>(MidiMessageType::Start) && msg.value > 0)
+}
+
+void MidiInParser::CallbackHandler::onProgramChange(const ProgramChange &msg, uint64_t timestamp_us)
+{
+    if (programChangeCallback)
     {
-        bpmCounter.start();
+        programChangeCallback(msg, timestamp_us);
     }
+}
 
-    if (controllerCallback)
+void MidiInParser::CallbackHandler::onChannelPressure(const ChannelPressure &msg, uint64_t timestamp_us)
+{
+    if (channelPressureCallback)
     {
-        controllerCallback(msg);
+        channelPressureCallback(msg, timestamp_us);
     }
 }
-void MidiInParser::parseSongPosition(const uint8_t packet[4])
+
+void MidiInParser::CallbackHandler::onPitchBend(const PitchBend &msg, uint64_t timestamp_us)
 {
-    SongPosition msg;
-    msg.position = static_cast<uint16_t>((packet[3] << 7) | packet[2]);
+    if (pitchBendCallback)
+    {
+        pitchBendCallback(msg, timestamp_us);
+    }
+}
 
+void MidiInParser::CallbackHandler::onSongPosition(const SongPosition &msg, uint64_t timestamp_us)
+{
     if (songPositionCallback)
     {
-        songPositionCallback(msg);
+        songPositionCallback(msg, timestamp_us);
     }
 }
 
-void MidiInParser::parseNoteMessage(const uint8_t packet[4], bool on)
+void MidiInParser::CallbackHandler::onNote(const NoteMessage &msg, uint64_t timestamp_us)
 {
-    uint8_t status = packet[1];
-    uint8_t channel = status & 0x0F;
-
-    NoteMessage msg;
-    msg.channel = channel;
-    msg.note = packet[2];
-    msg.velocity = packet[3];
-    msg.on = on && msg.velocity > 0;
-
     if (noteMessageCallback)
     {
-        noteMessageCallback(msg);
+        noteMessageCallback(msg, timestamp_us);
     }
 }
 
-void MidiInParser::parseTransportCommand(const uint8_t packet[4])
+void MidiInParser::CallbackHandler::onTransport(const TransportEvent &msg, uint64_t timestamp_us)
 {
-    TransportCommand command;
+    if (transportCallback)
+    {
+        transportCallback(msg, timestamp_us);
+    }
+}
 
-    switch (packet[1])
+void MidiInParser::CallbackHandler::onTimingClock(uint64_t timestamp_us)
+{
+    if (timingClockCallback)
     {
-    case 0xFA:
-        command = TransportCommand::Start;
-        break;
-    case 0xFB:
-        command = TransportCommand::Continue;
-        break;
-    case 0xFC:
-        command = TransportCommand::Stop;
-        break;
-    default:
-        command = TransportCommand::Unknown;
-        break;
+        timingClockCallback(timestamp_us);
     }
+}
 
-    if (command != TransportCommand::Unknown && transportCallback)
+void MidiInParser::CallbackHandler::onBpm(uint8_t bpm)
+{
+    if (bpmCallback)
     {
-        transportCallback(TransportEvent{command});
+        bpmCallback(bpm);
     }
 }
+
+void MidiInParser::CallbackHandler::onTempo(BpmQ16 bpm, uint8_t confidence)
+{
+    if (tempoCallback)
+    {
+        tempoCallback(bpm, confidence);
+    }
+}
+
+void MidiInParser::CallbackHandler::onUnknown(const uint8_t packet[4], uint64_t)
+{
+    (void)packet; // unused when tracing is off
+    MIDI_TRACE(RxUnknown, packet[1], packet[2], packet[3]);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include "clock_pll.hpp"
+#include "midi_hal.hpp"
+#include "midi_out.hpp"
+
+namespace midi
+{
+    // Deviation of tick intervals from the tracked period
+    struct ClockJitterStats
+    {
+        uint32_t ticks = 0;
+        uint32_t max_us = 0;
+        uint64_t total_us = 0;
+
+        uint32_t averageUs() const { return ticks ? static_cast<uint32_t>(total_us / ticks) : 0; }
+    };
+
+    struct MidiClockFollowStats
+    {
+        ClockJitterStats input;  // Upstream ticks as they arrived
+        ClockJitterStats output; // Regenerated ticks as they were sent
+        uint32_t relocks = 0;
+        uint32_t skipped = 0;    // Output ticks dropped to catch up after a dropout
+        BpmQ16 bpm = 0;
+        bool locked = false;
+    };
+
+    // Regenerates a clean MIDI clock that follows a jittery upstream clock.
+    //
+    // Feed it the incoming 0xF8 ticks (e.g. from MidiInParser's timing clock
+    // callback) and transport events. A ClockPll smooths the tick times and
+    // a one-shot timer sends one 0xF8 per upstream tick at the smoothed
+    // time, never more than one tick ahead of the upstream clock. Start and
+    // Continue go out with the next regenerated tick, Stop right away.
+    class MidiClockFollower
+    {
+    public:
+        explicit MidiClockFollower(MidiOut &out, uint32_t time_constant_ticks = ClockPll::kDefaultTimeConstant);
+        ~MidiClockFollower();
+
+        // Start following; ticks fed before this are ignored
+        void begin();
+        void end();
+
+        // PLL time constant in ticks: longer is smoother but slower to follow
+        void setTimeConstant(uint32_t ticks);
+
+        void onClockTick(uint64_t timestamp_us);
+        void onTransport(TransportCommand command);
+
+        MidiClockFollowStats getStats() const;
+        void resetStats();
+
+        BpmQ16 bpm() const;
+
+    private:
+        void onTimer();
+        void arm();
+        static void record(ClockJitterStats &stats, uint64_t interval_us, uint64_t period_us);
+
+        MidiOut &out;
+        ClockPll pll;
+        hal::Mutex armLock; // Held across timer.stop() and startOnce() in arm()
+        mutable hal::CriticalSection lock;
+        std::atomic<uint8_t> pendingTransport{0}; // TransportCommand, 0 = none
+        bool active = false;
+
+        // Guarded by lock
+        uint64_t outIndex = 0; // Upstream tick index of the next regenerated tick
+        uint64_t lastIn_us = 0;
+        uint64_t lastOut_us = 0;
+        MidiClockFollowStats stats;
+
+        // Last, so it is destroyed first: ~Timer waits out a running
+        // onTimer(), which still uses everything above
+        hal::Timer timer;
+    };
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include "midi_clock.hpp"
+#include "midi_hal.hpp"
+#include "midi_out.hpp"
+
+namespace midi
+{
+    // Generates MIDI clock from a hal::Timer instead of an application delay loop.
+    //
+    // Each tick re-arms a one-shot timer at the exact time computed by
+    // ClockTickScheduler, so timer latency never accumulates into drift.
+    // Clock and transport bytes go through MidiOut's real-time lane.
+    class MidiClockMaster
+    {
+    public:
+        explicit MidiClockMaster(MidiOut &out);
+        ~MidiClockMaster();
+
+        // Start emitting clock at `bpm`; the first tick goes out right away
+        void begin(BpmQ16 bpm);
+
+        // Stop emitting clock (does not send Stop; use setTransport for that)
+        void end();
+
+        void setBpm(BpmQ16 bpm);
+
+        // Glide to `bpm` over `beats` beats, one step per tick
+        void rampTo(BpmQ16 bpm, uint32_t beats);
+
+        // Send Start/Stop/Continue together with the next tick, so the
+        // receiving sequencer sees them on the tick grid
+        void setTransport(TransportCommand command);
+
+        BpmQ16 bpm() const;
+        bool running() const { return active; }
+
+    private:
+        void onTimer();
+        void arm();
+
+        MidiOut &out;
+        ClockTickScheduler scheduler;
+        mutable hal::CriticalSection lock;
+        std::atomic<uint8_t> pendingTransport{0}; // TransportCommand, 0 = none
+        bool active = false;
+
+        // Last, so it is destroyed first: ~Timer waits out a running
+        // onTimer(), which still uses everything above
+        hal::Timer timer;
+    };
+}
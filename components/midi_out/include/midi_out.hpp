@@ -1,11 +1,14 @@
 #pragma once
-#include "driver/gpio.h"
-#include "driver/uart.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
 #include <functional>
 
+#include <atomic>
+#include "controller_coalescer.hpp"
+#include "latency_histogram.hpp"
+#include "midi_hal.hpp"
 #include "midi_protocol.hpp"
+#include "midi_running_status.hpp"
+#include "note_tracker.hpp"
+#include "timing_wheel.hpp"
 
 namespace midi
 {
@@ -13,12 +16,72 @@ namespace midi
     {
         uint8_t data[3];
         size_t length;
+        const uint8_t *payload = nullptr; // Borrowed SysEx buffer, written instead of data
+        uint64_t received_us = 0;         // Arrival time of a forwarded message, 0 if local
+        uint64_t enqueued_us = 0;         // When it entered tx_queue, for the latency probes
     };
+
+    // A System Real-Time byte waiting in the priority lane
+    struct MidiRealtimeByte
+    {
+        uint8_t status;
+        uint64_t enqueued_us;
+        uint64_t received_us; // Arrival time of a forwarded byte, 0 if local
+    };
+
+    // Real-time lane delay, from the send call until the byte starts on the
+    // wire (queueing plus the modelled UART backlog ahead of it)
+    struct MidiRealtimeStats
+    {
+        uint32_t sent = 0;
+        uint32_t dropped = 0;          // Real-time queue full
+        uint32_t max_delay_us = 0;
+        uint64_t total_delay_us = 0;
+        uint32_t over_byte_time = 0;   // Bytes delayed by more than MIDI_BYTE_TIME_US
+
+        uint32_t averageDelayUs() const { return sent ? static_cast<uint32_t>(total_delay_us / sent) : 0; }
+    };
+    // Forwarded (thru) messages, from their arrival at the input until they
+    // start on this port's wire
+    struct MidiThruStats
+    {
+        uint32_t forwarded = 0;
+        uint32_t dropped = 0;          // Output queue full
+        uint32_t max_latency_us = 0;
+        uint64_t total_latency_us = 0;
+
+        uint32_t averageLatencyUs() const { return forwarded ? static_cast<uint32_t>(total_latency_us / forwarded) : 0; }
+    };
+
     struct MidiOutConfig
     {
-        gpio_num_t sendPin;
-        gpio_num_t receivePin;
-        uart_port_t uart_num;
+        hal::Pin sendPin;
+        hal::Pin receivePin;
+        hal::UartPort uart_num;
+        bool running_status = true;               // Omit repeated status bytes
+        uint32_t running_status_refresh_ms = 500; // Resend the status at least this often
+        bool note_off_as_note_on = false;         // Send Note Off as Note On, velocity 0
+        uint8_t tx_lookahead_bytes = 4;           // Bytes handed to the UART ahead of the wire while
+                                                  // real-time bytes flow; bounds how long they wait
+        uint32_t realtime_idle_ms = 250;          // After this long without a real-time byte (and no
+                                                  // coalesced values waiting), write whole batches
+        bool track_notes = true;                  // Remember which notes are held on this output
+        bool release_notes_on_stop = true;        // Send their Note Offs after a Stop (needs track_notes)
+        bool coalesce_controllers = false;        // CC, pitch bend and channel pressure: latest value
+                                                  // wins, and may overtake queued notes
+        bool latency_probes = true;               // Fill the histograms behind getLatency()
+    };
+
+    // Where queued messages (local and thru) spend their time, from the
+    // send call until their last stop bit leaves the wire per the modelled
+    // UART backlog. Coalesced controllers and real-time bytes bypass the
+    // queue: see coalescedControllers() and MidiRealtimeStats.
+    struct MidiOutLatency
+    {
+        LatencyHistogram::Snapshot queue; // Send call until the TX task takes the message
+        LatencyHistogram::Snapshot wire;  // Send call until the message has left the wire
+        uint32_t dropped = 0;             // Queue full, message lost
+        uint32_t queue_high_water = 0;    // Most messages waiting at once
     };
 
     class MidiOut
@@ -27,20 +90,150 @@ namespace midi
     public:
         MidiOut(const MidiOutConfig &config);
         void init();
+        // With coalesce_controllers, CCs that carry a position (see
+        // ControllerCoalescer::coalesces), pitch bend and channel pressure
+        // skip the FIFO. A value not yet on the wire is replaced by the
+        // next one, so a sweep never fills the queue and its final value
+        // always goes out; they may overtake queued notes.
         void sendControllerChange(ControllerChange event);
         void setSongPosition(SongPosition event);
         void setNote(NoteMessage event);
         void setTransportEvent(TransportEvent event);
         void sendTimingClock();
+        void sendPolyAftertouch(PolyAftertouch event);
+        void sendProgramChange(ProgramChange event);
+        void sendChannelPressure(ChannelPressure event);
+        void sendPitchBend(PitchBend event);
+
+        // 14-bit CC as MSB + LSB, and NRPN/RPN as select + data entry. The
+        // Control Changes are queued together, so running status makes them
+        // 2 bytes each after the first.
+        void sendHighResController(HighResController event);
+        void sendParameterChange(ParameterChange event);
+
+        // Send USB MIDI event packets as they came in, e.g. a transfer from
+        // a USB host, taking the message length from each CIN. The cable
+        // number is ignored. CC, channel pressure and pitch bend go through
+        // the calls above (and so coalesce), real-time bytes take the
+        // priority lane. SysEx packets (CIN 4–7) and reserved CINs are
+        // skipped; send SysEx with sendSysEx(). Returns the packets sent.
+        size_t sendPackets(const Packet4 *packets, size_t count);
+
+        // Queue a System Real-Time byte (0xF8–0xFF) ahead of everything else.
+        // It is slipped between the bytes of whatever is being sent.
+        void sendRealtime(uint8_t status);
+
+        MidiRealtimeStats getRealtimeStats() const;
+
+        // Merge a message that arrived on another port at `received_us`
+        // (thru). It shares the output encoder with local messages, so
+        // running status stays consistent; real-time bytes take the
+        // priority lane. Never blocks. See MidiThru.
+        bool forward(const uint8_t *data, size_t length, uint64_t received_us);
+
+        MidiThruStats getThruStats() const;
+
+        // Controller values replaced before they reached the wire
+        uint32_t coalescedControllers() const;
+
+        // Lock-free copy of the latency histograms and queue counters (needs
+        // latency_probes); callable from any task
+        MidiOutLatency getLatency() const;
+
+        // Send a Note Off for every note still held on this output, and
+        // only for those (needs track_notes). Runs on the TX task ahead of
+        // queued messages; safe to call from any task, e.g. when an input
+        // loses Active Sensing.
+        void releaseHeldNotes();
+
+        // Send a message at an absolute hal::nowUs() time. Due messages are
+        // released by a one-shot timer armed for the earliest deadline and
+        // join the normal output queue; real-time bytes go to the priority
+        // lane. A time in the past sends right away. Returns false when the
+        // schedule is full.
+        bool sendAt(uint64_t timestamp_us, const uint8_t *data, size_t length);
+        bool sendAt(uint64_t timestamp_us, NoteMessage event);
+        bool sendAt(uint64_t timestamp_us, ControllerChange event);
+        bool sendAt(uint64_t timestamp_us, SongPosition event);
+        bool sendAt(uint64_t timestamp_us, TransportEvent event);
+        bool sendAt(uint64_t timestamp_us, PolyAftertouch event);
+        bool sendAt(uint64_t timestamp_us, ProgramChange event);
+        bool sendAt(uint64_t timestamp_us, ChannelPressure event);
+        bool sendAt(uint64_t timestamp_us, PitchBend event);
+
+        // Send a complete SysEx message (0xF0 ... 0xF7) straight from the
+        // caller's buffer. Blocks until the bytes are handed to the UART
+        // driver, so the buffer only has to live for the duration of the call.
+        bool sendSysEx(const uint8_t *data, size_t length);
 
     private:
+        static constexpr size_t kTxBatchSize = 96; // Bytes gathered into one uart_write_bytes
+        static constexpr size_t kScheduleSize = 128; // Messages waiting for sendAt
+
         void txLoop();
+        void pump();
+        bool refill();
+        void encodeRelease(uint64_t now_us);
+        bool takeQueued(MidiTxMessage &msg);
+        void encodeMessage(const uint8_t *data, size_t length, uint64_t now_us);
+        void writeRealtime(uint64_t now_us);
+        void recordThru(uint64_t latency_us);
+        bool throttled(uint64_t now_us) const;
+        size_t wireRoom(uint64_t now_us, bool throttle) const;
+        void writeWire(const uint8_t *data, size_t length, uint64_t now_us);
+        void probeQueued(const MidiTxMessage &msg, uint64_t now_us);
+        void probeWritten();
+        void wakeTx();
         void sendBytes(const uint8_t *data, size_t length);
+        void serviceSchedule();
+        void armSchedule(uint64_t due_us, uint64_t now_us);
 
         MidiOutConfig config;
-        QueueHandle_t tx_queue = nullptr;
-        QueueHandle_t uart_queue = nullptr;
-        TaskHandle_t tx_task = nullptr;
+        hal::Uart uart;
+        hal::Queue tx_queue;
+        hal::Queue rt_queue; // MidiRealtimeByte, always drained first
+        hal::TaskHandle tx_task = nullptr;
+        hal::Mutex sysex_lock;  // One borrowed buffer in flight at a time
+        hal::Signal sysex_done; // Given by txLoop once the buffer is written
+        hal::Timer wake_timer;  // Wakes the TX task when the wire has room
+        hal::Timer schedule_timer; // One-shot, at the earliest scheduled deadline
+        hal::Mutex schedule_lock;
+        TimingWheel<kScheduleSize> schedule; // Guarded by schedule_lock
+        uint64_t scheduleArmed_us = UINT64_MAX; // schedule_timer's deadline, UINT64_MAX = none; guarded by schedule_lock
+        std::atomic<bool> releaseRequested{false};
+        ControllerCoalescer controllers; // Drained by the TX task alongside tx_queue
+
+        // Owned by the TX task
+        RunningStatusEncoder encoder;
+        uint8_t batch[kTxBatchSize];      // Encoded messages waiting for the wire
+        const uint8_t *txData = batch;    // batch, or a borrowed SysEx payload
+        size_t txLength = 0;
+        size_t txOffset = 0;
+        bool sysexActive = false;         // txData is a SysEx payload
+        MidiTxMessage heldSysEx;          // Dequeued while a batch was still open
+        bool haveHeldSysEx = false;
+        uint64_t wireFreeAt_us = 0;       // When everything written so far has left the wire
+        uint64_t lastRealtime_us = 0;     // Last real-time byte written, 0 = none yet
+        NoteTracker heldNotes;            // Notes encoded and not yet released
+        bool releasing = false;           // Note Offs for heldNotes still to go out
+
+        // Queued messages in the current batch, to stamp when they leave the wire
+        struct WireProbe
+        {
+            size_t end; // Offset just past the message in txData
+            uint64_t enqueued_us;
+        };
+        WireProbe wireProbes[kTxBatchSize];
+        size_t wireProbeCount = 0;
+        size_t wireProbeNext = 0;
+        LatencyHistogram queueLatency; // Written by the TX task
+        LatencyHistogram wireLatency;  // Written by the TX task
+        std::atomic<uint32_t> queueHighWater{0};
+        std::atomic<uint32_t> queueDropped{0};
+
+        mutable hal::CriticalSection statsLock;
+        MidiRealtimeStats rtStats;
+        MidiThruStats thruStats;
     };
 
 }
@@ -1,41 +1,107 @@
 #pragma once
+#include <cstddef>
 #include "midi_protocol.hpp"
+#include "usb_midi.hpp"
 
 namespace midi
 {
-    inline void to_usb_packet(const ControllerChange &msg, uint8_t out[4])
+    // USB MIDI event packets, with byte 0 = cable number (0–15) << 4 | CIN
+
+    inline void to_usb_packet(const ControllerChange &msg, uint8_t out[4], uint8_t cable = 0)
     {
-        out[0] = (0 << 4) | 0xB;
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | 0xB);
         out[1] = 0xB0 | (msg.channel & 0x0F);
         out[2] = msg.controller;
         out[3] = msg.value;
     }
 
-    inline void to_usb_packet(const NoteMessage &msg, uint8_t out[4])
+    inline void to_usb_packet(const NoteMessage &msg, uint8_t out[4], uint8_t cable = 0)
     {
         const uint8_t status = (msg.on ? 0x90 : 0x80) | (msg.channel & 0x0F);
         const uint8_t cin = msg.on ? 0x9 : 0x8;
-        out[0] = (0 << 4) | cin;
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | cin);
         out[1] = status;
         out[2] = msg.note;
         out[3] = msg.velocity;
     }
 
-    inline void to_usb_packet(const TransportEvent &msg, uint8_t out[4])
+    // System Real-Time: CIN F, one byte
+    inline void to_usb_packet(const TransportEvent &msg, uint8_t out[4], uint8_t cable = 0)
     {
-        out[0] = (0 << 4) | 0x5;
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | 0xF);
         out[1] = static_cast<uint8_t>(msg.command);
         out[2] = 0x00;
         out[3] = 0x00;
     }
 
-    inline void to_usb_packet(const SongPosition &msg, uint8_t out[4])
+    inline void to_usb_packet(const SongPosition &msg, uint8_t out[4], uint8_t cable = 0)
     {
-        out[0] = (0 << 4) | 0x3;
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | 0x3);
         out[1] = 0xF2;
         out[2] = static_cast<uint8_t>(msg.position & 0x7F);
         out[3] = static_cast<uint8_t>((msg.position >> 7) & 0x7F);
     }
 
+    inline void to_usb_packet(const PolyAftertouch &msg, uint8_t out[4], uint8_t cable = 0)
+    {
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | 0xA);
+        out[1] = 0xA0 | (msg.channel & 0x0F);
+        out[2] = msg.note & 0x7F;
+        out[3] = msg.pressure & 0x7F;
+    }
+
+    inline void to_usb_packet(const ProgramChange &msg, uint8_t out[4], uint8_t cable = 0)
+    {
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | 0xC);
+        out[1] = 0xC0 | (msg.channel & 0x0F);
+        out[2] = msg.program & 0x7F;
+        out[3] = 0x00;
+    }
+
+    inline void to_usb_packet(const ChannelPressure &msg, uint8_t out[4], uint8_t cable = 0)
+    {
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | 0xD);
+        out[1] = 0xD0 | (msg.channel & 0x0F);
+        out[2] = msg.pressure & 0x7F;
+        out[3] = 0x00;
+    }
+
+    inline void to_usb_packet(const PitchBend &msg, uint8_t out[4], uint8_t cable = 0)
+    {
+        out[0] = static_cast<uint8_t>((cable & 0x0F) << 4 | 0xE);
+        out[1] = 0xE0 | (msg.channel & 0x0F);
+        out[2] = static_cast<uint8_t>(msg.value & 0x7F);
+        out[3] = static_cast<uint8_t>((msg.value >> 7) & 0x7F);
+    }
+
+    // MSB then LSB Control Change. Returns the number of packets (2).
+    inline size_t to_usb_packets(const HighResController &msg, uint8_t out[][4], uint8_t cable = 0)
+    {
+        const uint8_t controller = msg.controller & 0x1F;
+        to_usb_packet(ControllerChange{msg.channel, controller, static_cast<uint8_t>((msg.value >> 7) & 0x7F)}, out[0], cable);
+        to_usb_packet(ControllerChange{msg.channel, static_cast<uint8_t>(controller + 32), static_cast<uint8_t>(msg.value & 0x7F)}, out[1], cable);
+        return 2;
+    }
 
+    // Parameter select (MSB, LSB) then data entry (MSB, LSB). Returns the
+    // number of packets (4).
+    inline size_t to_usb_packets(const ParameterChange &msg, uint8_t out[][4], uint8_t cable = 0)
+    {
+        const uint8_t selectMsb = msg.registered ? 101 : 99;
+        to_usb_packet(ControllerChange{msg.channel, selectMsb, static_cast<uint8_t>((msg.parameter >> 7) & 0x7F)}, out[0], cable);
+        to_usb_packet(ControllerChange{msg.channel, static_cast<uint8_t>(selectMsb - 1), static_cast<uint8_t>(msg.parameter & 0x7F)}, out[1], cable);
+        to_usb_packet(ControllerChange{msg.channel, 6, static_cast<uint8_t>((msg.value >> 7) & 0x7F)}, out[2], cable);
+        to_usb_packet(ControllerChange{msg.channel, 38, static_cast<uint8_t>(msg.value & 0x7F)}, out[3], cable);
+        return 4;
+    }
+
+    // `count` single-packet messages of one type into out[0..count), e.g. a
+    // whole USB transfer at once. Returns `count`.
+    template <typename Message>
+    inline size_t to_usb_packets(const Message *msgs, size_t count, Packet4 *out, uint8_t cable = 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+            to_usb_packet(msgs[i], out[i].data(), cable);
+        return count;
+    }
 }
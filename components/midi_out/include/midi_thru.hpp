@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "midi_protocol.hpp"
+#include "midi_router.hpp"
+#include "midi_out.hpp"
+
+namespace midi
+{
+    // Which received messages are passed through
+    struct MidiThruConfig
+    {
+        bool channel_messages = true;
+        bool system_common = true;
+        bool realtime = true;
+        uint16_t channel_mask = 0xFFFF; // Bit n forwards channel n (0–15)
+    };
+
+    // Forwards messages from an input straight to a MidiOut, merged with
+    // whatever the application sends there. Hook it to the input's UART
+    // task so nothing waits on the input's dispatch:
+    //
+    //   MidiThru thru(midiOut);
+    //   midiIn.setThruHook([&](const MidiEvent &e) { thru.feed(e); });
+    //
+    // End-to-end latency is reported by MidiOut::getThruStats().
+    class MidiThru
+    {
+    public:
+        explicit MidiThru(MidiOut &out, const MidiThruConfig &config = {});
+
+        void feed(const MidiEvent &event);
+
+        // Run forwarded messages through `router` (nullptr for none). The
+        // router must stay alive while set; swap in a freshly compiled one
+        // rather than recompiling it in place.
+        void setRouter(const MidiRouter *router) { this->router.store(router, std::memory_order_release); }
+
+        // Messages left out by the config or the router; callable from any task
+        uint32_t filtered() const { return filteredCount.load(std::memory_order_relaxed); }
+
+    private:
+        bool passes(uint8_t status) const;
+
+        MidiOut &out;
+        MidiThruConfig config;
+        std::atomic<const MidiRouter *> router{nullptr};
+        std::atomic<uint32_t> filteredCount{0}; // Written by the feeding task
+    };
+}
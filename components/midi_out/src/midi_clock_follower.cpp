@@ -0,0 +1,174 @@
+#include "midi_clock_follower.hpp"
+#include "midi_log.hpp"
+
+static const char *TAG = "MidiClockFollower";
+using namespace midi;
+
+MidiClockFollower::MidiClockFollower(MidiOut &out, uint32_t time_constant_ticks) : out(out)
+{
+    pll.setTimeConstant(time_constant_ticks);
+
+    armLock.create();
+    timer.create([](void *arg)
+                 { static_cast<MidiClockFollower *>(arg)->onTimer(); },
+                 this, "midi_clock_follow", false);
+}
+
+MidiClockFollower::~MidiClockFollower()
+{
+    end();
+}
+
+void MidiClockFollower::begin()
+{
+    end();
+
+    lock.lock();
+    pll.reset();
+    outIndex = 0;
+    lastIn_us = 0;
+    lastOut_us = 0;
+    active = true;
+    lock.unlock();
+
+    MIDI_LOGI(TAG, "Following upstream clock, time constant %u ticks", (unsigned)pll.timeConstantTicks());
+}
+
+void MidiClockFollower::end()
+{
+    lock.lock();
+    active = false;
+    lock.unlock();
+    timer.stop();
+}
+
+void MidiClockFollower::setTimeConstant(uint32_t ticks)
+{
+    lock.lock();
+    pll.setTimeConstant(ticks);
+    lock.unlock();
+}
+
+BpmQ16 MidiClockFollower::bpm() const
+{
+    lock.lock();
+    BpmQ16 value = pll.bpm();
+    lock.unlock();
+    return value;
+}
+
+MidiClockFollowStats MidiClockFollower::getStats() const
+{
+    lock.lock();
+    MidiClockFollowStats snapshot = stats;
+    snapshot.relocks = pll.relockCount();
+    snapshot.bpm = pll.bpm();
+    snapshot.locked = pll.locked();
+    lock.unlock();
+    return snapshot;
+}
+
+void MidiClockFollower::resetStats()
+{
+    lock.lock();
+    stats = {};
+    lock.unlock();
+}
+
+void MidiClockFollower::record(ClockJitterStats &stats, uint64_t interval_us, uint64_t period_us)
+{
+    uint64_t deviation = interval_us > period_us ? interval_us - period_us : period_us - interval_us;
+    stats.ticks++;
+    stats.total_us += deviation;
+    if (deviation > stats.max_us)
+        stats.max_us = static_cast<uint32_t>(deviation);
+}
+
+void MidiClockFollower::onClockTick(uint64_t timestamp_us)
+{
+    lock.lock();
+    if (!active)
+    {
+        lock.unlock();
+        return;
+    }
+
+    pll.addTick(timestamp_us);
+    if (lastIn_us != 0 && pll.locked())
+        record(stats.input, timestamp_us - lastIn_us, pll.periodQ16() >> 16);
+    lastIn_us = timestamp_us;
+
+    // After a dropout, skip the ticks we can no longer send on time
+    uint64_t received = pll.ticksReceived();
+    if (outIndex + 2 < received)
+    {
+        stats.skipped += static_cast<uint32_t>(received - 1 - outIndex);
+        outIndex = received - 1;
+    }
+    lock.unlock();
+
+    // The smoothed time of the next tick moved; re-aim the timer
+    arm();
+}
+
+void MidiClockFollower::onTransport(TransportCommand command)
+{
+    if (command == TransportCommand::Stop)
+    {
+        pendingTransport.store(0, std::memory_order_release);
+        out.sendRealtime(static_cast<uint8_t>(command));
+        return;
+    }
+    pendingTransport.store(static_cast<uint8_t>(command), std::memory_order_release);
+}
+
+void MidiClockFollower::onTimer()
+{
+    uint64_t now_us = hal::nowUs();
+
+    lock.lock();
+    if (!active || !pll.locked())
+    {
+        lock.unlock();
+        return;
+    }
+    // At most one tick ahead of upstream, so a stopped clock stops us too
+    uint32_t due = 0;
+    while (outIndex <= pll.ticksReceived() && pll.tickTime(outIndex) <= now_us)
+    {
+        if (lastOut_us != 0)
+            record(stats.output, now_us - lastOut_us, pll.periodQ16() >> 16);
+        lastOut_us = now_us;
+        outIndex++;
+        due++;
+    }
+    lock.unlock();
+
+    for (uint32_t i = 0; i < due; ++i)
+    {
+        uint8_t transport = pendingTransport.exchange(0, std::memory_order_acq_rel);
+        if (transport)
+            out.sendRealtime(transport);
+        out.sendRealtime(0xF8);
+    }
+
+    arm();
+}
+
+// Called from both the input task and the timer callback. armLock keeps
+// each stop, read and start together, so the last caller aims the timer
+// from the newest PLL state and never restarts a timer the other armed.
+void MidiClockFollower::arm()
+{
+    armLock.lock();
+    timer.stop();
+    uint64_t now_us = hal::nowUs();
+    lock.lock();
+    bool keep = active && pll.locked() && outIndex <= pll.ticksReceived();
+    uint64_t next_us = keep ? pll.tickTime(outIndex) : 0;
+    lock.unlock();
+
+    if (keep)
+        timer.startOnce(next_us > now_us ? next_us - now_us : 0);
+    armLock.unlock();
+}
@@ -0,0 +1,108 @@
+#include "midi_clock_master.hpp"
+#include "midi_log.hpp"
+
+static const char *TAG = "MidiClockMaster";
+using namespace midi;
+
+MidiClockMaster::MidiClockMaster(MidiOut &out) : out(out)
+{
+    timer.create([](void *arg)
+                 { static_cast<MidiClockMaster *>(arg)->onTimer(); },
+                 this, "midi_clock", false);
+}
+
+MidiClockMaster::~MidiClockMaster()
+{
+    end();
+}
+
+void MidiClockMaster::begin(BpmQ16 bpm)
+{
+    end();
+
+    uint64_t now_us = hal::nowUs();
+    lock.lock();
+    scheduler.reset(now_us, bpm);
+    active = true;
+    lock.unlock();
+
+    MIDI_LOGI(TAG, "Clock master at %u.%03u BPM", (unsigned)(bpm >> 16), (unsigned)(((bpm & 0xFFFF) * 1000) >> 16));
+    onTimer();
+}
+
+void MidiClockMaster::end()
+{
+    lock.lock();
+    active = false;
+    lock.unlock();
+    timer.stop();
+}
+
+void MidiClockMaster::setBpm(BpmQ16 bpm)
+{
+    lock.lock();
+    scheduler.setBpm(bpm);
+    lock.unlock();
+}
+
+void MidiClockMaster::rampTo(BpmQ16 bpm, uint32_t beats)
+{
+    lock.lock();
+    scheduler.rampTo(bpm, beats * MIDI_CLOCKS_PER_BEAT);
+    lock.unlock();
+}
+
+BpmQ16 MidiClockMaster::bpm() const
+{
+    lock.lock();
+    BpmQ16 value = scheduler.bpm();
+    lock.unlock();
+    return value;
+}
+
+void MidiClockMaster::setTransport(TransportCommand command)
+{
+    pendingTransport.store(static_cast<uint8_t>(command), std::memory_order_release);
+}
+
+void MidiClockMaster::onTimer()
+{
+    uint64_t now_us = hal::nowUs();
+
+    lock.lock();
+    if (!active)
+    {
+        lock.unlock();
+        return;
+    }
+    // Emit every tick that is due (more than one only if we were starved)
+    uint32_t due = 0;
+    while (scheduler.nextTick() <= now_us)
+    {
+        scheduler.advance();
+        due++;
+    }
+    lock.unlock();
+
+    for (uint32_t i = 0; i < due; ++i)
+    {
+        uint8_t transport = pendingTransport.exchange(0, std::memory_order_acq_rel);
+        if (transport)
+            out.sendRealtime(transport);
+        out.sendRealtime(0xF8);
+    }
+
+    arm();
+}
+
+void MidiClockMaster::arm()
+{
+    uint64_t now_us = hal::nowUs();
+    lock.lock();
+    uint64_t next_us = scheduler.nextTick();
+    bool keep = active;
+    lock.unlock();
+
+    if (keep)
+        timer.startOnce(next_us > now_us ? next_us - now_us : 0);
+}
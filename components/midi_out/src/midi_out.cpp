@@ -1,6 +1,7 @@
 #include "midi_out.hpp"
 #include "midi_out_parser.hpp"
-#include "esp_log.h"
+#include "midi_log.hpp"
+#include "midi_trace.hpp"
 
 static const char *TAG = "MidiSends";
 using namespace midi;
@@ -9,35 +10,43 @@ MidiOut::MidiOut(const MidiOutConfig &cfg) : config(cfg) {}
 
 void MidiOut::init()
 {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
-    uart_config_t uart_config = {
-        .baud_rate = MIDI_BAUD_RATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-    };
-#pragma GCC diagnostic pop
-
-    ESP_ERROR_CHECK(uart_param_config(config.uart_num, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(config.uart_num, config.sendPin, config.receivePin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-    ESP_ERROR_CHECK(uart_driver_install(config.uart_num, 256, 256, 0, nullptr, 0));
-    ESP_ERROR_CHECK(uart_flush(config.uart_num));
-
-    tx_queue = xQueueCreate(32, sizeof(MidiTxMessage));
-
-    xTaskCreate(
+    hal::UartConfig uart_cfg;
+    uart_cfg.port = config.uart_num;
+    uart_cfg.tx_pin = config.sendPin;
+    uart_cfg.rx_pin = config.receivePin;
+    uart_cfg.rx_buffer_size = 256;
+    uart_cfg.tx_buffer_size = 256;
+    uart.open(uart_cfg);
+
+    if (config.tx_lookahead_bytes == 0)
+        config.tx_lookahead_bytes = 1;
+    encoder.configure(config.running_status, config.running_status_refresh_ms * 1000, config.note_off_as_note_on);
+
+    tx_queue.create(32, sizeof(MidiTxMessage));
+    rt_queue.create(16, sizeof(MidiRealtimeByte));
+    sysex_lock.create();
+    sysex_done.create();
+
+    wake_timer.create([](void *arg)
+                      { static_cast<MidiOut *>(arg)->wakeTx(); },
+                      this, "midi_tx_wake");
+
+    schedule_lock.create();
+    schedule.clear(hal::nowUs());
+    schedule_timer.create([](void *arg)
+                          { static_cast<MidiOut *>(arg)->serviceSchedule(); },
+                          this, "midi_schedule");
+
+    tx_task = hal::startTask(
         [](void *arg)
         {
             auto *self = static_cast<MidiOut *>(arg);
             self->txLoop();
         },
+        this,
         "midi_tx_task",
         4098,
-        this,
-        configMAX_PRIORITIES - 5,
-        &tx_task);
+        hal::kMaxPriority - 5);
 }
 
 void MidiOut::setNote(NoteMessage event)
@@ -49,6 +58,13 @@ void MidiOut::setNote(NoteMessage event)
 
 void MidiOut::sendControllerChange(ControllerChange event)
 {
+    if (config.coalesce_controllers && ControllerCoalescer::coalesces(event.controller))
+    {
+        controllers.setControllerChange(event.channel, event.controller, event.value);
+        wakeTx();
+        return;
+    }
+
     uint8_t packet[4];
     to_usb_packet(event, packet);
     sendBytes(&packet[1], 3);
@@ -58,7 +74,7 @@ void MidiOut::setTransportEvent(TransportEvent event)
 {
     uint8_t packet[4];
     to_usb_packet(event, packet);
-    sendBytes(&packet[1], 1); // real-time MIDI is 1 byte
+    sendRealtime(packet[1]); // real-time MIDI is 1 byte
 }
 
 void MidiOut::setSongPosition(SongPosition event)
@@ -70,42 +86,620 @@ void MidiOut::setSongPosition(SongPosition event)
 
 void MidiOut::sendTimingClock()
 {
-    uint8_t data = 0xF8;
-    sendBytes(&data, 1);
+    sendRealtime(0xF8);
+}
+
+void MidiOut::sendPolyAftertouch(PolyAftertouch event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    sendBytes(&packet[1], 3);
+}
+
+void MidiOut::sendProgramChange(ProgramChange event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    sendBytes(&packet[1], 2);
+}
+
+void MidiOut::sendChannelPressure(ChannelPressure event)
+{
+    if (config.coalesce_controllers)
+    {
+        controllers.setChannelPressure(event.channel, event.pressure);
+        wakeTx();
+        return;
+    }
+
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    sendBytes(&packet[1], 2);
+}
+
+void MidiOut::sendPitchBend(PitchBend event)
+{
+    if (config.coalesce_controllers)
+    {
+        controllers.setPitchBend(event.channel, event.value);
+        wakeTx();
+        return;
+    }
+
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    sendBytes(&packet[1], 3);
+}
+
+void MidiOut::sendHighResController(HighResController event)
+{
+    uint8_t packets[2][4];
+    size_t count = to_usb_packets(event, packets);
+    for (size_t i = 0; i < count; ++i)
+        sendBytes(&packets[i][1], 3);
+}
+
+void MidiOut::sendParameterChange(ParameterChange event)
+{
+    uint8_t packets[4][4];
+    size_t count = to_usb_packets(event, packets);
+    for (size_t i = 0; i < count; ++i)
+        sendBytes(&packets[i][1], 3);
+}
+
+size_t MidiOut::sendPackets(const Packet4 *packets, size_t count)
+{
+    size_t sent = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t *packet = packets[i].data();
+        const uint8_t status = packet[1];
+        switch (usbCinOf(packet))
+        {
+        case UsbCin::ControlChange:
+            sendControllerChange(ControllerChange{static_cast<uint8_t>(status & 0x0F), packet[2], packet[3]});
+            break;
+        case UsbCin::ChannelPressure:
+            sendChannelPressure(ChannelPressure{static_cast<uint8_t>(status & 0x0F), packet[2]});
+            break;
+        case UsbCin::PitchBend:
+            sendPitchBend(PitchBend{static_cast<uint8_t>(status & 0x0F), static_cast<uint16_t>((packet[3] << 7) | packet[2])});
+            break;
+        case UsbCin::NoteOff:
+        case UsbCin::NoteOn:
+        case UsbCin::PolyAftertouch:
+        case UsbCin::ProgramChange:
+        case UsbCin::SystemCommon2:
+        case UsbCin::SystemCommon3:
+            if (!(status & 0x80))
+                continue;
+            sendBytes(&packet[1], usbMessageLength(packet));
+            break;
+        case UsbCin::Byte:
+        case UsbCin::SingleByte: // Tune Request; SysEx ending with 0xF7 is skipped
+            if (status >= 0xF8)
+                sendRealtime(status);
+            else if (status == 0xF6)
+                sendBytes(&packet[1], 1);
+            else
+                continue;
+            break;
+        default:
+            continue;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+void MidiOut::sendRealtime(uint8_t status)
+{
+    MidiRealtimeByte rt = {status, hal::nowUs(), 0};
+    if (!rt_queue.send(&rt))
+    {
+        statsLock.lock();
+        rtStats.dropped++;
+        statsLock.unlock();
+        MIDI_LOGW(TAG, "MIDI real-time queue full — 0x%02X dropped", status);
+        return;
+    }
+    wakeTx();
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, const uint8_t *data, size_t length)
+{
+    if (length == 0 || length > 3 || !(data[0] & 0x80) || data[0] == 0xF0)
+    {
+        MIDI_LOGW(TAG, "sendAt takes a single 1-3 byte message");
+        return false;
+    }
+
+    ScheduledMessage msg = {};
+    msg.due_us = timestamp_us;
+    memcpy(msg.data, data, length);
+    msg.length = static_cast<uint8_t>(length);
+
+    uint64_t now_us = hal::nowUs();
+    schedule_lock.lock();
+    bool scheduled = schedule.schedule(msg, now_us);
+    if (scheduled && timestamp_us < scheduleArmed_us)
+        armSchedule(timestamp_us, now_us);
+    schedule_lock.unlock();
+
+    if (!scheduled)
+        MIDI_LOGW(TAG, "MIDI schedule full — message dropped");
+    return scheduled;
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, NoteMessage event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 3);
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, ControllerChange event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 3);
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, SongPosition event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 3);
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, TransportEvent event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 1);
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, PolyAftertouch event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 3);
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, ProgramChange event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 2);
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, ChannelPressure event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 2);
+}
+
+bool MidiOut::sendAt(uint64_t timestamp_us, PitchBend event)
+{
+    uint8_t packet[4];
+    to_usb_packet(event, packet);
+    return sendAt(timestamp_us, &packet[1], 3);
+}
+
+// Runs on the timer task at the earliest deadline. Hands due messages to
+// the TX task and re-arms for the next one, if any.
+void MidiOut::serviceSchedule()
+{
+    uint64_t now_us = hal::nowUs();
+
+    schedule_lock.lock();
+    schedule.advance(now_us, [this](const ScheduledMessage &msg)
+                     {
+                         if (msg.data[0] >= 0xF8)
+                             sendRealtime(msg.data[0]);
+                         else
+                             sendBytes(msg.data, msg.length); });
+    uint64_t due_us = schedule.nextDue();
+    if (due_us == UINT64_MAX)
+    {
+        schedule_timer.stop(); // sendAt() may have armed it for what just went out
+        scheduleArmed_us = UINT64_MAX;
+    }
+    else
+    {
+        armSchedule(due_us, now_us);
+    }
+    schedule_lock.unlock();
+}
+
+// Call with schedule_lock held
+void MidiOut::armSchedule(uint64_t due_us, uint64_t now_us)
+{
+    scheduleArmed_us = due_us;
+    schedule_timer.startOnce(due_us > now_us ? due_us - now_us : 0);
+}
+
+bool MidiOut::forward(const uint8_t *data, size_t length, uint64_t received_us)
+{
+    bool queued;
+    if (data[0] >= 0xF8)
+    {
+        MidiRealtimeByte rt = {data[0], hal::nowUs(), received_us};
+        queued = rt_queue.send(&rt);
+    }
+    else
+    {
+        MidiTxMessage msg;
+        memcpy(msg.data, data, length);
+        msg.length = length;
+        msg.received_us = received_us;
+        msg.enqueued_us = config.latency_probes ? hal::nowUs() : 0;
+        queued = tx_queue.send(&msg);
+    }
+
+    if (!queued)
+    {
+        if (data[0] < 0xF8)
+            queueDropped.fetch_add(1, std::memory_order_relaxed);
+        statsLock.lock();
+        thruStats.dropped++;
+        statsLock.unlock();
+        return false;
+    }
+    wakeTx();
+    return true;
+}
+
+MidiThruStats MidiOut::getThruStats() const
+{
+    statsLock.lock();
+    MidiThruStats snapshot = thruStats;
+    statsLock.unlock();
+    return snapshot;
+}
+
+void MidiOut::recordThru(uint64_t latency_us)
+{
+    statsLock.lock();
+    thruStats.forwarded++;
+    thruStats.total_latency_us += latency_us;
+    if (latency_us > thruStats.max_latency_us)
+        thruStats.max_latency_us = static_cast<uint32_t>(latency_us);
+    statsLock.unlock();
+}
+
+uint32_t MidiOut::coalescedControllers() const
+{
+    return controllers.replaced();
+}
+
+MidiOutLatency MidiOut::getLatency() const
+{
+    auto backoff = []
+    { hal::sleepMs(1); };
+    MidiOutLatency snapshot;
+    snapshot.queue = queueLatency.snapshot(backoff);
+    snapshot.wire = wireLatency.snapshot(backoff);
+    snapshot.dropped = queueDropped.load(std::memory_order_relaxed);
+    snapshot.queue_high_water = queueHighWater.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+MidiRealtimeStats MidiOut::getRealtimeStats() const
+{
+    statsLock.lock();
+    MidiRealtimeStats snapshot = rtStats;
+    statsLock.unlock();
+    return snapshot;
+}
+
+void MidiOut::releaseHeldNotes()
+{
+    if (!config.track_notes)
+        return;
+    releaseRequested.store(true, std::memory_order_release);
+    wakeTx();
+}
+
+void MidiOut::wakeTx()
+{
+    hal::notify(tx_task);
 }
 
 void MidiOut::txLoop()
 {
-    MidiTxMessage msg;
     while (true)
     {
-        if (xQueueReceive(tx_queue, &msg, portMAX_DELAY))
+        hal::waitForNotify(hal::kForever);
+        pump();
+    }
+}
+
+// While real-time bytes flow, keeps at most tx_lookahead_bytes in the UART
+// ahead of the wire, so a real-time byte never waits behind more than that,
+// even mid-message or mid-SysEx; a one-shot timer wakes us as soon as a
+// byte has gone out. Otherwise up to a whole batch goes out in one write
+// and the timer wakes us once it has drained to the lookahead, so bulk
+// traffic costs one wake-up per batch rather than one per byte.
+void MidiOut::pump()
+{
+    while (true)
+    {
+        uint64_t now_us = hal::nowUs();
+        writeRealtime(now_us);
+
+        if (txOffset == txLength && !refill())
+            return; // idle until the next notification
+
+        bool throttle = throttled(now_us);
+        size_t room = wireRoom(now_us, throttle);
+        if (room == 0)
+        {
+            size_t keep = throttle ? config.tx_lookahead_bytes - 1u : config.tx_lookahead_bytes;
+            uint64_t lookahead_us = static_cast<uint64_t>(keep) * MIDI_BYTE_TIME_US;
+            uint64_t backlog_us = wireFreeAt_us - now_us;
+            uint64_t delay_us = backlog_us > lookahead_us + 50 ? backlog_us - lookahead_us : 50;
+            if (!wake_timer.active())
+                wake_timer.startOnce(delay_us);
+            return;
+        }
+
+        size_t length = txLength - txOffset;
+        if (length > room)
+            length = room;
+        writeWire(txData + txOffset, length, now_us);
+        txOffset += length;
+        if (wireProbeNext < wireProbeCount)
+            probeWritten();
+
+        if (txOffset == txLength && sysexActive)
         {
-            int res = uart_write_bytes(config.uart_num, msg.data, msg.length);
-            if (res < 0)
+            // The driver has its own copy now; release the caller's buffer
+            sysexActive = false;
+            sysex_done.give();
+        }
+    }
+}
+
+// Loads the next run of bytes: either queued messages encoded into `batch`,
+// or a SysEx payload used in place. Returns false when nothing is pending.
+bool MidiOut::refill()
+{
+    txOffset = 0;
+    txLength = 0;
+    txData = batch;
+    wireProbeCount = 0;
+    wireProbeNext = 0;
+
+    uint64_t now_us = hal::nowUs();
+    if (releaseRequested.exchange(false, std::memory_order_acquire))
+        releasing = true;
+    if (releasing)
+    {
+        encodeRelease(now_us);
+        if (txLength > 0)
+            return true;
+    }
+
+    // Alternate between the FIFO and the coalesced controllers, so
+    // neither starves the other when the wire is saturated
+    bool queueOpen = true;
+    while (txLength + 3 <= kTxBatchSize)
+    {
+        bool took = false;
+        MidiTxMessage msg;
+        if (queueOpen && takeQueued(msg))
+        {
+            took = true;
+            if (msg.payload)
             {
-                ESP_LOGE(TAG, "MIDI send failed: %s", esp_err_to_name(res));
+                if (txLength > 0)
+                {
+                    // Finish the open batch first
+                    heldSysEx = msg;
+                    haveHeldSysEx = true;
+                    break;
+                }
+                encoder.reset(); // SysEx cancels running status
+                txData = msg.payload;
+                txLength = msg.length;
+                sysexActive = true;
+                probeQueued(msg, now_us);
+                break;
             }
-            else
+            if (msg.received_us)
             {
-                ESP_LOGI(TAG, "MIDI send len=%u, wrote=%d", (unsigned int)msg.length, res);
-                uart_wait_tx_done(config.uart_num, pdMS_TO_TICKS(10));
+                // Starts on the wire after the backlog and the batch ahead of it
+                uint64_t start_us = (wireFreeAt_us > now_us ? wireFreeAt_us : now_us) + txLength * MIDI_BYTE_TIME_US;
+                recordThru(start_us > msg.received_us ? start_us - msg.received_us : 0);
             }
+            encodeMessage(msg.data, msg.length, now_us);
+            probeQueued(msg, now_us);
+        }
+        else
+        {
+            queueOpen = false;
         }
+
+        // Once the FIFO is empty, take controller values only as fast as
+        // the wire needs them: one still in the store can be replaced by a
+        // newer value, one already in the batch can't
+        uint8_t coalesced[3];
+        size_t length;
+        bool wanted = queueOpen || txLength < config.tx_lookahead_bytes;
+        if (wanted && txLength + 3 <= kTxBatchSize && (length = controllers.pop(coalesced)) > 0)
+        {
+            took = true;
+            encodeMessage(coalesced, length, now_us);
+        }
+
+        if (!took)
+            break;
     }
+
+    return txLength > 0;
 }
 
-void MidiOut::sendBytes(const uint8_t *data, size_t length)
+bool MidiOut::takeQueued(MidiTxMessage &msg)
+{
+    if (haveHeldSysEx)
+    {
+        msg = heldSysEx;
+        haveHeldSysEx = false;
+        return true;
+    }
+
+    size_t waiting = tx_queue.waiting();
+    if (!tx_queue.receive(&msg))
+        return false;
+    if (waiting > queueHighWater.load(std::memory_order_relaxed))
+        queueHighWater.store(static_cast<uint32_t>(waiting), std::memory_order_relaxed);
+    return true;
+}
+
+// A queued message now sits in txData up to txLength
+void MidiOut::probeQueued(const MidiTxMessage &msg, uint64_t now_us)
+{
+    if (!config.latency_probes || !msg.enqueued_us)
+        return;
+    queueLatency.record(now_us - msg.enqueued_us);
+    wireProbes[wireProbeCount++] = WireProbe{txLength, msg.enqueued_us};
+}
+
+// Stamps every probed message written out by now with the time its last
+// byte leaves the wire
+void MidiOut::probeWritten()
+{
+    while (wireProbeNext < wireProbeCount && wireProbes[wireProbeNext].end <= txOffset)
+    {
+        const WireProbe &probe = wireProbes[wireProbeNext++];
+        uint64_t done_us = wireFreeAt_us - static_cast<uint64_t>(txOffset - probe.end) * MIDI_BYTE_TIME_US;
+        wireLatency.record(done_us > probe.enqueued_us ? done_us - probe.enqueued_us : 0);
+    }
+}
+
+void MidiOut::encodeMessage(const uint8_t *data, size_t length, uint64_t now_us)
+{
+    if (config.track_notes)
+        heldNotes.feed(data, length);
+    txLength += encoder.encode(data, length, now_us, batch + txLength);
+}
+
+// Encodes Note Offs for held notes into `batch`, as many as fit, the same
+// way as a Note Off the application sends (note_off_as_note_on included).
+// Clears `releasing` once the last one is encoded.
+void MidiOut::encodeRelease(uint64_t now_us)
+{
+    size_t released = heldNotes.releaseAll([&](const NoteMessage &off)
+                                           {
+                                               uint8_t packet[4];
+                                               to_usb_packet(off, packet);
+                                               encodeMessage(&packet[1], 3, now_us); },
+                                           kTxBatchSize / 3);
+    if (released < kTxBatchSize / 3)
+        releasing = false;
+}
+
+void MidiOut::writeRealtime(uint64_t now_us)
+{
+    MidiRealtimeByte rt;
+    while (rt_queue.receive(&rt))
+    {
+        uint64_t backlog_us = wireFreeAt_us > now_us ? wireFreeAt_us - now_us : 0;
+        uint64_t delay_us = (now_us - rt.enqueued_us) + backlog_us;
+        writeWire(&rt.status, 1, now_us);
+        lastRealtime_us = now_us;
+        if (config.track_notes)
+        {
+            if (rt.status == static_cast<uint8_t>(TransportCommand::Stop) && config.release_notes_on_stop)
+                releasing = true;
+            heldNotes.feed(&rt.status, 1); // System Reset forgets everything
+        }
+        if (rt.received_us)
+            recordThru(now_us + backlog_us - rt.received_us);
+
+        statsLock.lock();
+        rtStats.sent++;
+        rtStats.total_delay_us += delay_us;
+        if (delay_us > rtStats.max_delay_us)
+            rtStats.max_delay_us = static_cast<uint32_t>(delay_us);
+        if (delay_us > MIDI_BYTE_TIME_US)
+            rtStats.over_byte_time++;
+        statsLock.unlock();
+    }
+}
+
+// Real-time bytes went out recently, or coalesced values wait to be taken
+// as late as possible
+bool MidiOut::throttled(uint64_t now_us) const
+{
+    if (lastRealtime_us && now_us - lastRealtime_us < static_cast<uint64_t>(config.realtime_idle_ms) * 1000)
+        return true;
+    return config.coalesce_controllers && !controllers.empty();
+}
+
+size_t MidiOut::wireRoom(uint64_t now_us, bool throttle) const
 {
+    uint64_t backlog_us = wireFreeAt_us > now_us ? wireFreeAt_us - now_us : 0;
+    size_t backlog = static_cast<size_t>((backlog_us + MIDI_BYTE_TIME_US - 1) / MIDI_BYTE_TIME_US);
+    size_t limit = throttle ? config.tx_lookahead_bytes : kTxBatchSize;
+    return backlog >= limit ? 0 : limit - backlog;
+}
+
+void MidiOut::writeWire(const uint8_t *data, size_t length, uint64_t now_us)
+{
+    int res = uart.write(data, length);
+    if (res < 0)
+    {
+        MIDI_LOGE(TAG, "MIDI send failed: %d", res);
+        encoder.reset(); // the receiver may have missed a status byte
+        return;
+    }
+
+    uint64_t start_us = wireFreeAt_us > now_us ? wireFreeAt_us : now_us;
+    wireFreeAt_us = start_us + static_cast<uint64_t>(res) * MIDI_BYTE_TIME_US;
+    MIDI_TRACE(TxWrite, static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(res > 255 ? 255 : res));
+}
+
+bool MidiOut::sendSysEx(const uint8_t *data, size_t length)
+{
+    if (length < 2 || data[0] != 0xF0 || data[length - 1] != 0xF7)
+    {
+        MIDI_LOGW(TAG, "SysEx must start with 0xF0 and end with 0xF7");
+        return false;
+    }
+
     MidiTxMessage msg;
+    msg.payload = data;
+    msg.length = length;
+    msg.enqueued_us = config.latency_probes ? hal::nowUs() : 0;
+
+    sysex_lock.lock();
+    bool queued = tx_queue.send(&msg, hal::kForever);
+    if (queued)
+    {
+        wakeTx();
+        sysex_done.take(hal::kForever);
+    }
+    sysex_lock.unlock();
+
+    return queued;
+}
+
+void MidiOut::sendBytes(const uint8_t *data, size_t length)
+{
+    MidiTxMessage msg = {};
     memcpy(msg.data, data, length);
     msg.length = length;
-  
+    msg.enqueued_us = config.latency_probes ? hal::nowUs() : 0;
 
-    ESP_LOGI(TAG, "Sending: %02X %02X %02X", msg.data[0], msg.data[1], msg.data[2]);
-    // ESP_LOGI(TAG, "Sending: %s %s %s", toBinary(msg.data[0]).c_str(), toBinary(msg.data[1]).c_str(), toBinary(msg.data[2]).c_str());
-    if (xQueueSend(tx_queue, &msg, 0) != pdTRUE)
+    MIDI_TRACE(TxQueued, msg.data[0], msg.data[1], msg.data[2]);
+    if (!tx_queue.send(&msg))
     {
-        ESP_LOGW(TAG, "MIDI TX queue full — message dropped");
+        queueDropped.fetch_add(1, std::memory_order_relaxed);
+        MIDI_LOGW(TAG, "MIDI TX queue full — message dropped");
+        return;
     }
+    wakeTx();
 }
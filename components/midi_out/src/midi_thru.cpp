@@ -0,0 +1,50 @@
+#include "midi_thru.hpp"
+
+using namespace midi;
+
+MidiThru::MidiThru(MidiOut &out, const MidiThruConfig &config) : out(out), config(config) {}
+
+bool MidiThru::passes(uint8_t status) const
+{
+    switch (statusInfo(status).cls)
+    {
+    case MessageClass::ChannelVoice:
+        return config.channel_messages && (config.channel_mask & (1u << (status & 0x0F)));
+    case MessageClass::SystemCommon:
+        return config.system_common;
+    case MessageClass::RealTime:
+        return config.realtime;
+    default:
+        return false; // SysEx arrives in chunks, not as events
+    }
+}
+
+void MidiThru::feed(const MidiEvent &event)
+{
+    const uint8_t status = event.packet[1];
+    if (!passes(status))
+    {
+        filteredCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    int8_t length = statusInfo(status).length;
+    if (length <= 0)
+        return;
+
+    const MidiRouter *active = router.load(std::memory_order_acquire);
+    if (!active)
+    {
+        out.forward(&event.packet[1], static_cast<size_t>(length), event.timestamp_us);
+        return;
+    }
+
+    uint8_t routed[3];
+    size_t routedLength = active->route(&event.packet[1], static_cast<size_t>(length), routed);
+    if (routedLength == 0)
+    {
+        filteredCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    out.forward(routed, routedLength, event.timestamp_us);
+}
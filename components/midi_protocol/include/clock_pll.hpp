@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include "midi_clock.hpp"
+
+namespace midi
+{
+    // Second-order software PLL locked to incoming MIDI clock ticks.
+    //
+    // Keeps a model of the upstream clock (next tick time and period, both
+    // Q16.16 us) and pulls it towards each arriving tick with a PI loop.
+    // tickTime(k) is the smoothed time of upstream tick k, which is what a
+    // regenerated clock should follow. The time constant, in ticks, sets
+    // the loop bandwidth: longer rejects more jitter but follows tempo
+    // changes more slowly. Right after (re)acquiring the loop starts wide
+    // and narrows to the configured constant. Pure integer math.
+    class ClockPll
+    {
+    public:
+        static constexpr uint32_t kDefaultTimeConstant = 48; // Two beats
+
+        ClockPll() { setTimeConstant(kDefaultTimeConstant); }
+
+        // Loop time constant in ticks (damping 0.7). Minimum 2.
+        void setTimeConstant(uint32_t ticks)
+        {
+            timeConstant = ticks < 2 ? 2 : ticks;
+        }
+
+        uint32_t timeConstantTicks() const { return timeConstant; }
+
+        void reset()
+        {
+            received = 0;
+            acquiring = true;
+            sinceAcquire = 0;
+            lastError_us = 0;
+        }
+
+        // Feed upstream tick at `timestamp_us`. Returns the phase error of
+        // this tick against the model, in us (0 while acquiring).
+        int32_t addTick(uint64_t timestamp_us)
+        {
+            const int64_t t_q16 = static_cast<int64_t>(timestamp_us << 16);
+
+            if (received == 0)
+            {
+                lastInput_us = timestamp_us;
+                received = 1;
+                return 0;
+            }
+
+            if (acquiring)
+            {
+                acquire(timestamp_us);
+                return 0;
+            }
+
+            int64_t error = t_q16 - next_q16;
+            int64_t limit = static_cast<int64_t>(period_q16 / 2);
+            if (error > limit || error < -limit)
+            {
+                // Tempo jump, dropout or missed byte: restart from this tick
+                relocks++;
+                acquire(timestamp_us);
+                return 0;
+            }
+
+            uint32_t tau = sinceAcquire + 2 < timeConstant ? sinceAcquire + 2 : timeConstant;
+            sinceAcquire++;
+
+            // Kp = 2 * 0.7 / tau, Ki = 1 / tau^2
+            int64_t period = static_cast<int64_t>(period_q16) + error / (static_cast<int64_t>(tau) * tau);
+            if (period < 1)
+                period = 1;
+            period_q16 = static_cast<uint64_t>(period);
+            next_q16 += period + error * 14 / (10 * static_cast<int64_t>(tau));
+
+            lastInput_us = timestamp_us;
+            received++;
+            lastError_us = static_cast<int32_t>(error >> 16);
+            return lastError_us;
+        }
+
+        // Smoothed time of upstream tick `index` (0 = first tick fed)
+        uint64_t tickTime(uint64_t index) const
+        {
+            int64_t ahead = static_cast<int64_t>(index) - static_cast<int64_t>(received);
+            return static_cast<uint64_t>(next_q16 + ahead * static_cast<int64_t>(period_q16)) >> 16;
+        }
+
+        // Ticks fed so far; the next tick has this index
+        uint64_t ticksReceived() const { return received; }
+
+        bool locked() const { return !acquiring; }
+        uint64_t periodQ16() const { return period_q16; }
+        BpmQ16 bpm() const { return period_q16 ? static_cast<BpmQ16>(ClockTickScheduler::kTickNumerator / period_q16) : 0; }
+        int32_t lastErrorUs() const { return lastError_us; }
+        uint32_t relockCount() const { return relocks; }
+
+    private:
+        // Take the period from the last interval and the phase from this tick
+        void acquire(uint64_t timestamp_us)
+        {
+            uint64_t interval = timestamp_us > lastInput_us ? timestamp_us - lastInput_us : 1;
+            period_q16 = interval << 16;
+            next_q16 = static_cast<int64_t>(timestamp_us << 16) + static_cast<int64_t>(period_q16);
+            lastInput_us = timestamp_us;
+            received++;
+            acquiring = false;
+            sinceAcquire = 0;
+            lastError_us = 0;
+        }
+
+        uint32_t timeConstant = kDefaultTimeConstant;
+        uint64_t received = 0;
+        bool acquiring = true;
+        uint32_t sinceAcquire = 0;
+        uint64_t lastInput_us = 0;
+        int64_t next_q16 = 0;     // Expected time of tick `received`, Q16.16 us
+        uint64_t period_q16 = 0;  // Q16.16 us per tick
+        int32_t lastError_us = 0;
+        uint32_t relocks = 0;
+    };
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include "midi_protocol.hpp"
+
+namespace midi
+{
+    // Combines Control Change sequences into high-resolution events.
+    //
+    // 14-bit controllers: CC 0–31 carries the MSB, CC 32–63 the LSB. A
+    // controller is reported on its MSB until an LSB has been seen for it;
+    // from then on it is reported once per pair, on the LSB. A sender that
+    // only moves the MSB is still reported, just with a zero LSB.
+    //
+    // NRPN/RPN: CC 99/98 (NRPN) or 101/100 (RPN) select a parameter, CC 6
+    // and 38 enter its value and CC 96/97 step it. Data entry is reported
+    // the same way: on CC 6 until the channel has sent a CC 38, then on
+    // CC 38. RPN 127/127 (null) deselects.
+    //
+    // feed() returns the events through `sink`; pure integer state, ~700
+    // bytes, no platform dependencies. Not thread-safe.
+    class ControllerAggregator
+    {
+    public:
+        // Call sink.onHighResController(const HighResController &) or
+        // sink.onParameterChange(const ParameterChange &) when a value is
+        // complete. Returns true when `msg` was part of a 14-bit or
+        // parameter sequence.
+        template <typename Sink>
+        bool feed(const ControllerChange &msg, Sink &&sink)
+        {
+            const uint8_t ch = msg.channel & 0x0F;
+            const uint8_t cc = msg.controller;
+            const uint8_t value = msg.value & 0x7F;
+            Channel &state = channels[ch];
+
+            switch (cc)
+            {
+            case kDataEntryMsb:
+                if (!state.selected())
+                    return false;
+                state.dataMsb = value;
+                state.dataLsb = 0;
+                if (!state.dataHasLsb)
+                    sink.onParameterChange(parameter(ch, state));
+                return true;
+
+            case kDataEntryLsb:
+                if (!state.selected())
+                    return false;
+                state.dataLsb = value;
+                state.dataHasLsb = true;
+                sink.onParameterChange(parameter(ch, state));
+                return true;
+
+            case kDataIncrement:
+            case kDataDecrement:
+            {
+                if (!state.selected())
+                    return false;
+                uint16_t data = static_cast<uint16_t>((state.dataMsb << 7) | state.dataLsb);
+                if (cc == kDataIncrement && data < 0x3FFF)
+                    data++;
+                else if (cc == kDataDecrement && data > 0)
+                    data--;
+                state.dataMsb = static_cast<uint8_t>(data >> 7);
+                state.dataLsb = static_cast<uint8_t>(data & 0x7F);
+                sink.onParameterChange(parameter(ch, state));
+                return true;
+            }
+
+            case kNrpnLsb:
+            case kNrpnMsb:
+            case kRpnLsb:
+            case kRpnMsb:
+            {
+                const bool registered = cc == kRpnLsb || cc == kRpnMsb;
+                if (registered != state.registered)
+                {
+                    // Switching between NRPN and RPN starts a fresh selection
+                    state.registered = registered;
+                    state.paramMsb = state.paramLsb = kUnset;
+                }
+                if (cc == kNrpnMsb || cc == kRpnMsb)
+                    state.paramMsb = value;
+                else
+                    state.paramLsb = value;
+                if (registered && state.paramMsb == 0x7F && state.paramLsb == 0x7F)
+                    state.paramMsb = state.paramLsb = kUnset; // RPN null
+                state.dataMsb = state.dataLsb = 0;
+                return true;
+            }
+
+            default:
+                break;
+            }
+
+            if (cc < 32)
+            {
+                state.msb[cc] = value;
+                if (!(state.hasLsb & (1u << cc)))
+                    sink.onHighResController(HighResController{ch, cc, static_cast<uint16_t>(value << 7)});
+                return true;
+            }
+            if (cc < 64)
+            {
+                const uint8_t msbController = cc - 32;
+                state.hasLsb |= 1u << msbController;
+                sink.onHighResController(HighResController{ch, msbController, static_cast<uint16_t>((state.msb[msbController] << 7) | value)});
+                return true;
+            }
+            return false;
+        }
+
+        // Forget all selections and learned LSB use, e.g. after a reset
+        void reset()
+        {
+            for (auto &state : channels)
+                state = Channel{};
+        }
+
+    private:
+        static constexpr uint8_t kDataEntryMsb = 6;
+        static constexpr uint8_t kDataEntryLsb = 38;
+        static constexpr uint8_t kDataIncrement = 96;
+        static constexpr uint8_t kDataDecrement = 97;
+        static constexpr uint8_t kNrpnLsb = 98;
+        static constexpr uint8_t kNrpnMsb = 99;
+        static constexpr uint8_t kRpnLsb = 100;
+        static constexpr uint8_t kRpnMsb = 101;
+        static constexpr uint8_t kUnset = 0xFF;
+
+        struct Channel
+        {
+            uint8_t msb[32] = {};  // Last MSB of CC 0–31
+            uint32_t hasLsb = 0;   // Bit n: CC n has been followed by an LSB
+            uint8_t paramMsb = kUnset;
+            uint8_t paramLsb = kUnset;
+            uint8_t dataMsb = 0;
+            uint8_t dataLsb = 0;
+            bool registered = false;
+            bool dataHasLsb = false; // The channel sends CC 38
+
+            bool selected() const { return paramMsb != kUnset && paramLsb != kUnset; }
+        };
+
+        static ParameterChange parameter(uint8_t ch, const Channel &state)
+        {
+            return ParameterChange{ch, state.registered,
+                                   static_cast<uint16_t>((state.paramMsb << 7) | state.paramLsb),
+                                   static_cast<uint16_t>((state.dataMsb << 7) | state.dataLsb)};
+        }
+
+        Channel channels[16];
+    };
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace midi
+{
+    // Last-value-wins store for continuous controllers.
+    //
+    // One slot per (channel, controller), per channel pitch bend and per
+    // channel pressure. Setting a slot that has not gone out yet replaces
+    // its value instead of queueing another message, so a knob sweep that
+    // outruns the wire costs no memory and the last value always arrives.
+    // pop() hands out pending slots round-robin from where the previous
+    // pop stopped, so one busy controller cannot starve the others.
+    //
+    // An LSB (CC 32–63) shares its MSB's slot, so a 14-bit pair leaves MSB
+    // first and back to back. A new MSB drops an LSB still waiting for the
+    // old one.
+    //
+    // Lock-free with one consumer: set() from any task, pop() from the TX
+    // task only. A set() racing a pop() of the same slot may send the new
+    // value twice, never an old value last.
+    class ControllerCoalescer
+    {
+    public:
+        // Whether a CC may be coalesced: only those that carry a position.
+        // Switches (64–69), Portamento Control (84) and the High Resolution
+        // Velocity Prefix (88) act on the notes around them; bank select,
+        // data entry and parameter select only mean something in sequence;
+        // channel mode messages are commands. Those keep their order in the
+        // FIFO. An LSB goes with its MSB.
+        static constexpr bool coalesces(uint8_t controller)
+        {
+            if (controller >= 32 && controller < 64)
+                controller -= 32;
+            return controller != 0 && controller != 6 &&
+                   !(controller >= 64 && controller <= 69) &&
+                   controller != 84 && controller != 88 &&
+                   !(controller >= 96 && controller <= 101) &&
+                   controller < 120;
+        }
+
+        void setControllerChange(uint8_t channel, uint8_t controller, uint8_t value)
+        {
+            controller &= 0x7F;
+            value &= 0x7F;
+            const size_t base = (channel & 0x0F) * 128;
+            if (controller >= 64)
+            {
+                set(base + controller, value);
+                return;
+            }
+
+            // MSB: replaces the pair. LSB: joins a waiting MSB, or goes alone.
+            const size_t slot = base + (controller & 31);
+            uint16_t current = values[slot].load(std::memory_order_relaxed);
+            uint16_t next;
+            do
+            {
+                if (controller < 32)
+                    next = static_cast<uint16_t>(kMsb | value << 7);
+                else
+                    next = static_cast<uint16_t>((current & kMsb ? current & (kMsb | 0x3F80) : 0) | kLsb | value);
+            } while (!values[slot].compare_exchange_weak(current, next, std::memory_order_relaxed));
+            markPending(slot, current & (controller < 32 ? kMsb | kLsb : kLsb));
+        }
+
+        void setPitchBend(uint8_t channel, uint16_t value)
+        {
+            set(kPitchBendSlot + (channel & 0x0F), value & 0x3FFF);
+        }
+
+        void setChannelPressure(uint8_t channel, uint8_t pressure)
+        {
+            set(kPressureSlot + (channel & 0x0F), pressure & 0x7F);
+        }
+
+        // Take the next pending value as a MIDI message (status first) in
+        // `out`, which must have room for 3 bytes. Returns its length, 0
+        // when nothing is pending.
+        size_t pop(uint8_t *out)
+        {
+            size_t slot;
+            uint16_t value;
+            do
+            {
+                if (!takeNext(slot))
+                    return 0;
+                value = values[slot].load(std::memory_order_relaxed);
+            } while (isPair(slot) && !takePairHalf(slot, value, out));
+
+            if (slot < kPitchBendSlot)
+            {
+                if (isPair(slot))
+                    return 3;
+                out[0] = static_cast<uint8_t>(0xB0 | (slot >> 7));
+                out[1] = static_cast<uint8_t>(slot & 0x7F);
+                out[2] = static_cast<uint8_t>(value);
+                return 3;
+            }
+            if (slot < kPressureSlot)
+            {
+                out[0] = static_cast<uint8_t>(0xE0 | (slot - kPitchBendSlot));
+                out[1] = static_cast<uint8_t>(value & 0x7F);
+                out[2] = static_cast<uint8_t>(value >> 7);
+                return 3;
+            }
+            out[0] = static_cast<uint8_t>(0xD0 | (slot - kPressureSlot));
+            out[1] = static_cast<uint8_t>(value);
+            return 2;
+        }
+
+        bool empty() const
+        {
+            for (const auto &word : pending)
+            {
+                if (word.load(std::memory_order_relaxed))
+                    return false;
+            }
+            return true;
+        }
+
+        // Values overwritten before they went out
+        uint32_t replaced() const { return replacedCount.load(std::memory_order_relaxed); }
+
+    private:
+        static constexpr size_t kPitchBendSlot = 16 * 128;
+        static constexpr size_t kPressureSlot = kPitchBendSlot + 16;
+        static constexpr size_t kSlots = kPressureSlot + 16;
+        static constexpr size_t kWords = (kSlots + 31) / 32;
+
+        // In the slots of CC 0–31 the value itself says which half of the
+        // pair waits; pop() clears what it takes, so a pending bit with
+        // neither flag is stale
+        static constexpr uint16_t kMsb = 0x4000; // MSB in bits 7–13
+        static constexpr uint16_t kLsb = 0x8000; // LSB in bits 0–6
+
+        static bool isPair(size_t slot) { return slot < kPitchBendSlot && (slot & 0x7F) < 32; }
+
+        void set(size_t slot, uint16_t value)
+        {
+            values[slot].store(value, std::memory_order_relaxed);
+            markPending(slot, true);
+        }
+
+        // `replacing`: a value still pending in the slot was overwritten
+        void markPending(size_t slot, bool replacing)
+        {
+            uint32_t bit = 1u << (slot & 31);
+            if ((pending[slot >> 5].fetch_or(bit, std::memory_order_release) & bit) && replacing)
+                replacedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Takes the waiting MSB, or else the waiting LSB, of a pair slot as a
+        // CC in `out`. An LSB left behind stays pending and is popped next.
+        // False when nothing waits (stale pending bit).
+        bool takePairHalf(size_t slot, uint16_t value, uint8_t *out)
+        {
+            uint16_t rest;
+            do
+            {
+                if (!(value & (kMsb | kLsb)))
+                    return false;
+                rest = value & kMsb ? value & (kLsb | 0x7F) : 0;
+            } while (!values[slot].compare_exchange_weak(value, rest, std::memory_order_relaxed));
+
+            const uint8_t controller = slot & 0x7F;
+            out[0] = static_cast<uint8_t>(0xB0 | (slot >> 7));
+            out[1] = value & kMsb ? controller : static_cast<uint8_t>(controller + 32);
+            out[2] = static_cast<uint8_t>(value & kMsb ? (value >> 7) & 0x7F : value & 0x7F);
+            if (rest & kLsb)
+            {
+                markPending(slot, false);
+                cursor = slot;
+            }
+            return true;
+        }
+
+        // Clears and returns the first pending slot at or after the cursor,
+        // wrapping around once
+        bool takeNext(size_t &slot)
+        {
+            size_t word = cursor >> 5;
+            uint32_t mask = ~0u << (cursor & 31); // bits at or after the cursor
+            for (size_t step = 0; step <= kWords; ++step)
+            {
+                uint32_t bits = pending[word].load(std::memory_order_acquire) & mask;
+                while (bits)
+                {
+                    uint32_t bit = bits & (~bits + 1);
+                    if (pending[word].fetch_and(~bit, std::memory_order_acquire) & bit)
+                    {
+                        slot = (word << 5) | static_cast<size_t>(__builtin_ctz(bit));
+                        cursor = slot + 1 < kSlots ? slot + 1 : 0;
+                        return true;
+                    }
+                    bits &= ~bit;
+                }
+                mask = ~0u;
+                word = word + 1 < kWords ? word + 1 : 0;
+            }
+            return false;
+        }
+
+        std::atomic<uint16_t> values[kSlots] = {};
+        std::atomic<uint32_t> pending[kWords] = {};
+        std::atomic<uint32_t> replacedCount{0};
+        size_t cursor = 0; // Consumer only
+    };
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace midi
+{
+    // Durations in microseconds, counted in fixed log2 buckets.
+    //
+    // Bucket 0 holds 0 us, bucket i (1 <= i < kBuckets - 1) holds
+    // [2^(i-1), 2^i) us, and the last bucket everything from 2^22 us (~4 s)
+    // up. record() belongs to one task; trySnapshot() may be called from
+    // any other and never blocks it. The writer bumps a sequence number
+    // around each update and a reader that saw it change reads again, so a
+    // snapshot is always consistent and the 64-bit total needs no 64-bit
+    // atomics (which the ESP32 only has through a lock).
+    class LatencyHistogram
+    {
+    public:
+        static constexpr size_t kBuckets = 24;
+
+        struct Snapshot
+        {
+            uint32_t buckets[kBuckets] = {};
+            uint32_t count = 0;
+            uint32_t max_us = 0;
+            uint64_t total_us = 0;
+
+            uint32_t averageUs() const { return count ? static_cast<uint32_t>(total_us / count) : 0; }
+
+            // Upper bound of the bucket holding the p-th percentile (0-100),
+            // capped at the maximum; 0 when nothing was recorded
+            uint32_t percentileUs(uint8_t p) const
+            {
+                uint64_t rank = (static_cast<uint64_t>(count) * p + 99) / 100;
+                uint64_t seen = 0;
+                for (size_t i = 0; i < kBuckets; ++i)
+                {
+                    seen += buckets[i];
+                    if (seen >= rank && seen > 0)
+                        return upperBoundUs(i) < max_us && i < kBuckets - 1 ? upperBoundUs(i) : max_us;
+                }
+                return 0;
+            }
+        };
+
+        // Largest value counted in bucket `index`
+        static constexpr uint32_t upperBoundUs(size_t index)
+        {
+            return index == 0 ? 0 : (1u << index) - 1;
+        }
+
+        static constexpr size_t bucketFor(uint32_t us)
+        {
+            size_t index = us == 0 ? 0 : 32 - static_cast<size_t>(__builtin_clz(us));
+            return index < kBuckets ? index : kBuckets - 1;
+        }
+
+        // Writer side only
+        void record(uint64_t us)
+        {
+            uint32_t value = us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(us);
+            uint32_t seq = sequence.load(std::memory_order_relaxed);
+            sequence.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            size_t bucket = bucketFor(value);
+            buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            uint32_t low = totalLow.load(std::memory_order_relaxed);
+            if (low + value < low)
+                totalHigh.store(totalHigh.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            totalLow.store(low + value, std::memory_order_relaxed);
+            if (value > max.load(std::memory_order_relaxed))
+                max.store(value, std::memory_order_relaxed);
+
+            sequence.store(seq + 2, std::memory_order_release);
+        }
+
+        // One attempt at a consistent copy; false when record() was caught
+        // mid-update. Don't spin on it: a reader that preempted the writer on
+        // the same core would wait forever, so block briefly and try again.
+        bool trySnapshot(Snapshot &out) const
+        {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1)
+                return false;
+
+            for (size_t i = 0; i < kBuckets; ++i)
+                out.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            out.count = count.load(std::memory_order_relaxed);
+            out.max_us = max.load(std::memory_order_relaxed);
+            out.total_us = static_cast<uint64_t>(totalHigh.load(std::memory_order_relaxed)) << 32 |
+                           totalLow.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return sequence.load(std::memory_order_relaxed) == before;
+        }
+
+        // Retries trySnapshot(), calling `backoff()` (e.g. a 1 ms sleep)
+        // between attempts
+        template <typename Backoff>
+        Snapshot snapshot(Backoff &&backoff) const
+        {
+            Snapshot out;
+            while (!trySnapshot(out))
+                backoff();
+            return out;
+        }
+
+    private:
+        std::atomic<uint32_t> sequence{0}; // Odd while record() is updating
+        std::atomic<uint32_t> buckets[kBuckets] = {};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> max{0};
+        std::atomic<uint32_t> totalLow{0};
+        std::atomic<uint32_t> totalHigh{0};
+    };
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+
+#define MIDI_CLOCKS_PER_BEAT 24
+
+namespace midi
+{
+    // Tempo in beats per minute as unsigned Q16.16 fixed point
+    using BpmQ16 = uint32_t;
+
+    constexpr BpmQ16 bpmToQ16(float bpm)
+    {
+        return static_cast<BpmQ16>(bpm * 65536.0f + 0.5f);
+    }
+
+    constexpr float bpmFromQ16(BpmQ16 bpm)
+    {
+        return static_cast<float>(bpm) / 65536.0f;
+    }
+
+    // Tick timing for a MIDI clock master.
+    //
+    // Tick times are kept in Q16.16 microseconds, and the remainder of each
+    // interval division is carried Bresenham-style. At a constant tempo the
+    // schedule is exact: tick k lands at origin + k * 60e6 / (24 * bpm) with no
+    // accumulated rounding, however long it runs. Pure integer math, no
+    // platform dependencies.
+    class ClockTickScheduler
+    {
+    public:
+        // Beat length in Q16.16 microseconds, over 24 ticks
+        static constexpr uint64_t kTickNumerator = 60000000ULL * 65536ULL * 65536ULL / MIDI_CLOCKS_PER_BEAT;
+
+        // First tick at `first_tick_us`
+        void reset(uint64_t first_tick_us, BpmQ16 bpm)
+        {
+            next_q16 = first_tick_us << 16;
+            ticks = 0;
+            rampTicksLeft = 0;
+            setInterval(bpm);
+        }
+
+        // Change tempo from the next interval on. Cancels a ramp.
+        void setBpm(BpmQ16 bpm)
+        {
+            rampTicksLeft = 0;
+            setInterval(bpm);
+        }
+
+        // Move linearly to `target` over `over_ticks` ticks (one tempo step per tick)
+        void rampTo(BpmQ16 target, uint32_t over_ticks)
+        {
+            if (over_ticks == 0)
+            {
+                setBpm(target);
+                return;
+            }
+            rampStart = currentBpm;
+            rampTarget = target;
+            rampTicks = over_ticks;
+            rampTicksLeft = over_ticks;
+        }
+
+        // Time of the next tick, in microseconds
+        uint64_t nextTick() const { return next_q16 >> 16; }
+
+        // Consume the next tick and schedule the one after. Returns the
+        // consumed tick's time.
+        uint64_t advance()
+        {
+            uint64_t tick_us = nextTick();
+
+            if (rampTicksLeft > 0)
+            {
+                rampTicksLeft--;
+                uint32_t done = rampTicks - rampTicksLeft;
+                int64_t span = static_cast<int64_t>(rampTarget) - static_cast<int64_t>(rampStart);
+                setInterval(static_cast<BpmQ16>(rampStart + span * done / rampTicks));
+            }
+
+            next_q16 += intervalWhole;
+            remainder += intervalRemainder;
+            if (remainder >= divisor)
+            {
+                remainder -= divisor;
+                next_q16++;
+            }
+            ticks++;
+            return tick_us;
+        }
+
+        BpmQ16 bpm() const { return currentBpm; }
+        uint64_t tickCount() const { return ticks; }
+        bool ramping() const { return rampTicksLeft > 0; }
+
+    private:
+        void setInterval(BpmQ16 bpm)
+        {
+            if (bpm == 0)
+                bpm = 1;
+            currentBpm = bpm;
+            divisor = bpm;
+            intervalWhole = kTickNumerator / divisor;
+            intervalRemainder = kTickNumerator % divisor;
+            remainder = 0; // at most 1/65536 us lost per tempo change
+        }
+
+        uint64_t next_q16 = 0; // Next tick, Q16.16 microseconds
+        uint64_t ticks = 0;
+        BpmQ16 currentBpm = 0;
+        uint64_t divisor = 1;
+        uint64_t intervalWhole = 0;     // Q16.16 microseconds per tick
+        uint64_t intervalRemainder = 0; // ... plus intervalRemainder / divisor
+        uint64_t remainder = 0;
+
+        BpmQ16 rampStart = 0;
+        BpmQ16 rampTarget = 0;
+        uint32_t rampTicks = 0;
+        uint32_t rampTicksLeft = 0;
+    };
+}
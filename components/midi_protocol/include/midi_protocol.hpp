@@ -1,11 +1,23 @@
 #pragma once
+#include <array>
 #include <cstdint>
 #include <string.h>
 #include <string>
 #define MIDI_BAUD_RATE 31250
+#define MIDI_BYTE_TIME_US (10 * 1000000 / MIDI_BAUD_RATE) // 8N1 frame, 320 us
 
 namespace midi
 {
+    // USB MIDI style packet: [cable/CIN, status, data1, data2]
+    using Packet4 = std::array<uint8_t, 4>;
+
+    // A received message together with the time its first byte arrived
+    struct MidiEvent
+    {
+        Packet4 packet;
+        uint64_t timestamp_us;
+    };
+
     struct ControllerChange
     {
         uint8_t channel;    // MIDI channel (0–15)
@@ -34,6 +46,48 @@ namespace midi
         uint8_t velocity; // Velocity or release velocity
     };
 
+    struct PolyAftertouch
+    {
+        uint8_t channel;  // MIDI channel (0–15)
+        uint8_t note;     // MIDI note number (0–127)
+        uint8_t pressure; // Pressure (0–127)
+    };
+
+    struct ProgramChange
+    {
+        uint8_t channel; // MIDI channel (0–15)
+        uint8_t program; // Program number (0–127)
+    };
+
+    struct ChannelPressure
+    {
+        uint8_t channel;  // MIDI channel (0–15)
+        uint8_t pressure; // Pressure (0–127)
+    };
+
+    struct PitchBend
+    {
+        uint8_t channel; // MIDI channel (0–15)
+        uint16_t value;  // 0–16383, 8192 = centre
+    };
+
+    // A 14-bit controller: MSB on CC 0–31, LSB on CC 32–63
+    struct HighResController
+    {
+        uint8_t channel;    // MIDI channel (0–15)
+        uint8_t controller; // MSB controller number (0–31)
+        uint16_t value;     // 0–16383
+    };
+
+    // An NRPN or RPN value, assembled from its parameter select and data entry CCs
+    struct ParameterChange
+    {
+        uint8_t channel;    // MIDI channel (0–15)
+        bool registered;    // true = RPN (CC 101/100), false = NRPN (CC 99/98)
+        uint16_t parameter; // 0–16383
+        uint16_t value;     // 0–16383; data LSB is 0 when the sender only sends the MSB
+    };
+
     struct SongPosition
     {
         uint16_t position; // Position in MIDI beats (16th notes)
@@ -65,53 +119,91 @@ namespace midi
         Unknown = 0x00
     };
 
-    inline const char *to_string(MidiMessageType type)
+    // Broad class of a status byte
+    enum class MessageClass : uint8_t
+    {
+        Data,            // 0x00–0x7F, not a status byte
+        ChannelVoice,    // 0x80–0xEF
+        SystemExclusive, // 0xF0
+        SystemCommon,    // 0xF1–0xF7
+        RealTime,        // 0xF8–0xFF
+        Undefined        // 0xF4, 0xF5, 0xF9, 0xFD
+    };
+
+    // Everything needed to classify a status byte, without branching
+    struct StatusInfo
     {
-        switch (type)
+        MidiMessageType type; // Message type (channel stripped for voice messages)
+        int8_t length;        // Bytes including status; -1 = variable (SysEx), 1 for data/undefined
+        MessageClass cls;
+        const char *name;
+    };
+
+    namespace detail
+    {
+        constexpr StatusInfo makeStatusInfo(unsigned status)
+        {
+            using T = MidiMessageType;
+            using C = MessageClass;
+
+            if (status < 0x80)
+                return {T::Unknown, 1, C::Data, "Unknown"};
+
+            if (status < 0xF0)
+            {
+                switch (status & 0xF0)
+                {
+                case 0x80: return {T::NoteOff, 3, C::ChannelVoice, "Note Off"};
+                case 0x90: return {T::NoteOn, 3, C::ChannelVoice, "Note On"};
+                case 0xA0: return {T::PolyAftertouch, 3, C::ChannelVoice, "Poly Aftertouch"};
+                case 0xB0: return {T::ControlChange, 3, C::ChannelVoice, "Control Change"};
+                case 0xC0: return {T::ProgramChange, 2, C::ChannelVoice, "Program Change"};
+                case 0xD0: return {T::ChannelPressure, 2, C::ChannelVoice, "Channel Pressure"};
+                default: return {T::PitchBend, 3, C::ChannelVoice, "Pitch Bend"};
+                }
+            }
+
+            const T type = static_cast<T>(status);
+            switch (status)
+            {
+            case 0xF0: return {type, -1, C::SystemExclusive, "System Exclusive"};
+            case 0xF1: return {type, 2, C::SystemCommon, "Time Code Quarter"};
+            case 0xF2: return {type, 3, C::SystemCommon, "Song Position"};
+            case 0xF3: return {type, 2, C::SystemCommon, "Song Select"};
+            case 0xF6: return {type, 1, C::SystemCommon, "Tune Request"};
+            case 0xF7: return {type, 1, C::SystemCommon, "End of SysEx"};
+            case 0xF8: return {type, 1, C::RealTime, "Timing Clock"};
+            case 0xFA: return {type, 1, C::RealTime, "Start"};
+            case 0xFB: return {type, 1, C::RealTime, "Continue"};
+            case 0xFC: return {type, 1, C::RealTime, "Stop"};
+            case 0xFE: return {type, 1, C::RealTime, "Active Sensing"};
+            case 0xFF: return {type, 1, C::RealTime, "System Reset"};
+            default: return {type, 1, C::Undefined, "Unknown"};
+            }
+        }
+
+        constexpr std::array<StatusInfo, 256> makeStatusTable()
         {
-        case MidiMessageType::NoteOff:
-            return "Note Off";
-        case MidiMessageType::NoteOn:
-            return "Note On";
-        case MidiMessageType::PolyAftertouch:
-            return "Poly Aftertouch";
-        case MidiMessageType::ControlChange:
-            return "Control Change";
-        case MidiMessageType::ProgramChange:
-            return "Program Change";
-        case MidiMessageType::ChannelPressure:
-            return "Channel Pressure";
-        case MidiMessageType::PitchBend:
-            return "Pitch Bend";
-        case MidiMessageType::SystemExclusive:
-            return "System Exclusive";
-        case MidiMessageType::TimeCodeQuarter:
-            return "Time Code Quarter";
-        case MidiMessageType::SongPosition:
-            return "Song Position";
-        case MidiMessageType::SongSelect:
-            return "Song Select";
-        case MidiMessageType::TuneRequest:
-            return "Tune Request";
-        case MidiMessageType::EndOfExclusive:
-            return "End of SysEx";
-        case MidiMessageType::TimingClock:
-            return "Timing Clock";
-        case MidiMessageType::Start:
-            return "Start";
-        case MidiMessageType::Continue:
-            return "Continue";
-        case MidiMessageType::Stop:
-            return "Stop";
-        case MidiMessageType::ActiveSensing:
-            return "Active Sensing";
-        case MidiMessageType::SystemReset:
-            return "System Reset";
-        default:
-            return "Unknown";
+            std::array<StatusInfo, 256> table{};
+            for (unsigned i = 0; i < 256; ++i)
+                table[i] = makeStatusInfo(i);
+            return table;
         }
     }
 
+    // Indexed by status byte, built at compile time
+    inline constexpr std::array<StatusInfo, 256> kStatusTable = detail::makeStatusTable();
+
+    constexpr const StatusInfo &statusInfo(uint8_t statusByte)
+    {
+        return kStatusTable[statusByte];
+    }
+
+    constexpr const char *to_string(MidiMessageType type)
+    {
+        return kStatusTable[static_cast<uint8_t>(type)].name;
+    }
+
     inline std::string toBinary(uint8_t byte)
     {
         char buf[9];
@@ -121,64 +213,13 @@ namespace midi
         return std::string(buf);
     }
 
-    inline int getMidiMessageSize(MidiMessageType type)
+    constexpr int getMidiMessageSize(MidiMessageType type)
     {
-        using T = MidiMessageType;
-        switch (type)
-        {
-        // 3-byte channel voice messages
-        case T::NoteOff:
-        case T::NoteOn:
-        case T::PolyAftertouch:
-        case T::ControlChange:
-        case T::PitchBend:
-            return 3;
-
-        // 2-byte channel voice messages
-        case T::ProgramChange:
-        case T::ChannelPressure:
-            return 2;
-
-        // System Common
-        case T::SongPosition:
-            return 3;
-        case T::TimeCodeQuarter:
-        case T::SongSelect:
-            return 2;
-        case T::TuneRequest:
-        case T::EndOfExclusive:
-            return 1;
-
-        // System Real-Time (always 1 byte)
-        case T::TimingClock:
-        case T::Start:
-        case T::Continue:
-        case T::Stop:
-        case T::ActiveSensing:
-        case T::SystemReset:
-            return 1;
-
-        // System Exclusive (variable length)
-        case T::SystemExclusive:
-            return -1;
-
-        case T::Unknown:
-        default:
-            return 1; // Safe fallback
-        }
+        return kStatusTable[static_cast<uint8_t>(type)].length;
     }
 
-    inline MidiMessageType getMessageType(uint8_t statusByte)
+    constexpr MidiMessageType getMessageType(uint8_t statusByte)
     {
-        using T = MidiMessageType;
-
-        if (statusByte >= 0xF8)
-            return static_cast<T>(statusByte); // Real-time messages (single-byte)
-        if (statusByte >= 0xF0 && statusByte <= 0xF7)
-            return static_cast<T>(statusByte); // System Common messages
-        if ((statusByte & 0x80) == 0)
-            return T::Unknown; // Not a status byte (data byte)
-
-        return static_cast<T>(statusByte & 0xF0); // Channel Voice messages (high nibble identifies type)
+        return kStatusTable[statusByte].type;
     }
 }
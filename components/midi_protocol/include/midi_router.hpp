@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace midi
+{
+    // Remaps one controller number, or drops it. Applies to one channel or
+    // to all of them (channel = kAllChannels).
+    struct MidiCcRule
+    {
+        static constexpr uint8_t kAllChannels = 0xFF;
+        static constexpr uint8_t kDrop = 0xFF;
+
+        uint8_t channel = kAllChannels; // Input channel 0–15
+        uint8_t from;                   // Input controller number
+        uint8_t to;                     // Output controller number, or kDrop
+        const uint8_t *curve = nullptr; // 128-entry value table, nullptr = unchanged
+    };
+
+    // Human-editable routing rules, turned into lookup tables by
+    // MidiRouter::compile(). Channels are 0–15.
+    struct MidiRouteConfig
+    {
+        uint16_t channels = 0xFFFF;   // Bit n passes input channel n
+        uint8_t channel_map[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+        uint8_t voice_types = 0x7F;   // Bit n passes status 0x80 + 16n (Note Off … Pitch Bend)
+        bool system_common = true;
+        bool realtime = true;
+        const uint8_t *velocity_curve = nullptr; // 128-entry Note On velocity table
+        const MidiCcRule *cc_rules = nullptr;    // Later rules win
+        size_t cc_rule_count = 0;
+    };
+
+    // Channel remap, filtering, CC remap and value curves in one table pass.
+    //
+    // compile() flattens a MidiRouteConfig into a 256-entry status map (filter
+    // and channel remap in one lookup) and per-status data-byte rows of
+    // {number, curve} pairs: an identity row for most messages, the note row
+    // (velocity curve) for Note On, and one row per channel for CCs. route()
+    // is then three table lookups and no per-rule branching. No allocation;
+    // about 6 KB of tables.
+    //
+    // Not safe to compile() while another task routes through the same
+    // object: compile a second router and swap pointers instead.
+    class MidiRouter
+    {
+    public:
+        static constexpr size_t kMaxCurves = 8; // Including the identity curve
+
+        MidiRouter();
+
+        // Returns false when the config uses more than kMaxCurves - 1
+        // distinct curves; the router is left passing everything unchanged.
+        bool compile(const MidiRouteConfig &config);
+
+        // Transform one complete message (status first, 1–3 bytes). Returns
+        // the output length, or 0 when the message is dropped. `out` may be
+        // `in`.
+        size_t route(const uint8_t *in, size_t length, uint8_t *out) const
+        {
+            const uint8_t status = statusMap[in[0]];
+            if (status == 0)
+                return 0;
+
+            if (length < 3)
+            {
+                out[0] = status;
+                if (length == 2)
+                    out[1] = in[1];
+                return length;
+            }
+
+            const DataRoute route = dataRows[in[0]][in[1]];
+            if (route.number & 0x80)
+                return 0; // controller dropped
+
+            out[0] = status;
+            out[1] = route.number;
+            out[2] = curves[route.curve][in[2]];
+            return 3;
+        }
+
+        // Fill `curve` with a straight line from `min` (input 1) to `max`
+        // (input 127); 0 stays 0. Handy for velocity ranges.
+        static void scaleCurve(uint8_t curve[128], uint8_t min, uint8_t max);
+
+    private:
+        struct DataRoute
+        {
+            uint8_t number; // Output data byte 1; bit 7 set drops the message
+            uint8_t curve;  // Index into curves for data byte 2
+        };
+
+        void reset();
+        int curveSlot(const uint8_t *table, bool velocity);
+
+        uint8_t statusMap[256];           // Output status, 0 = drop
+        const DataRoute *dataRows[256];   // Row used for each input status
+        DataRoute identityRow[128];
+        DataRoute noteOnRow[128];
+        DataRoute ccRows[16][128];
+        uint8_t curves[kMaxCurves][128];  // curves[0] is the identity
+        const uint8_t *curveSources[kMaxCurves];
+        size_t curveCount = 1;
+    };
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace midi
+{
+    // Running-status encoder for an outgoing MIDI 1.0 byte stream.
+    //
+    // Omits the status byte of a channel voice message when it repeats the
+    // previous one, and resends it at least every `refresh_us` so a receiver
+    // that joins late (or missed a byte) re-syncs. Real-time bytes pass
+    // through without touching the running status; System Common and SysEx
+    // cancel it, as the spec requires.
+    class RunningStatusEncoder
+    {
+    public:
+        void configure(bool enabled, uint32_t refresh_us, bool note_off_as_note_on)
+        {
+            this->enabled = enabled;
+            this->refresh_us = refresh_us;
+            this->noteOffAsNoteOn = note_off_as_note_on;
+            reset();
+        }
+
+        // Encode one complete message (status first, 1–3 bytes) into `out`,
+        // which must have room for 3 bytes. Returns the bytes written.
+        size_t encode(const uint8_t *msg, size_t length, uint64_t now_us, uint8_t *out)
+        {
+            uint8_t status = msg[0];
+
+            if (status >= 0xF8)
+            {
+                out[0] = status;
+                return 1;
+            }
+
+            if (status >= 0xF0)
+            {
+                lastStatus = 0;
+                for (size_t i = 0; i < length; ++i)
+                    out[i] = msg[i];
+                return length;
+            }
+
+            uint8_t data2 = length > 2 ? msg[2] : 0;
+            if (noteOffAsNoteOn && (status & 0xF0) == 0x80)
+            {
+                // Note On with velocity 0 shares the status of the Note Ons around it
+                status = 0x90 | (status & 0x0F);
+                data2 = 0;
+            }
+
+            size_t written = 0;
+            bool reuse = enabled && status == lastStatus && now_us - lastStatusSent_us < refresh_us;
+            if (!reuse)
+            {
+                out[written++] = status;
+                lastStatus = status;
+                lastStatusSent_us = now_us;
+            }
+
+            out[written++] = msg[1];
+            if (length > 2)
+                out[written++] = data2;
+            return written;
+        }
+
+        // Forget the running status, e.g. after bytes went out another way
+        void reset() { lastStatus = 0; }
+
+    private:
+        bool enabled = true;
+        bool noteOffAsNoteOn = false;
+        uint32_t refresh_us = 500000;
+        uint8_t lastStatus = 0;
+        uint64_t lastStatusSent_us = 0;
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "midi_protocol.hpp"
+#include "midi_sysex.hpp"
+#include "usb_midi.hpp"
+
+namespace midi
+{
+    // Byte-level MIDI 1.0 stream parser.
+    //
+    // Keeps its state between calls, so a message split across several UART
+    // reads is still assembled. Handles running status and System Real-Time
+    // bytes interleaved inside other messages. No allocation, no platform
+    // dependencies: safe to build and run on a host.
+    class MidiStreamParser
+    {
+    public:
+        MidiStreamParser() = default;
+
+        // Feed one byte from the wire together with its arrival time.
+        // Returns true when `out` holds a complete message as a USB MIDI
+        // packet [cable/CIN, status, data1, data2], stamped with the arrival
+        // time of its first byte.
+        bool feed(uint8_t byte, uint64_t timestamp_us, MidiEvent &out);
+
+        // Feed a span of bytes whose last byte arrived at `last_timestamp_us`,
+        // calling `sink(const MidiEvent &)` for every complete message.
+        // Earlier bytes are stamped one wire byte time apart. Inlined so the
+        // per-byte path has no indirect call.
+        template <typename Sink>
+        void feed(const uint8_t *bytes, size_t length, uint64_t last_timestamp_us, Sink &&sink)
+        {
+            MidiEvent out;
+            uint64_t timestamp_us = last_timestamp_us - static_cast<uint64_t>(length - 1) * MIDI_BYTE_TIME_US;
+            for (size_t i = 0; i < length; ++i, timestamp_us += MIDI_BYTE_TIME_US)
+            {
+                if (feed(bytes[i], timestamp_us, out))
+                    sink(out);
+            }
+        }
+
+        // Drop any partially assembled message and the running status.
+        void reset();
+
+        // Cable number (0–15) stamped into every packet; 0 by default
+        void setCable(uint8_t cable) { cableBits = static_cast<uint8_t>((cable & 0x0F) << 4); }
+
+        // Deliver SysEx payload to `callback` in chunks taken from `pool`.
+        // Without a pool and callback SysEx is skipped.
+        void setSysExHandler(SysExChunkPool *pool, SysExCallback callback);
+
+        // SysEx messages cut short because the pool ran dry. One that had
+        // started still ends with a SysExEnd | SysExAborted chunk.
+        uint32_t sysExDropped() const { return sysexDropped; }
+
+        // Malformed input: data bytes with no status to attach to, messages
+        // cut short by a status byte (SysEx included), undefined status
+        // bytes and stray EOX
+        uint32_t parseErrors() const { return errors; }
+
+    private:
+        bool startMessage(uint8_t statusByte, uint64_t timestamp_us, MidiEvent &out);
+        void beginSysEx(uint64_t timestamp_us);
+        void appendSysEx(uint8_t byte);
+        void endSysEx(uint8_t flags);
+        void flushSysEx();
+
+        uint8_t status = 0;       // Status of the message being assembled (0 = none)
+        uint8_t data[2] = {0, 0}; // Data bytes collected so far
+        uint8_t dataIndex = 0;    // Number of data bytes collected
+        uint8_t dataLength = 0;   // Data bytes expected for `status`
+        bool inSysEx = false;     // Between 0xF0 and its terminator
+        bool statusConsumed = false; // Next data byte starts a running-status message
+        uint8_t cableBits = 0;    // Cable number, already in the high nibble
+        uint64_t messageTimestamp = 0; // Arrival of the first byte of the current message
+
+        SysExChunkPool *sysexPool = nullptr;
+        SysExCallback sysexCallback;
+        SysExChunk *sysexChunk = nullptr; // Chunk being filled, nullptr when skipping
+        uint32_t sysexDropped = 0;
+        uint32_t errors = 0;
+    };
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace midi
+{
+    // Flags describing where a chunk sits inside one SysEx message
+    enum SysExFlags : uint8_t
+    {
+        SysExStart = 0x01,   // First chunk (the 0xF0 preceded it)
+        SysExEnd = 0x02,     // Last chunk
+        SysExAborted = 0x04, // Ended by a status byte other than 0xF7
+    };
+
+    // A slice of SysEx payload (bytes between 0xF0 and 0xF7, both excluded)
+    struct SysExChunk
+    {
+        static constexpr size_t kCapacity = 128;
+
+        uint8_t data[kCapacity];
+        uint16_t length = 0;
+        uint8_t flags = 0;
+        uint64_t timestamp_us = 0; // Arrival of the 0xF0 that opened the message
+
+        bool isStart() const { return flags & SysExStart; }
+        bool isEnd() const { return flags & SysExEnd; }
+        bool isAborted() const { return flags & SysExAborted; }
+    };
+
+    // Called for every filled chunk. The chunk goes back to its pool when the
+    // callback returns, so copy out whatever must outlive the call.
+    using SysExCallback = std::function<void(const SysExChunk &)>;
+
+    // Fixed pool of chunk buffers, so a SysEx dump of any size is received
+    // without a contiguous (or any) allocation.
+    class SysExChunkPool
+    {
+    public:
+        static constexpr size_t kChunkCount = 4;
+
+        // Returns nullptr when every chunk is in use
+        SysExChunk *acquire()
+        {
+            uint32_t mask = freeMask.load(std::memory_order_relaxed);
+            while (mask != 0)
+            {
+                uint32_t bit = mask & (~mask + 1);
+                if (freeMask.compare_exchange_weak(mask, mask & ~bit, std::memory_order_acquire))
+                {
+                    SysExChunk *chunk = &chunks[__builtin_ctz(bit)];
+                    chunk->length = 0;
+                    chunk->flags = 0;
+                    return chunk;
+                }
+            }
+            exhaustedCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        void release(SysExChunk *chunk)
+        {
+            uint32_t index = static_cast<uint32_t>(chunk - chunks);
+            freeMask.fetch_or(1u << index, std::memory_order_release);
+        }
+
+        // Times acquire() found the pool empty
+        uint32_t exhausted() const { return exhaustedCount.load(std::memory_order_relaxed); }
+
+    private:
+        static_assert(kChunkCount <= 32, "free mask is 32 bits wide");
+
+        SysExChunk chunks[kChunkCount];
+        std::atomic<uint32_t> freeMask{(kChunkCount == 32) ? 0xFFFFFFFFu : ((1u << kChunkCount) - 1)};
+        std::atomic<uint32_t> exhaustedCount{0};
+    };
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "midi_protocol.hpp"
+
+namespace midi
+{
+    // Which notes are held, as a 16 x 128 bitset.
+    //
+    // Note On sets a bit, Note Off (or Note On with velocity 0) clears it,
+    // All Sound Off / All Notes Off clear a channel and System Reset clears
+    // everything. Queries are O(1); releaseAll() visits only the set bits,
+    // so it sends exactly the Note Offs that are needed. A note played twice
+    // is held once. Not thread-safe.
+    class NoteTracker
+    {
+    public:
+        void onNote(const NoteMessage &msg)
+        {
+            uint64_t bit = 1ULL << (msg.note & 63);
+            uint64_t &word = held[msg.channel & 0x0F][(msg.note >> 6) & 1];
+            if (msg.on && msg.velocity > 0)
+                word |= bit;
+            else
+                word &= ~bit;
+        }
+
+        // Track a raw message (status first, 1–3 bytes)
+        void feed(const uint8_t *msg, size_t length)
+        {
+            const uint8_t status = msg[0];
+            const uint8_t type = status & 0xF0;
+            if ((type == 0x80 || type == 0x90) && length == 3)
+            {
+                onNote(NoteMessage{static_cast<uint8_t>(status & 0x0F), type == 0x90, msg[1], msg[2]});
+            }
+            else if (type == 0xB0 && length == 3 && (msg[1] == kAllSoundOff || msg[1] == kAllNotesOff))
+            {
+                held[status & 0x0F][0] = 0;
+                held[status & 0x0F][1] = 0;
+            }
+            else if (status == static_cast<uint8_t>(MidiMessageType::SystemReset))
+            {
+                clear();
+            }
+        }
+
+        bool isHeld(uint8_t channel, uint8_t note) const
+        {
+            return (held[channel & 0x0F][(note >> 6) & 1] >> (note & 63)) & 1;
+        }
+
+        bool anyHeld() const { return channelsHeld() != 0; }
+
+        // Bit n set when channel n holds at least one note
+        uint16_t channelsHeld() const
+        {
+            uint16_t mask = 0;
+            for (uint8_t ch = 0; ch < 16; ++ch)
+            {
+                if (held[ch][0] | held[ch][1])
+                    mask |= static_cast<uint16_t>(1u << ch);
+            }
+            return mask;
+        }
+
+        size_t heldCount() const
+        {
+            size_t count = 0;
+            for (uint8_t ch = 0; ch < 16; ++ch)
+                count += __builtin_popcountll(held[ch][0]) + __builtin_popcountll(held[ch][1]);
+            return count;
+        }
+
+        // Call `sink(const NoteMessage &)` with a Note Off for every held
+        // note and forget them, stopping early after `max` notes. Returns
+        // how many were released.
+        template <typename Sink>
+        size_t releaseAll(Sink &&sink, size_t max = SIZE_MAX)
+        {
+            size_t released = 0;
+            for (uint8_t ch = 0; ch < 16; ++ch)
+            {
+                for (uint8_t half = 0; half < 2; ++half)
+                {
+                    uint64_t &word = held[ch][half];
+                    while (word)
+                    {
+                        if (released == max)
+                            return released;
+                        uint8_t note = static_cast<uint8_t>((half << 6) | __builtin_ctzll(word));
+                        word &= word - 1;
+                        sink(NoteMessage{ch, false, note, 0});
+                        released++;
+                    }
+                }
+            }
+            return released;
+        }
+
+        void clear()
+        {
+            for (auto &channel : held)
+                channel[0] = channel[1] = 0;
+        }
+
+    private:
+        static constexpr uint8_t kAllSoundOff = 120;
+        static constexpr uint8_t kAllNotesOff = 123;
+
+        uint64_t held[16][2] = {}; // [channel][note / 64]
+    };
+
+    // Active Sensing (0xFE) timeout, as MIDI 1.0 defines it.
+    //
+    // Off until the first 0xFE arrives; from then on the sender promises
+    // to send something at least every 300 ms. When it stays silent for
+    // longer (cable pulled, sender crashed), expired() reports it once and
+    // the watch disarms until the next 0xFE. Timestamps in, no platform
+    // dependencies.
+    class ActiveSensingWatch
+    {
+    public:
+        static constexpr uint32_t kDefaultTimeoutUs = 300000;
+
+        explicit ActiveSensingWatch(uint32_t timeout_us = kDefaultTimeoutUs) : timeout_us(timeout_us) {}
+
+        // A complete message arrived at `timestamp_us`
+        void onMessage(uint8_t status, uint64_t timestamp_us)
+        {
+            if (status == static_cast<uint8_t>(MidiMessageType::ActiveSensing))
+                sensing = true;
+            else if (status == static_cast<uint8_t>(MidiMessageType::SystemReset))
+                sensing = false;
+            onActivity(timestamp_us);
+        }
+
+        // Any other sign of life (e.g. SysEx bytes) that is not a message
+        void onActivity(uint64_t timestamp_us)
+        {
+            if (timestamp_us > last_us)
+                last_us = timestamp_us;
+        }
+
+        // True once when an armed input has been silent past the timeout
+        bool expired(uint64_t now_us)
+        {
+            if (!sensing || now_us < deadline())
+                return false;
+            sensing = false;
+            return true;
+        }
+
+        bool armed() const { return sensing; }
+        uint64_t deadline() const { return last_us + timeout_us; }
+        void reset() { sensing = false; }
+
+    private:
+        uint32_t timeout_us;
+        uint64_t last_us = 0;
+        bool sensing = false;
+    };
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace midi
+{
+    // Wait-free single-producer, single-consumer ring of fixed-size items.
+    //
+    // Exactly one producer and one consumer: push() from one task (or ISR)
+    // only, pop() from one other task only. A second consumer would read
+    // the same slots and move `tail` behind the first one's back; fan out
+    // after pop() instead. The counters and size() may be read from
+    // anywhere. Neither side ever blocks or takes a lock; a full ring
+    // rejects the item and counts an overflow instead.
+    template <typename T, size_t Capacity>
+    class SpscRing
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        // Producer side. Returns false (and counts an overflow) when full.
+        bool push(const T &item)
+        {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            uint32_t used = h - tail.load(std::memory_order_acquire);
+            if (used >= Capacity)
+            {
+                overflowCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            items[h & kMask] = item;
+            head.store(h + 1, std::memory_order_release);
+
+            if (used + 1 > highWater.load(std::memory_order_relaxed))
+                highWater.store(used + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Consumer side. Moves up to `max` items into `out`, returns how many.
+        size_t pop(T *out, size_t max)
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            uint32_t available = head.load(std::memory_order_acquire) - t;
+            size_t count = available < max ? available : max;
+
+            for (size_t i = 0; i < count; ++i)
+                out[i] = items[(t + i) & kMask];
+
+            tail.store(t + static_cast<uint32_t>(count), std::memory_order_release);
+            return count;
+        }
+
+        size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+        bool empty() const { return size() == 0; }
+        static constexpr size_t capacity() { return Capacity; }
+
+        // Most items ever waiting at once
+        uint32_t highWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+
+        // Items rejected because the ring was full
+        uint32_t overflows() const { return overflowCount.load(std::memory_order_relaxed); }
+
+    private:
+        static constexpr uint32_t kMask = Capacity - 1;
+
+        T items[Capacity];
+        std::atomic<uint32_t> head{0}; // Next slot to write, owned by the producer
+        std::atomic<uint32_t> tail{0}; // Next slot to read, owned by the consumer
+        std::atomic<uint32_t> highWater{0};
+        std::atomic<uint32_t> overflowCount{0};
+    };
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "midi_clock.hpp"
+
+namespace midi
+{
+    // Tempo of an incoming MIDI clock, re-estimated on every tick.
+    //
+    // Fits a least-squares line through the last kWindow tick times; the
+    // slope is the tick period. Integer math only, O(kWindow) per tick.
+    //
+    // A tick further than the tolerance from the fitted line is held back
+    // (the prediction goes into the window instead) so a single late byte
+    // barely moves the estimate. kRelockTicks outliers in a row mean the
+    // tempo really changed: the window restarts from those ticks alone.
+    class TempoEstimator
+    {
+    public:
+        static constexpr size_t kWindow = MIDI_CLOCKS_PER_BEAT;
+        static constexpr size_t kMinTicks = 3;    // Ticks needed for a first estimate
+        static constexpr size_t kRelockTicks = 3; // Consecutive outliers that restart the fit
+
+        void reset()
+        {
+            count = 0;
+            first = 0;
+            outliers = 0;
+            currentBpm = 0;
+            period_q16 = 0;
+            jitter = 0;
+        }
+
+        // Add the tick at `timestamp_us`. Returns true when a new estimate is
+        // available (every tick from the kMinTicks-th on).
+        bool addTick(uint64_t timestamp_us)
+        {
+            if (count >= kMinTicks && period_q16 > 0)
+            {
+                uint64_t predicted = predictNext();
+                uint64_t error = timestamp_us > predicted ? timestamp_us - predicted : predicted - timestamp_us;
+                uint64_t tolerance = (period_q16 >> 20) + 4 * static_cast<uint64_t>(jitter) + 100; // period/16
+                if (error > tolerance)
+                {
+                    pending[outliers++] = timestamp_us;
+                    if (outliers < kRelockTicks)
+                    {
+                        push(predicted);
+                        return fit();
+                    }
+
+                    count = 0;
+                    first = 0;
+                    for (size_t i = 0; i < outliers; ++i)
+                        push(pending[i]);
+                    outliers = 0;
+                    return fit();
+                }
+            }
+
+            outliers = 0;
+            push(timestamp_us);
+            return fit();
+        }
+
+        // Tempo in Q16.16 BPM, 0 before the first estimate
+        BpmQ16 bpm() const { return currentBpm; }
+
+        // Tick period in Q16.16 microseconds
+        uint64_t periodQ16() const { return period_q16; }
+
+        // Mean distance of the window's ticks from the fitted line, us
+        uint32_t jitterUs() const { return jitter; }
+
+        // 0–100: how full the window is, scaled down by jitter relative to
+        // the period (jitter of a quarter period or more gives 0)
+        uint8_t confidence() const
+        {
+            if (count < kMinTicks || period_q16 == 0)
+                return 0;
+            uint64_t period_us = period_q16 >> 16;
+            uint64_t spread = 4 * static_cast<uint64_t>(jitter);
+            uint64_t steadiness = spread >= period_us ? 0 : (period_us - spread) * 100 / period_us;
+            return static_cast<uint8_t>(steadiness * count / kWindow);
+        }
+
+        bool locked() const { return count >= kMinTicks; }
+        size_t ticksInWindow() const { return count; }
+
+    private:
+        void push(uint64_t timestamp_us)
+        {
+            if (count < kWindow)
+            {
+                ticks[(first + count) % kWindow] = timestamp_us;
+                count++;
+            }
+            else
+            {
+                ticks[first] = timestamp_us;
+                first = (first + 1) % kWindow;
+            }
+        }
+
+        uint64_t at(size_t i) const { return ticks[(first + i) % kWindow]; }
+
+        // Regresses tick time on tick index, relative to the oldest tick
+        bool fit()
+        {
+            if (count < kMinTicks)
+                return false;
+
+            const int64_t n = static_cast<int64_t>(count);
+            const uint64_t origin = at(0);
+            int64_t sumT = 0;
+            int64_t sumIT = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                int64_t t = static_cast<int64_t>(at(i) - origin);
+                sumT += t;
+                sumIT += static_cast<int64_t>(i) * t;
+            }
+            const int64_t sumI = n * (n - 1) / 2;
+            const int64_t den = n * n * (n * n - 1) / 12; // n*sum(i^2) - sum(i)^2
+            const int64_t num = n * sumIT - sumI * sumT;
+            if (num <= 0)
+                return false; // timestamps not increasing
+
+            slopeNum = num;
+            slopeDen = den;
+            interceptNum = sumT * den - num * sumI; // times n * den
+            fitOrigin = origin;
+
+            period_q16 = (static_cast<uint64_t>(num) << 16) / static_cast<uint64_t>(den);
+            currentBpm = static_cast<BpmQ16>(ClockTickScheduler::kTickNumerator / period_q16);
+
+            uint64_t residuals = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                int64_t fitted = lineAt(static_cast<int64_t>(i));
+                int64_t actual = static_cast<int64_t>(at(i) - origin);
+                residuals += static_cast<uint64_t>(actual > fitted ? actual - fitted : fitted - actual);
+            }
+            jitter = static_cast<uint32_t>(residuals / count);
+            return true;
+        }
+
+        // Fitted time of tick index i, relative to fitOrigin
+        int64_t lineAt(int64_t i) const
+        {
+            const int64_t n = static_cast<int64_t>(count);
+            return (interceptNum + slopeNum * i * n) / (n * slopeDen);
+        }
+
+        uint64_t predictNext() const
+        {
+            return fitOrigin + static_cast<uint64_t>(lineAt(static_cast<int64_t>(count)));
+        }
+
+        uint64_t ticks[kWindow] = {};
+        size_t count = 0;
+        size_t first = 0;
+        uint64_t pending[kRelockTicks] = {};
+        size_t outliers = 0;
+
+        int64_t slopeNum = 0;
+        int64_t slopeDen = 1;
+        int64_t interceptNum = 0;
+        uint64_t fitOrigin = 0;
+
+        BpmQ16 currentBpm = 0;
+        uint64_t period_q16 = 0;
+        uint32_t jitter = 0;
+    };
+}
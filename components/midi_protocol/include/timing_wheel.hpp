@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace midi
+{
+    // A MIDI message waiting for its send time
+    struct ScheduledMessage
+    {
+        uint64_t due_us;
+        uint8_t data[3];
+        uint8_t length;
+    };
+
+    // Two-level hierarchical timing wheel over a fixed pool of messages.
+    //
+    // Level 0 has 256 slots of 256 us (65 ms span), level 1 has 256 slots of
+    // 65 ms (16.7 s span). Anything further out waits in an overflow list
+    // that is re-examined every 16.7 s. Insert is O(1); advancing is O(1) per
+    // elapsed slot plus the messages it releases. Messages due at the same
+    // time come out in the order they were scheduled. Not thread-safe.
+    template <size_t Capacity>
+    class TimingWheel
+    {
+        static_assert(Capacity > 0 && Capacity < 0xFFFF, "pool indices are 16 bits");
+
+    public:
+        static constexpr uint32_t kTickShift = 8; // 256 us per level-0 slot
+        static constexpr uint32_t kTickUs = 1u << kTickShift;
+
+        TimingWheel() { clear(0); }
+
+        // Drop everything and restart the wheel at `now_us`
+        void clear(uint64_t now_us)
+        {
+            for (size_t i = 0; i < kSlots; ++i)
+            {
+                level0[i] = {kNil, kNil};
+                level1[i] = {kNil, kNil};
+            }
+            overflow = {kNil, kNil};
+            for (size_t i = 0; i < Capacity; ++i)
+                next[i] = static_cast<uint16_t>(i + 1 < Capacity ? i + 1 : kNil);
+            freeHead = 0;
+            count = 0;
+            current = now_us >> kTickShift;
+        }
+
+        // Returns false when the pool is full. `now_us` moves an empty wheel
+        // up to the present, so the first message after an idle spell (when
+        // nothing called advance()) is placed against the current time
+        // rather than the last service, and the next advance() has no
+        // stale slots to walk through.
+        bool schedule(const ScheduledMessage &msg, uint64_t now_us)
+        {
+            if (freeHead == kNil)
+                return false;
+            if (count == 0 && (now_us >> kTickShift) > current)
+                current = now_us >> kTickShift;
+
+            uint16_t index = freeHead;
+            freeHead = next[index];
+            pool[index] = msg;
+            place(index);
+            count++;
+            return true;
+        }
+
+        // Release every message due at or before `now_us`, in slot order,
+        // by calling `sink(const ScheduledMessage &)`. Never releases early.
+        template <typename Sink>
+        void advance(uint64_t now_us, Sink &&sink)
+        {
+            const uint64_t target = now_us >> kTickShift;
+            if (count == 0)
+            {
+                if (target > current)
+                    current = target;
+                return;
+            }
+
+            while (true)
+            {
+                // Slots behind `target` are entirely due; the one at `target`
+                // only up to now_us, the rest of it stays put
+                const bool partial = current >= target;
+                List &slot = level0[current & kSlotMask];
+                uint16_t index = slot.head;
+                slot = {kNil, kNil};
+                while (index != kNil)
+                {
+                    uint16_t following = next[index];
+                    if (partial && pool[index].due_us > now_us)
+                    {
+                        append(slot, index);
+                    }
+                    else
+                    {
+                        sink(static_cast<const ScheduledMessage &>(pool[index]));
+                        next[index] = freeHead;
+                        freeHead = index;
+                        count--;
+                    }
+                    index = following;
+                }
+
+                if (partial)
+                    break;
+
+                current++;
+                if ((current & kSlotMask) == 0)
+                {
+                    if (((current >> kLevelShift) & kSlotMask) == 0)
+                        cascade(overflow);
+                    cascade(level1[(current >> kLevelShift) & kSlotMask]);
+                }
+            }
+        }
+
+        // Earliest due time of anything waiting, UINT64_MAX when empty. Looks
+        // at the first occupied slot of each level and the overflow list:
+        // at most 2 x 256 slots plus the messages in the lists it finds.
+        uint64_t nextDue() const
+        {
+            if (count == 0)
+                return UINT64_MAX;
+
+            // Level 0 holds ticks [current, current + 256), one per slot
+            uint64_t earliest = UINT64_MAX;
+            for (uint64_t tick = current; tick < current + kSlots; ++tick)
+            {
+                const List &slot = level0[tick & kSlotMask];
+                if (slot.head != kNil)
+                {
+                    earliest = earliestIn(slot);
+                    break;
+                }
+            }
+
+            // Level 1 holds later 256-tick blocks, which may overlap the end
+            // of level 0's span
+            const uint64_t block = current >> kLevelShift;
+            for (uint64_t later = block + 1; later <= block + kSlots; ++later)
+            {
+                const List &slot = level1[later & kSlotMask];
+                if (slot.head != kNil)
+                {
+                    earliest = std::min(earliest, earliestIn(slot));
+                    break;
+                }
+            }
+            return std::min(earliest, earliestIn(overflow));
+        }
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        static constexpr size_t capacity() { return Capacity; }
+
+    private:
+        static constexpr uint16_t kNil = 0xFFFF;
+        static constexpr size_t kSlots = 256;
+        static constexpr uint64_t kSlotMask = kSlots - 1;
+        static constexpr uint32_t kLevelShift = 8;
+
+        struct List
+        {
+            uint16_t head;
+            uint16_t tail;
+        };
+
+        void append(List &list, uint16_t index)
+        {
+            next[index] = kNil;
+            if (list.tail == kNil)
+                list.head = index;
+            else
+                next[list.tail] = index;
+            list.tail = index;
+        }
+
+        void place(uint16_t index)
+        {
+            uint64_t tick = pool[index].due_us >> kTickShift;
+            if (tick < current)
+                tick = current; // already late: goes out on the next advance
+
+            uint64_t delta = tick - current;
+            if (delta < kSlots)
+                append(level0[tick & kSlotMask], index);
+            else if (delta < kSlots * kSlots)
+                append(level1[(tick >> kLevelShift) & kSlotMask], index);
+            else
+                append(overflow, index);
+        }
+
+        uint64_t earliestIn(const List &list) const
+        {
+            uint64_t earliest = UINT64_MAX;
+            for (uint16_t index = list.head; index != kNil; index = next[index])
+                earliest = std::min(earliest, pool[index].due_us);
+            return earliest;
+        }
+
+        void cascade(List &list)
+        {
+            uint16_t index = list.head;
+            list = {kNil, kNil};
+            while (index != kNil)
+            {
+                uint16_t following = next[index];
+                place(index);
+                index = following;
+            }
+        }
+
+        ScheduledMessage pool[Capacity];
+        uint16_t next[Capacity]; // Intrusive list links, shared by slots and the free list
+        List level0[kSlots];
+        List level1[kSlots];
+        List overflow;
+        uint16_t freeHead = kNil;
+        size_t count = 0;
+        uint64_t current = 0; // Level-0 tick being serviced
+    };
+}
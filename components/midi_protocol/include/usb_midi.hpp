@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "midi_protocol.hpp"
+
+namespace midi
+{
+    // USB MIDI 1.0 event packet framing: byte 0 of a Packet4 is the cable
+    // number (virtual port, 0–15) in the high nibble and the Code Index
+    // Number in the low nibble. The CIN alone says what the packet holds
+    // and how many of its bytes are MIDI, so a receiver can dispatch on it
+    // without looking at the status byte.
+    enum class UsbCin : uint8_t
+    {
+        Misc = 0x0,            // Reserved; packets from sources that leave byte 0 zero
+        CableEvent = 0x1,      // Reserved
+        SystemCommon2 = 0x2,   // MTC Quarter Frame, Song Select
+        SystemCommon3 = 0x3,   // Song Position Pointer
+        SysExStart = 0x4,      // SysEx starts or continues, 3 bytes
+        SingleByte = 0x5,      // 1-byte System Common (Tune Request) or SysEx ending with 1 byte
+        SysExEnd2 = 0x6,       // SysEx ends with 2 bytes
+        SysExEnd3 = 0x7,       // SysEx ends with 3 bytes
+        NoteOff = 0x8,
+        NoteOn = 0x9,
+        PolyAftertouch = 0xA,
+        ControlChange = 0xB,
+        ProgramChange = 0xC,
+        ChannelPressure = 0xD,
+        PitchBend = 0xE,
+        Byte = 0xF,            // One byte as is; System Real-Time
+    };
+
+    // MIDI bytes carried by a packet with each CIN (0 for the reserved ones)
+    constexpr uint8_t kUsbCinLength[16] = {0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1};
+
+    namespace detail
+    {
+        // CIN for a complete message starting with 0xF0 + index; SysEx
+        // bytes and undefined statuses get Misc
+        constexpr uint8_t kSystemCin[16] = {
+            0x0, 0x2, 0x3, 0x2, 0x0, 0x0, 0x5, 0x0, // F0 SysEx, F1 MTC, F2 SPP, F3 Song Select, F6 Tune Request
+            0xF, 0x0, 0xF, 0xF, 0xF, 0x0, 0xF, 0xF, // Real-Time (F9, FD undefined)
+        };
+    }
+
+    // CIN of a complete (non-SysEx) message with this status byte
+    constexpr uint8_t usbCin(uint8_t status)
+    {
+        return status < 0x80 ? 0x0 : status < 0xF0 ? static_cast<uint8_t>(status >> 4) : detail::kSystemCin[status & 0x0F];
+    }
+
+    constexpr uint8_t usbHeader(uint8_t cable, uint8_t status)
+    {
+        return static_cast<uint8_t>((cable & 0x0F) << 4 | usbCin(status));
+    }
+
+    constexpr uint8_t usbCable(const uint8_t packet[4]) { return packet[0] >> 4; }
+    constexpr UsbCin usbCinOf(const uint8_t packet[4]) { return static_cast<UsbCin>(packet[0] & 0x0F); }
+
+    // MIDI bytes in `packet` (from packet[1] on), 0 for reserved CINs
+    constexpr uint8_t usbMessageLength(const uint8_t packet[4]) { return kUsbCinLength[packet[0] & 0x0F]; }
+
+    // Frame a complete message (status first, 1–3 bytes) for `cable`
+    inline Packet4 makeUsbPacket(uint8_t cable, const uint8_t *message, size_t length)
+    {
+        return {usbHeader(cable, message[0]), message[0],
+                length > 1 ? message[1] : static_cast<uint8_t>(0),
+                length > 2 ? message[2] : static_cast<uint8_t>(0)};
+    }
+}
@@ -0,0 +1,45 @@
+#include "midi_protocol.hpp"
+
+// Compile-time checks of the status byte table against the MIDI 1.0 spec
+using namespace midi;
+
+static_assert(statusInfo(0x00).cls == MessageClass::Data && statusInfo(0x7F).cls == MessageClass::Data);
+static_assert(getMessageType(0x45) == MidiMessageType::Unknown);
+static_assert(getMidiMessageSize(MidiMessageType::Unknown) == 1);
+
+static_assert(getMessageType(0x80) == MidiMessageType::NoteOff && getMessageType(0x8F) == MidiMessageType::NoteOff);
+static_assert(getMessageType(0x9A) == MidiMessageType::NoteOn);
+static_assert(getMessageType(0xBF) == MidiMessageType::ControlChange);
+static_assert(getMessageType(0xE3) == MidiMessageType::PitchBend);
+static_assert(statusInfo(0xC5).cls == MessageClass::ChannelVoice);
+
+static_assert(getMidiMessageSize(MidiMessageType::NoteOff) == 3);
+static_assert(getMidiMessageSize(MidiMessageType::NoteOn) == 3);
+static_assert(getMidiMessageSize(MidiMessageType::PolyAftertouch) == 3);
+static_assert(getMidiMessageSize(MidiMessageType::ControlChange) == 3);
+static_assert(getMidiMessageSize(MidiMessageType::ProgramChange) == 2);
+static_assert(getMidiMessageSize(MidiMessageType::ChannelPressure) == 2);
+static_assert(getMidiMessageSize(MidiMessageType::PitchBend) == 3);
+static_assert(statusInfo(0xD7).length == 2 && statusInfo(0x93).length == 3);
+
+static_assert(getMidiMessageSize(MidiMessageType::SystemExclusive) == -1);
+static_assert(statusInfo(0xF0).cls == MessageClass::SystemExclusive);
+static_assert(getMidiMessageSize(MidiMessageType::TimeCodeQuarter) == 2);
+static_assert(getMidiMessageSize(MidiMessageType::SongPosition) == 3);
+static_assert(getMidiMessageSize(MidiMessageType::SongSelect) == 2);
+static_assert(getMidiMessageSize(MidiMessageType::TuneRequest) == 1);
+static_assert(getMidiMessageSize(MidiMessageType::EndOfExclusive) == 1);
+static_assert(statusInfo(0xF2).cls == MessageClass::SystemCommon);
+
+static_assert(statusInfo(0xF4).cls == MessageClass::Undefined && statusInfo(0xF5).cls == MessageClass::Undefined);
+static_assert(statusInfo(0xF9).cls == MessageClass::Undefined && statusInfo(0xFD).cls == MessageClass::Undefined);
+static_assert(getMessageType(0xF4) == static_cast<MidiMessageType>(0xF4));
+
+static_assert(getMessageType(0xF8) == MidiMessageType::TimingClock);
+static_assert(getMessageType(0xFC) == MidiMessageType::Stop);
+static_assert(statusInfo(0xF8).cls == MessageClass::RealTime && statusInfo(0xFF).cls == MessageClass::RealTime);
+static_assert(getMidiMessageSize(MidiMessageType::ActiveSensing) == 1);
+
+static_assert(to_string(MidiMessageType::Unknown)[0] == 'U');
+static_assert(to_string(MidiMessageType::TimingClock)[0] == 'T');
+static_assert(to_string(static_cast<MidiMessageType>(0x9C))[5] == 'O'); // "Note On", any channel
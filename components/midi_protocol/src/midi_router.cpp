@@ -0,0 +1,110 @@
+#include "midi_router.hpp"
+
+using namespace midi;
+
+MidiRouter::MidiRouter()
+{
+    reset();
+}
+
+void MidiRouter::reset()
+{
+    for (size_t i = 0; i < 128; ++i)
+    {
+        curves[0][i] = static_cast<uint8_t>(i);
+        identityRow[i] = {static_cast<uint8_t>(i), 0};
+        noteOnRow[i] = identityRow[i];
+        for (size_t ch = 0; ch < 16; ++ch)
+            ccRows[ch][i] = identityRow[i];
+    }
+    curveSources[0] = nullptr;
+    curveCount = 1;
+
+    for (size_t s = 0; s < 256; ++s)
+    {
+        statusMap[s] = s < 0x80 || s == 0xF0 ? 0 : static_cast<uint8_t>(s); // data bytes and SysEx never route
+        dataRows[s] = identityRow;
+    }
+    for (size_t ch = 0; ch < 16; ++ch)
+    {
+        dataRows[0x90 | ch] = noteOnRow;
+        dataRows[0xB0 | ch] = ccRows[ch];
+    }
+}
+
+// Returns the slot holding `table`, adding it if new; -1 when full
+int MidiRouter::curveSlot(const uint8_t *table, bool velocity)
+{
+    if (!table)
+        return 0;
+    for (size_t i = 1; i < curveCount; ++i)
+    {
+        if (curveSources[i] == table)
+            return static_cast<int>(i);
+    }
+    if (curveCount == kMaxCurves)
+        return -1;
+
+    uint8_t *curve = curves[curveCount];
+    for (size_t i = 0; i < 128; ++i)
+        curve[i] = table[i] & 0x7F;
+    if (velocity)
+    {
+        // Keep Note On a Note On, and velocity 0 a Note Off
+        curve[0] = 0;
+        for (size_t i = 1; i < 128; ++i)
+            curve[i] = curve[i] ? curve[i] : 1;
+    }
+    curveSources[curveCount] = table;
+    return static_cast<int>(curveCount++);
+}
+
+bool MidiRouter::compile(const MidiRouteConfig &config)
+{
+    reset();
+
+    int velocity = curveSlot(config.velocity_curve, true);
+    if (velocity < 0)
+        return false;
+    for (size_t i = 0; i < 128; ++i)
+        noteOnRow[i].curve = static_cast<uint8_t>(velocity);
+
+    for (size_t r = 0; r < config.cc_rule_count; ++r)
+    {
+        const MidiCcRule &rule = config.cc_rules[r];
+        int curve = curveSlot(rule.curve, false);
+        if (curve < 0)
+        {
+            reset();
+            return false;
+        }
+        DataRoute route = {rule.to == MidiCcRule::kDrop ? uint8_t{0x80} : static_cast<uint8_t>(rule.to & 0x7F),
+                           static_cast<uint8_t>(curve)};
+        for (size_t ch = 0; ch < 16; ++ch)
+        {
+            if (rule.channel == MidiCcRule::kAllChannels || rule.channel == ch)
+                ccRows[ch][rule.from & 0x7F] = route;
+        }
+    }
+
+    for (size_t s = 0x80; s < 0xF0; ++s)
+    {
+        const size_t type = (s >> 4) - 8;
+        const size_t ch = s & 0x0F;
+        bool pass = (config.voice_types & (1u << type)) && (config.channels & (1u << ch));
+        statusMap[s] = pass ? static_cast<uint8_t>((s & 0xF0) | (config.channel_map[ch] & 0x0F)) : 0;
+    }
+    for (size_t s = 0xF1; s < 0xF8; ++s)
+        statusMap[s] = config.system_common ? static_cast<uint8_t>(s) : 0;
+    for (size_t s = 0xF8; s < 0x100; ++s)
+        statusMap[s] = config.realtime ? static_cast<uint8_t>(s) : 0;
+
+    return true;
+}
+
+void MidiRouter::scaleCurve(uint8_t curve[128], uint8_t min, uint8_t max)
+{
+    curve[0] = 0;
+    for (int i = 1; i < 128; ++i)
+        curve[i] = static_cast<uint8_t>(min + (max - min) * (i - 1) / 126);
+}
@@ -0,0 +1,175 @@
+#include "midi_stream_parser.hpp"
+
+using namespace midi;
+
+void MidiStreamParser::reset()
+{
+    if (sysexChunk)
+        endSysEx(SysExEnd | SysExAborted);
+
+    status = 0;
+    dataIndex = 0;
+    dataLength = 0;
+    inSysEx = false;
+    statusConsumed = false;
+}
+
+bool MidiStreamParser::feed(uint8_t byte, uint64_t timestamp_us, MidiEvent &out)
+{
+    // System Real-Time: may appear anywhere, never touches the running state
+    if (byte >= 0xF8)
+    {
+        if (statusInfo(byte).cls == MessageClass::Undefined)
+        {
+            errors++;
+            return false;
+        }
+
+        out = {{static_cast<uint8_t>(cableBits | usbCin(byte)), byte, 0, 0}, timestamp_us};
+        return true;
+    }
+
+    if (byte & 0x80)
+        return startMessage(byte, timestamp_us, out);
+
+    // Data byte
+    if (inSysEx)
+    {
+        appendSysEx(byte);
+        return false;
+    }
+    if (status == 0)
+    {
+        errors++; // no running status to attach to
+        return false;
+    }
+
+    if (statusConsumed)
+    {
+        messageTimestamp = timestamp_us; // running status: message starts here
+        statusConsumed = false;
+    }
+
+    data[dataIndex++] = byte;
+    if (dataIndex < dataLength)
+        return false;
+
+    out = {{static_cast<uint8_t>(cableBits | usbCin(status)), status, data[0], dataLength > 1 ? data[1] : static_cast<uint8_t>(0)},
+           messageTimestamp};
+    dataIndex = 0;
+    statusConsumed = true;
+
+    // Only channel voice messages establish running status
+    if (status >= 0xF0)
+        status = 0;
+
+    return true;
+}
+
+bool MidiStreamParser::startMessage(uint8_t statusByte, uint64_t timestamp_us, MidiEvent &out)
+{
+    if (inSysEx && sysexChunk)
+        endSysEx(statusByte == 0xF7 ? SysExEnd : SysExEnd | SysExAborted);
+    if ((inSysEx && statusByte != 0xF7) || (status != 0 && !statusConsumed))
+        errors++; // the message in progress is cut short
+
+    bool wasSysEx = inSysEx;
+    messageTimestamp = timestamp_us;
+    statusConsumed = false;
+    dataIndex = 0;
+    inSysEx = false;
+    status = 0; // System Common and SysEx clear running status
+
+    if (statusByte == 0xF0)
+    {
+        inSysEx = true;
+        beginSysEx(timestamp_us);
+        return false;
+    }
+
+    if (statusByte == 0xF7)
+    {
+        if (!wasSysEx)
+            errors++; // stray EOX
+        return false;
+    }
+
+    const StatusInfo &info = statusInfo(statusByte);
+    if (info.cls == MessageClass::Undefined)
+    {
+        errors++;
+        return false;
+    }
+
+    if (info.length <= 1)
+    {
+        out = {{static_cast<uint8_t>(cableBits | usbCin(statusByte)), statusByte, 0, 0}, timestamp_us}; // Tune Request
+        return true;
+    }
+
+    status = statusByte;
+    dataLength = static_cast<uint8_t>(info.length - 1);
+    return false;
+}
+
+void MidiStreamParser::setSysExHandler(SysExChunkPool *pool, SysExCallback callback)
+{
+    if (sysexChunk)
+        endSysEx(SysExEnd | SysExAborted);
+
+    sysexPool = pool;
+    sysexCallback = callback;
+}
+
+void MidiStreamParser::beginSysEx(uint64_t timestamp_us)
+{
+    if (!sysexPool || !sysexCallback)
+        return;
+
+    sysexChunk = sysexPool->acquire();
+    if (!sysexChunk)
+    {
+        sysexDropped++;
+        return;
+    }
+    sysexChunk->flags = SysExStart;
+    sysexChunk->timestamp_us = timestamp_us;
+}
+
+void MidiStreamParser::appendSysEx(uint8_t byte)
+{
+    if (!sysexChunk)
+        return;
+
+    if (sysexChunk->length == SysExChunk::kCapacity)
+    {
+        // Hand over the full chunk lazily, so the final chunk carries
+        // SysExEnd. Its successor is taken first: with the pool dry, the
+        // full chunk ends the message as aborted and the rest is skipped,
+        // so the consumer never waits for an end that does not come.
+        SysExChunk *next = sysexPool->acquire();
+        if (!next)
+        {
+            sysexDropped++;
+            endSysEx(SysExEnd | SysExAborted);
+            return;
+        }
+        next->timestamp_us = sysexChunk->timestamp_us;
+        flushSysEx();
+        sysexChunk = next;
+    }
+    sysexChunk->data[sysexChunk->length++] = byte;
+}
+
+void MidiStreamParser::endSysEx(uint8_t flags)
+{
+    sysexChunk->flags |= flags;
+    flushSysEx();
+}
+
+void MidiStreamParser::flushSysEx()
+{
+    sysexCallback(*sysexChunk);
+    sysexPool->release(sysexChunk);
+    sysexChunk = nullptr;
+}
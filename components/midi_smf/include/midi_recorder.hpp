@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "midi_clock.hpp"
+#include "midi_protocol.hpp"
+
+namespace midi
+{
+    // Captures received channel messages into a caller-provided arena for
+    // later export (see writeSmf).
+    //
+    // Each message is appended as a variable-length delta time in
+    // microseconds, the status byte only when it differs from the previous
+    // message's (running status), then the data bytes: 2 to 4 bytes for a
+    // typical note, never more than kMaxRecordBytes. record() does no
+    // allocation, formatting or locking and costs the same whatever was
+    // recorded before; when the arena is full it only counts the message as
+    // dropped. The arena is append-only, so a long take keeps its start.
+    //
+    // record() and recordTempo() belong to one task (the receive path);
+    // start(), stop() and reading may happen on any other. A Reader sees
+    // everything published so far, also while recording.
+    class MidiRecorder
+    {
+    public:
+        static constexpr size_t kMaxRecordBytes = 9; // 5-byte delta + Set Tempo (0xFF + 3 bytes)
+
+        struct Entry
+        {
+            uint64_t time_us; // Since start()
+            bool tempo;       // Set Tempo: tempo_us holds us per quarter note
+            uint8_t data[3];
+            uint8_t length;
+            uint32_t tempo_us;
+        };
+
+        // Decodes the arena from the start, up to what was published when
+        // it was made or up to `bytes` (a bytesUsed() value)
+        class Reader
+        {
+        public:
+            explicit Reader(const MidiRecorder &recorder);
+            Reader(const MidiRecorder &recorder, size_t bytes);
+            bool next(Entry &out);
+
+        private:
+            const uint8_t *arena;
+            size_t end;
+            size_t offset = 0;
+            uint64_t time_us = 0;
+            uint8_t runningStatus = 0;
+        };
+
+        MidiRecorder(uint8_t *arena, size_t size);
+
+        // Drop what was recorded and record from `now_us` on. Waits for a
+        // record() running on another task to finish.
+        void start(uint64_t now_us);
+        void stop();
+        bool recording() const { return active.load(std::memory_order_relaxed); }
+
+        // Receive path. Channel messages only; everything else is ignored.
+        // False if not recording, not a channel message, or the arena is full.
+        bool record(uint64_t timestamp_us, const uint8_t *data, size_t length)
+        {
+            uint8_t status = data[0];
+            uint8_t dataBytes = (status & 0xE0) == 0xC0 ? 1 : 2;
+            if (status < 0x80 || status >= 0xF0 || length < 1u + dataBytes || !enter())
+                return false;
+            if (size - head < kMaxRecordBytes)
+                return leave(false);
+
+            size_t at = putDelta(timestamp_us, head);
+            if (status != runningStatus)
+            {
+                arena[at++] = status;
+                runningStatus = status;
+            }
+            arena[at++] = data[1] & 0x7F;
+            if (dataBytes == 2)
+                arena[at++] = data[2] & 0x7F;
+            return publish(at);
+        }
+
+        bool record(const MidiEvent &event) { return record(event.timestamp_us, &event.packet[1], 3); }
+
+        // Receive path, e.g. with BpmCounter::bpmQ16() on each tempo update.
+        // Only changes of more than 0.1% from the last recorded tempo are
+        // kept.
+        bool recordTempo(uint64_t timestamp_us, BpmQ16 bpm);
+
+        size_t capacity() const { return size; }
+        size_t bytesUsed() const { return committed.load(std::memory_order_acquire); }
+        uint32_t events() const { return recorded.load(std::memory_order_relaxed); }
+        uint32_t dropped() const { return lost.load(std::memory_order_relaxed); }
+
+    private:
+        // The writer flags itself busy before checking `active`, and start()
+        // clears `active` before waiting for busy to drop, so one of them
+        // always sees the other (both sequentially consistent)
+        bool enter()
+        {
+            busy.store(true, std::memory_order_seq_cst);
+            if (active.load(std::memory_order_seq_cst))
+                return true;
+            busy.store(false, std::memory_order_release);
+            return false;
+        }
+
+        bool leave(bool ok)
+        {
+            if (!ok)
+                lost.store(lost.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            busy.store(false, std::memory_order_release);
+            return ok;
+        }
+
+        size_t putDelta(uint64_t timestamp_us, size_t at)
+        {
+            // Late timestamps (another input's back-dated arrival) count as now
+            uint64_t delta = timestamp_us > last_us ? timestamp_us - last_us : 0;
+            if (delta > kMaxDelta)
+                delta = kMaxDelta;
+            last_us += delta;
+
+            uint8_t groups[5];
+            size_t count = 0;
+            do
+            {
+                groups[count++] = delta & 0x7F;
+                delta >>= 7;
+            } while (delta);
+            while (count > 1)
+                arena[at++] = groups[--count] | 0x80;
+            arena[at++] = groups[0];
+            return at;
+        }
+
+        bool publish(size_t at)
+        {
+            head = at;
+            committed.store(at, std::memory_order_release);
+            recorded.store(recorded.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return leave(true);
+        }
+
+        static constexpr uint64_t kMaxDelta = (1ull << 35) - 1; // 5 groups of 7 bits, ~9.5 hours
+
+        uint8_t *arena;
+        size_t size;
+
+        std::atomic<bool> active{false};
+        std::atomic<bool> busy{false};
+        std::atomic<size_t> committed{0}; // Bytes a Reader may decode
+        std::atomic<uint32_t> recorded{0};
+        std::atomic<uint32_t> lost{0};
+
+        // Writer state, reset by start() while the writer is out
+        size_t head = 0;
+        uint64_t last_us = 0;
+        uint8_t runningStatus = 0;
+        uint32_t lastTempo_us = 0;
+    };
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "esp_partition.h"
+#include "smf_source.hpp"
+
+namespace midi
+{
+    // A file stored at the start of a data partition, read from flash with
+    // esp_partition_read() window by window; it takes no mmap pages. The
+    // file length comes from its own chunk headers, so the partition may be
+    // larger than the file.
+    class SmfPartitionSource : public SmfSource
+    {
+    public:
+        // Finds a data partition by label; valid() is false if there is none
+        explicit SmfPartitionSource(const char *label);
+        explicit SmfPartitionSource(const esp_partition_t *partition);
+
+        bool valid() const { return partition != nullptr; }
+
+        uint32_t size() const override;
+        bool read(uint32_t offset, uint8_t *out, size_t length) const override;
+
+    private:
+        const esp_partition_t *partition;
+    };
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "midi_hal.hpp"
+#include "midi_out.hpp"
+#include "smf_sequence.hpp"
+
+namespace midi
+{
+    struct SmfPlayerConfig
+    {
+        uint32_t lookahead_ms = 20; // How far ahead events are handed to MidiOut::sendAt
+        uint32_t period_ms = 5;     // Refill timer period; also the lead before the first event
+        bool loop = false;          // Start over at the end of the file
+    };
+
+    // Plays a Standard MIDI File on a MidiOut at the file's own tempo.
+    //
+    // A periodic hal::Timer reads events up to lookahead_ms ahead and hands
+    // them to MidiOut::sendAt with their absolute time, so timing is set by
+    // MidiOut's timing wheel rather than by when the timer runs. Follows
+    // transport messages (e.g. from a MidiIn callback): Start plays from the
+    // top, Stop pauses, Continue resumes, and Song Position Pointer moves
+    // the playback position through the sequence's seek index. It does not
+    // follow incoming MIDI clock.
+    class SmfPlayer
+    {
+    public:
+        explicit SmfPlayer(MidiOut &out, const SmfPlayerConfig &config = {});
+        ~SmfPlayer();
+
+        // Stop and open `source`, which must outlive playback. False if it is
+        // not a format 0 or 1 SMF.
+        bool load(const SmfSource &source);
+
+        void start();  // From the top
+        void resume(); // From where stop() left off, or the last seek()
+
+        // Events already handed to MidiOut (up to lookahead_ms) still go
+        // out; notes held on the output are released after them
+        void stop();
+
+        // Move to a Song Position Pointer value (MIDI beats); keeps playing
+        // if playing
+        void seek(uint16_t midiBeats);
+
+        void onTransport(TransportEvent event);
+        void onSongPosition(SongPosition event);
+
+        bool playing() const;
+        uint32_t positionTicks() const; // Next event not yet handed to MidiOut
+
+    private:
+        void onTimer();
+        void beginAt(uint32_t tick, uint64_t now_us);
+        void fill(uint64_t now_us);
+        void halt(uint64_t now_us);
+        uint64_t timeOf(uint32_t tick) const;
+
+        MidiOut &out;
+        SmfPlayerConfig config;
+        mutable hal::Mutex lock;
+
+        // Guarded by lock
+        SmfSequence sequence;
+        bool loaded = false;
+        bool active = false;
+        SmfEvent pending;          // Read but not yet scheduled (too far ahead or wheel full)
+        bool havePending = false;
+        uint64_t origin_us = 0;    // hal::nowUs() time of the file's `originOffset_us`
+        uint64_t originOffset_us = 0;
+        uint64_t lastDue_us = 0;   // Latest time handed to sendAt
+        bool releaseDue = false;   // releaseHeldNotes() once releaseAt_us has passed
+        uint64_t releaseAt_us = 0;
+
+        // Last, so it is destroyed first: ~Timer waits out a running
+        // onTimer(), which still uses everything above
+        hal::Timer timer;
+    };
+}
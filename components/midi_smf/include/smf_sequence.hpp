@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "smf_source.hpp"
+
+namespace midi
+{
+    // An event as read from one track chunk
+    struct SmfTrackEvent
+    {
+        enum class Kind : uint8_t
+        {
+            Message, // Channel message in data/length
+            Tempo,   // Set Tempo meta event, tempo_us per quarter note
+        };
+
+        uint32_t tick;
+        Kind kind;
+        uint8_t data[3];
+        uint8_t length;
+        uint32_t tempo_us;
+    };
+
+    // Cursor over one MTrk chunk, reading the source through a small
+    // window. Handles delta times and running status; SysEx and meta events
+    // other than Set Tempo are skipped.
+    class SmfTrack
+    {
+    public:
+        static constexpr size_t kWindowSize = 32;
+
+        // Where the next event starts, enough to resume reading there
+        struct State
+        {
+            uint32_t offset;
+            uint32_t tick; // Of the previous event
+            uint8_t runningStatus;
+        };
+
+        void attach(const SmfSource *source, uint32_t begin, uint32_t end);
+        void restore(const State &state);
+        State state() const { return {offset, tick, runningStatus}; }
+        void rewind() { restore({begin, 0, 0}); }
+
+        // Next channel message or tempo change; false at End of Track, at the
+        // end of the chunk, or on malformed data (see malformed())
+        bool next(SmfTrackEvent &out);
+
+        bool malformed() const { return failed; }
+        uint32_t sysExSkipped() const { return sysex; }
+
+    private:
+        bool readByte(uint8_t &out);
+        bool readVarLen(uint32_t &out);
+        bool skip(uint32_t length);
+        bool fail();
+
+        const SmfSource *source = nullptr;
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        uint32_t offset = 0;
+        uint32_t tick = 0;
+        uint8_t runningStatus = 0;
+        bool failed = false;
+        uint32_t sysex = 0;
+
+        uint8_t window[kWindowSize];
+        uint32_t windowStart = 0;
+        uint32_t windowLength = 0;
+    };
+
+    // A channel message of the merged sequence
+    struct SmfEvent
+    {
+        uint32_t tick;
+        uint16_t track;
+        uint8_t data[3];
+        uint8_t length;
+    };
+
+    // Standard MIDI File (format 0 or 1) read as one time-ordered stream.
+    //
+    // Tracks are merged with a min-heap on (tick, track), so events at the
+    // same tick come out in track order. open() makes one pass over the
+    // file to build the tempo map and a seek index, then rewinds; nothing
+    // but one window per track is held in memory. Ticks convert to time
+    // with integer math only: each tempo segment keeps its start in units of
+    // 1/division us, so rounding never accumulates across tempo changes.
+    // Not thread-safe.
+    class SmfSequence
+    {
+    public:
+        static constexpr size_t kMaxSeekPoints = 64; // Snapshots of every track; the spacing doubles to fit
+
+        // False if the header is not a format 0 or 1 SMF
+        bool open(const SmfSource &source);
+
+        uint16_t format() const { return fileFormat; }
+        size_t trackCount() const { return cursors.size(); }
+        uint16_t division() const { return fileDivision; }
+
+        // Tick of the last event or End of Track
+        uint32_t lengthTicks() const { return length; }
+
+        // Time of `tick` from the start of the file
+        uint64_t tickToUs(uint32_t tick) const;
+
+        // Tick of a Song Position Pointer value (MIDI beats, 16th notes). For
+        // SMPTE time division a MIDI beat counts as 125 ms (120 BPM).
+        uint32_t songPositionTick(uint16_t midiBeats) const;
+
+        void rewind();
+
+        // Continue from the first event at or after `tick`, starting from the
+        // nearest seek point before it
+        void seek(uint32_t tick);
+
+        // Next channel message; false at the end
+        bool next(SmfEvent &out);
+
+        // Tick of the event next() returns next, lengthTicks() at the end
+        uint32_t position() const;
+
+        // Found by open()
+        uint32_t sysExSkipped() const { return sysex; }
+        uint32_t malformedTracks() const { return malformed; }
+
+    private:
+        struct Cursor
+        {
+            SmfTrack track;
+            SmfTrack::State before; // Track state ahead of `peeked`
+            SmfTrackEvent peeked;
+        };
+
+        struct TempoSegment
+        {
+            uint32_t tick;
+            uint32_t rate;  // us per quarter note (SMPTE: us per `scale` ticks)
+            uint64_t start; // Segment start in 1/scale us
+        };
+
+        bool later(uint16_t a, uint16_t b) const;
+        void prime(uint16_t index);
+        bool pop(SmfTrackEvent &out, uint16_t &track);
+        void setTempo(uint32_t tick, uint32_t tempo_us);
+        void addSeekPoint(uint32_t tick);
+
+        uint16_t fileFormat = 0;
+        uint16_t fileDivision = 0;
+        uint32_t length = 0;
+        uint32_t sysex = 0;
+        uint32_t malformed = 0;
+        uint32_t scale = 1; // Ticks per quarter note (SMPTE: per `rate` us)
+        bool smpte = false;
+
+        std::vector<Cursor> cursors;
+        std::vector<uint16_t> heap; // Cursors with an event peeked, earliest first
+
+        std::vector<TempoSegment> tempo;
+
+        uint32_t seekInterval = 0; // Ticks between seek points
+        std::vector<uint32_t> seekTicks;
+        std::vector<SmfTrack::State> seekStates; // trackCount() per seek point
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace midi
+{
+    // Random-access bytes of a Standard MIDI File. SmfSequence reads it
+    // through small per-track windows and never holds the whole file.
+    class SmfSource
+    {
+    public:
+        virtual ~SmfSource() = default;
+
+        virtual uint32_t size() const = 0;
+
+        // Copy `length` bytes from `offset`; false if out of range or the
+        // read failed
+        virtual bool read(uint32_t offset, uint8_t *out, size_t length) const = 0;
+    };
+
+    // A file already in the address space: a const array, an mmap()ed file
+    // on the host, or a flash region mapped with esp_partition_mmap()
+    class SmfMemorySource : public SmfSource
+    {
+    public:
+        SmfMemorySource(const uint8_t *data, uint32_t size) : data(data), length(size) {}
+
+        uint32_t size() const override { return length; }
+
+        bool read(uint32_t offset, uint8_t *out, size_t count) const override
+        {
+            if (offset > length || count > length - offset)
+                return false;
+            for (size_t i = 0; i < count; ++i)
+                out[i] = data[offset + i];
+            return true;
+        }
+
+    private:
+        const uint8_t *data;
+        uint32_t length;
+    };
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include "midi_hal.hpp"
+#include "midi_recorder.hpp"
+
+namespace midi
+{
+    // Receives a file in pieces, in order; returning false aborts the write
+    using SmfSink = std::function<bool(const uint8_t *data, size_t length)>;
+
+    // Writes what `recorder` holds as a format 1 Standard MIDI File: track 0
+    // has the recorded tempo changes (120 BPM if there are none), track 1
+    // the messages. Times become ticks at `division` per quarter note along
+    // that tempo map, so the file plays back at the recorded times. Each
+    // track is encoded twice, once to learn its length and once into the
+    // sink, so it streams through a small buffer with no seeking and no
+    // allocation. May run while recording; it covers what was published
+    // when it started.
+    bool writeSmf(const MidiRecorder &recorder, const SmfSink &sink, uint16_t division = 480);
+
+    // Runs writeSmf on its own task, so a slow sink (flash, a file) never
+    // holds up the receive path
+    class SmfExporter
+    {
+    public:
+        using DoneCallback = std::function<void(bool ok)>;
+
+        void start(unsigned priority = 1, uint32_t stack_bytes = 4096);
+
+        // Export `recorder` into `sink` and then call `done` on the exporter
+        // task. False if the previous export is still running.
+        bool request(const MidiRecorder &recorder, SmfSink sink, DoneCallback done, uint16_t division = 480);
+
+        bool busy() const { return running.load(std::memory_order_acquire); }
+
+    private:
+        void taskLoop();
+
+        hal::TaskHandle task = nullptr;
+        std::atomic<bool> running{false};
+
+        // Handed over by request() while the task is idle
+        const MidiRecorder *source = nullptr;
+        SmfSink sink;
+        DoneCallback done;
+        uint16_t division = 480;
+    };
+}
@@ -0,0 +1,24 @@
+#include "smf_partition_source.hpp"
+
+using namespace midi;
+
+SmfPartitionSource::SmfPartitionSource(const char *label)
+    : partition(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label))
+{
+}
+
+SmfPartitionSource::SmfPartitionSource(const esp_partition_t *partition) : partition(partition)
+{
+}
+
+uint32_t SmfPartitionSource::size() const
+{
+    return partition ? partition->size : 0;
+}
+
+bool SmfPartitionSource::read(uint32_t offset, uint8_t *out, size_t length) const
+{
+    if (!partition || offset > partition->size || length > partition->size - offset)
+        return false;
+    return esp_partition_read(partition, offset, out, length) == ESP_OK;
+}
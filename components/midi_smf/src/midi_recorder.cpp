@@ -0,0 +1,106 @@
+#include "midi_recorder.hpp"
+#include "midi_hal.hpp"
+
+using namespace midi;
+
+MidiRecorder::MidiRecorder(uint8_t *arena, size_t size) : arena(arena), size(size)
+{
+}
+
+void MidiRecorder::start(uint64_t now_us)
+{
+    active.store(false, std::memory_order_seq_cst);
+    // A record() that got in before is a few instructions from done; sleep
+    // rather than spin, it may be waiting for this core
+    while (busy.load(std::memory_order_seq_cst))
+        hal::sleepMs(1);
+
+    head = 0;
+    last_us = now_us;
+    runningStatus = 0;
+    lastTempo_us = 0;
+    committed.store(0, std::memory_order_relaxed);
+    recorded.store(0, std::memory_order_relaxed);
+    lost.store(0, std::memory_order_relaxed);
+    active.store(true, std::memory_order_seq_cst);
+}
+
+void MidiRecorder::stop()
+{
+    active.store(false, std::memory_order_seq_cst);
+}
+
+bool MidiRecorder::recordTempo(uint64_t timestamp_us, BpmQ16 bpm)
+{
+    if (!bpm)
+        return false;
+    uint64_t tempo = (60000000ull << 16) / bpm;
+    uint32_t tempo_us = tempo > 0xFFFFFF ? 0xFFFFFF : static_cast<uint32_t>(tempo); // SMF tempo is 24-bit
+    if (!enter())
+        return false;
+    uint32_t change = tempo_us > lastTempo_us ? tempo_us - lastTempo_us : lastTempo_us - tempo_us;
+    if (lastTempo_us && change * 1000ull <= lastTempo_us)
+    {
+        busy.store(false, std::memory_order_release);
+        return false;
+    }
+    if (size - head < kMaxRecordBytes)
+        return leave(false);
+
+    size_t at = putDelta(timestamp_us, head);
+    arena[at++] = 0xFF;
+    arena[at++] = static_cast<uint8_t>(tempo_us >> 16);
+    arena[at++] = static_cast<uint8_t>(tempo_us >> 8);
+    arena[at++] = static_cast<uint8_t>(tempo_us);
+    lastTempo_us = tempo_us;
+    return publish(at);
+}
+
+MidiRecorder::Reader::Reader(const MidiRecorder &recorder)
+    : arena(recorder.arena), end(recorder.bytesUsed())
+{
+}
+
+MidiRecorder::Reader::Reader(const MidiRecorder &recorder, size_t bytes)
+    : arena(recorder.arena), end(bytes)
+{
+}
+
+bool MidiRecorder::Reader::next(Entry &out)
+{
+    if (offset >= end)
+        return false;
+
+    uint64_t delta = 0;
+    uint8_t byte;
+    do
+    {
+        byte = arena[offset++];
+        delta = delta << 7 | (byte & 0x7F);
+    } while ((byte & 0x80) && offset < end);
+    time_us += delta;
+    out.time_us = time_us;
+
+    uint8_t status = arena[offset];
+    if (status == 0xFF)
+    {
+        out.tempo = true;
+        out.length = 0;
+        out.tempo_us = static_cast<uint32_t>(arena[offset + 1]) << 16 | arena[offset + 2] << 8 | arena[offset + 3];
+        offset += 4;
+        return true;
+    }
+    if (status & 0x80)
+    {
+        runningStatus = status;
+        offset++;
+    }
+    out.tempo = false;
+    out.data[0] = runningStatus;
+    out.data[1] = arena[offset++];
+    out.data[2] = 0;
+    out.length = (runningStatus & 0xE0) == 0xC0 ? 2 : 3;
+    if (out.length == 3)
+        out.data[2] = arena[offset++];
+    return true;
+}
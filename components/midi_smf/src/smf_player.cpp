@@ -0,0 +1,201 @@
+#include "smf_player.hpp"
+#include "midi_log.hpp"
+
+static const char *TAG = "SmfPlayer";
+using namespace midi;
+
+SmfPlayer::SmfPlayer(MidiOut &out, const SmfPlayerConfig &config) : out(out), config(config)
+{
+    lock.create();
+    timer.create([](void *arg)
+                 { static_cast<SmfPlayer *>(arg)->onTimer(); },
+                 this, "smf_player");
+}
+
+SmfPlayer::~SmfPlayer()
+{
+    timer.stop();
+}
+
+bool SmfPlayer::load(const SmfSource &source)
+{
+    lock.lock();
+    active = false;
+    releaseDue = false;
+    havePending = false;
+    timer.stop();
+    loaded = sequence.open(source);
+    if (loaded)
+    {
+        MIDI_LOGI(TAG, "Format %u, %u tracks, %u ticks, %u ms", sequence.format(), (unsigned)sequence.trackCount(),
+                  (unsigned)sequence.lengthTicks(), (unsigned)(sequence.tickToUs(sequence.lengthTicks()) / 1000));
+        if (sequence.malformedTracks() || sequence.sysExSkipped())
+            MIDI_LOGW(TAG, "%u malformed tracks, %u SysEx skipped", (unsigned)sequence.malformedTracks(),
+                      (unsigned)sequence.sysExSkipped());
+    }
+    lock.unlock();
+    return loaded;
+}
+
+void SmfPlayer::start()
+{
+    lock.lock();
+    if (loaded)
+    {
+        sequence.rewind();
+        havePending = false;
+        beginAt(0, hal::nowUs());
+    }
+    lock.unlock();
+}
+
+void SmfPlayer::resume()
+{
+    lock.lock();
+    if (loaded && !active)
+        beginAt(havePending ? pending.tick : sequence.position(), hal::nowUs());
+    lock.unlock();
+}
+
+void SmfPlayer::stop()
+{
+    lock.lock();
+    if (active)
+        halt(hal::nowUs());
+    lock.unlock();
+}
+
+void SmfPlayer::seek(uint16_t midiBeats)
+{
+    lock.lock();
+    if (loaded)
+    {
+        uint32_t tick = sequence.songPositionTick(midiBeats);
+        sequence.seek(tick);
+        havePending = false;
+        if (active)
+            beginAt(tick, hal::nowUs());
+    }
+    lock.unlock();
+}
+
+void SmfPlayer::onTransport(TransportEvent event)
+{
+    switch (event.command)
+    {
+    case TransportCommand::Start:
+        start();
+        break;
+    case TransportCommand::Continue:
+        resume();
+        break;
+    case TransportCommand::Stop:
+        stop();
+        break;
+    default:
+        break;
+    }
+}
+
+void SmfPlayer::onSongPosition(SongPosition event)
+{
+    seek(event.position);
+}
+
+bool SmfPlayer::playing() const
+{
+    lock.lock();
+    bool value = active;
+    lock.unlock();
+    return value;
+}
+
+uint32_t SmfPlayer::positionTicks() const
+{
+    lock.lock();
+    uint32_t tick = havePending ? pending.tick : sequence.position();
+    lock.unlock();
+    return tick;
+}
+
+// Called with lock held
+void SmfPlayer::beginAt(uint32_t tick, uint64_t now_us)
+{
+    origin_us = now_us + config.period_ms * 1000ull;
+    originOffset_us = sequence.tickToUs(tick);
+    lastDue_us = now_us;
+    active = true;
+    releaseDue = false;
+    fill(now_us);
+    if (!timer.active())
+        timer.startPeriodic(config.period_ms * 1000ull);
+}
+
+// Called with lock held. Held notes are released one period after the last
+// scheduled event, once MidiOut has queued it: releaseHeldNotes() runs
+// ahead of the queue.
+void SmfPlayer::halt(uint64_t now_us)
+{
+    active = false;
+    releaseDue = true;
+    releaseAt_us = (lastDue_us > now_us ? lastDue_us : now_us) + config.period_ms * 1000ull;
+}
+
+// Called with lock held
+uint64_t SmfPlayer::timeOf(uint32_t tick) const
+{
+    return origin_us + sequence.tickToUs(tick) - originOffset_us;
+}
+
+// Called with lock held
+void SmfPlayer::fill(uint64_t now_us)
+{
+    uint64_t horizon_us = now_us + config.lookahead_ms * 1000ull;
+    bool wrapped = false;
+    while (active)
+    {
+        if (!havePending)
+        {
+            if (!sequence.next(pending))
+            {
+                if (!config.loop || wrapped)
+                {
+                    halt(now_us);
+                    break;
+                }
+                // The next pass starts where this one ends
+                origin_us = timeOf(sequence.lengthTicks());
+                originOffset_us = 0;
+                sequence.rewind();
+                wrapped = true; // A file without events must not spin here
+                continue;
+            }
+            havePending = true;
+            wrapped = false;
+        }
+
+        uint64_t due_us = timeOf(pending.tick);
+        if (due_us > horizon_us || !out.sendAt(due_us, pending.data, pending.length))
+            break; // Not due yet, or the schedule is full: retry next period
+        havePending = false;
+        if (due_us > lastDue_us)
+            lastDue_us = due_us;
+    }
+}
+
+void SmfPlayer::onTimer()
+{
+    uint64_t now_us = hal::nowUs();
+    lock.lock();
+    if (active)
+        fill(now_us);
+    bool release = releaseDue && now_us >= releaseAt_us;
+    if (release)
+        releaseDue = false;
+    if (!active && !releaseDue)
+        timer.stop();
+    lock.unlock();
+
+    if (release)
+        out.releaseHeldNotes();
+}
@@ -0,0 +1,407 @@
+#include "smf_sequence.hpp"
+#include <algorithm>
+
+using namespace midi;
+
+namespace
+{
+    constexpr uint32_t kDefaultTempoUs = 500000; // 120 BPM until the first Set Tempo
+
+    uint32_t readBig(const uint8_t *bytes, size_t count)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < count; ++i)
+            value = value << 8 | bytes[i];
+        return value;
+    }
+}
+
+// ---- SmfTrack ------------------------------------------------------------
+
+void SmfTrack::attach(const SmfSource *src, uint32_t first, uint32_t last)
+{
+    source = src;
+    begin = first;
+    end = last;
+    failed = false;
+    sysex = 0;
+    rewind();
+}
+
+void SmfTrack::restore(const State &state)
+{
+    offset = state.offset;
+    tick = state.tick;
+    runningStatus = state.runningStatus;
+    windowLength = 0;
+}
+
+bool SmfTrack::fail()
+{
+    failed = true;
+    offset = end;
+    return false;
+}
+
+bool SmfTrack::readByte(uint8_t &out)
+{
+    if (offset >= end)
+        return false;
+    if (offset < windowStart || offset - windowStart >= windowLength)
+    {
+        uint32_t count = std::min<uint32_t>(kWindowSize, end - offset);
+        if (!source->read(offset, window, count))
+            return false;
+        windowStart = offset;
+        windowLength = count;
+    }
+    out = window[offset++ - windowStart];
+    return true;
+}
+
+bool SmfTrack::readVarLen(uint32_t &out)
+{
+    out = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        uint8_t byte;
+        if (!readByte(byte))
+            return false;
+        out = out << 7 | (byte & 0x7F);
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false; // Longer than the 4 bytes SMF allows
+}
+
+bool SmfTrack::skip(uint32_t length)
+{
+    if (length > end - offset)
+        return false;
+    offset += length;
+    return true;
+}
+
+bool SmfTrack::next(SmfTrackEvent &out)
+{
+    while (offset < end)
+    {
+        uint32_t delta;
+        uint8_t status;
+        if (!readVarLen(delta) || !readByte(status))
+            return fail();
+        tick += delta;
+
+        uint8_t data1 = 0;
+        bool haveData1 = false;
+        if (status < 0x80)
+        {
+            if (!runningStatus)
+                return fail();
+            data1 = status;
+            haveData1 = true;
+            status = runningStatus;
+        }
+
+        if (status < 0xF0)
+        {
+            runningStatus = status;
+            out.tick = tick;
+            out.kind = SmfTrackEvent::Kind::Message;
+            out.data[0] = status;
+            out.length = (status & 0xE0) == 0xC0 ? 2 : 3; // Program change, channel pressure
+            if (!haveData1 && !readByte(data1))
+                return fail();
+            out.data[1] = data1;
+            out.data[2] = 0;
+            if (out.length == 3 && !readByte(out.data[2]))
+                return fail();
+            if ((out.data[1] | out.data[2]) & 0x80)
+                return fail();
+            return true;
+        }
+
+        // SysEx and meta events cancel running status
+        runningStatus = 0;
+        if (status == 0xFF)
+        {
+            uint8_t type;
+            uint32_t length;
+            if (!readByte(type) || !readVarLen(length))
+                return fail();
+            if (type == 0x2F) // End of Track
+            {
+                offset = end;
+                return false;
+            }
+            if (type == 0x51 && length == 3)
+            {
+                uint8_t bytes[3];
+                for (uint8_t &byte : bytes)
+                {
+                    if (!readByte(byte))
+                        return fail();
+                }
+                out.tick = tick;
+                out.kind = SmfTrackEvent::Kind::Tempo;
+                out.length = 0;
+                out.tempo_us = readBig(bytes, 3);
+                return true;
+            }
+            if (!skip(length))
+                return fail();
+        }
+        else if (status == 0xF0 || status == 0xF7)
+        {
+            uint32_t length;
+            if (!readVarLen(length) || !skip(length))
+                return fail();
+            sysex++;
+        }
+        else
+        {
+            return fail(); // System common and real-time have no place in a file
+        }
+    }
+    return false;
+}
+
+// ---- SmfSequence ---------------------------------------------------------
+
+bool SmfSequence::open(const SmfSource &source)
+{
+    cursors.clear();
+    heap.clear();
+    tempo.clear();
+    seekTicks.clear();
+    seekStates.clear();
+    length = 0;
+    sysex = 0;
+    malformed = 0;
+
+    uint8_t header[14];
+    if (!source.read(0, header, sizeof(header)) || readBig(header, 4) != 0x4D546864) // "MThd"
+        return false;
+    uint32_t headerLength = readBig(header + 4, 4);
+    fileFormat = static_cast<uint16_t>(readBig(header + 8, 2));
+    uint16_t tracks = static_cast<uint16_t>(readBig(header + 10, 2));
+    fileDivision = static_cast<uint16_t>(readBig(header + 12, 2));
+    if (headerLength < 6 || fileFormat > 1 || (fileFormat == 0 && tracks != 1) || fileDivision == 0)
+        return false;
+
+    smpte = fileDivision & 0x8000;
+    if (smpte)
+    {
+        // High byte: -24, -25, -29 (29.97 drop frame) or -30; low byte: ticks per frame
+        uint32_t fps = static_cast<uint8_t>(-static_cast<int8_t>(fileDivision >> 8));
+        uint32_t perFrame = fileDivision & 0xFF;
+        if (!fps || !perFrame)
+            return false;
+        bool dropFrame = fps == 29;
+        scale = (dropFrame ? 2997 : fps) * perFrame;
+        tempo.push_back({0, dropFrame ? 100000000u : 1000000u, 0});
+    }
+    else
+    {
+        scale = fileDivision;
+        tempo.push_back({0, kDefaultTempoUs, 0});
+    }
+
+    // Track chunks, skipping chunk types we don't know
+    uint32_t offset = 8 + headerLength;
+    cursors.reserve(tracks);
+    while (cursors.size() < tracks && source.size() >= 8 && offset <= source.size() - 8)
+    {
+        uint8_t chunk[8];
+        if (!source.read(offset, chunk, sizeof(chunk)))
+            break;
+        uint32_t begin = offset + 8;
+        uint32_t chunkLength = readBig(chunk + 4, 4);
+        uint32_t end = chunkLength > source.size() - begin ? source.size() : begin + chunkLength;
+        if (readBig(chunk, 4) == 0x4D54726B) // "MTrk"
+        {
+            cursors.emplace_back();
+            cursors.back().track.attach(&source, begin, end);
+        }
+        offset = end;
+    }
+    if (cursors.empty())
+        return false;
+
+    // One pass in time order: tempo changes and seek points
+    seekInterval = smpte ? static_cast<uint32_t>(static_cast<uint64_t>(scale) * 1000000 / tempo.front().rate)
+                         : fileDivision; // A second, or a quarter note
+    uint32_t nextSeekTick = 0;
+    rewind();
+    while (!heap.empty())
+    {
+        uint32_t tick = cursors[heap.front()].peeked.tick;
+        if (tick >= nextSeekTick)
+        {
+            addSeekPoint(tick);
+            nextSeekTick = (tick / seekInterval + 1) * seekInterval;
+        }
+
+        SmfTrackEvent event;
+        uint16_t track;
+        pop(event, track);
+        if (event.kind == SmfTrackEvent::Kind::Tempo && !smpte)
+            setTempo(event.tick, event.tempo_us);
+    }
+    for (Cursor &cursor : cursors)
+    {
+        length = std::max(length, cursor.track.state().tick);
+        sysex += cursor.track.sysExSkipped();
+        if (cursor.track.malformed())
+            malformed++;
+    }
+
+    rewind();
+    return true;
+}
+
+void SmfSequence::setTempo(uint32_t tick, uint32_t tempo_us)
+{
+    if (!tempo_us)
+        return;
+    TempoSegment &last = tempo.back();
+    if (tick == last.tick)
+    {
+        last.rate = tempo_us; // Several at one tick: the last one holds
+        return;
+    }
+    uint64_t start = last.start + static_cast<uint64_t>(tick - last.tick) * last.rate;
+    tempo.push_back({tick, tempo_us, start});
+}
+
+void SmfSequence::addSeekPoint(uint32_t tick)
+{
+    if (seekTicks.size() == kMaxSeekPoints)
+    {
+        // Keep every other point and space the next ones twice as far apart
+        size_t tracks = cursors.size();
+        size_t kept = 0;
+        for (size_t i = 0; i < seekTicks.size(); i += 2, ++kept)
+        {
+            seekTicks[kept] = seekTicks[i];
+            std::copy_n(seekStates.begin() + i * tracks, tracks, seekStates.begin() + kept * tracks);
+        }
+        seekTicks.resize(kept);
+        seekStates.resize(kept * tracks);
+        seekInterval *= 2;
+        if (tick < (seekTicks.back() / seekInterval + 1) * seekInterval)
+            return;
+    }
+
+    seekTicks.push_back(tick);
+    for (const Cursor &cursor : cursors)
+        seekStates.push_back(cursor.before);
+}
+
+uint64_t SmfSequence::tickToUs(uint32_t tick) const
+{
+    auto segment = std::upper_bound(tempo.begin(), tempo.end(), tick,
+                                    [](uint32_t t, const TempoSegment &s)
+                                    { return t < s.tick; }) -
+                   1;
+    return (segment->start + static_cast<uint64_t>(tick - segment->tick) * segment->rate) / scale;
+}
+
+uint32_t SmfSequence::songPositionTick(uint16_t midiBeats) const
+{
+    if (smpte)
+        return static_cast<uint32_t>(static_cast<uint64_t>(midiBeats) * 125000 * scale / tempo.front().rate);
+    return static_cast<uint32_t>(static_cast<uint64_t>(midiBeats) * fileDivision / 4);
+}
+
+// std heaps keep the greatest element first; "greater" here means later,
+// so the front is the earliest event, ties going to the lower track
+bool SmfSequence::later(uint16_t a, uint16_t b) const
+{
+    uint32_t tickA = cursors[a].peeked.tick;
+    uint32_t tickB = cursors[b].peeked.tick;
+    return tickA != tickB ? tickA > tickB : a > b;
+}
+
+void SmfSequence::prime(uint16_t index)
+{
+    Cursor &cursor = cursors[index];
+    cursor.before = cursor.track.state();
+    if (!cursor.track.next(cursor.peeked))
+        return;
+
+    heap.push_back(index);
+    std::push_heap(heap.begin(), heap.end(), [this](uint16_t a, uint16_t b)
+                   { return later(a, b); });
+}
+
+bool SmfSequence::pop(SmfTrackEvent &out, uint16_t &track)
+{
+    if (heap.empty())
+        return false;
+    std::pop_heap(heap.begin(), heap.end(), [this](uint16_t a, uint16_t b)
+                  { return later(a, b); });
+    track = heap.back();
+    heap.pop_back();
+    out = cursors[track].peeked;
+    prime(track);
+    return true;
+}
+
+void SmfSequence::rewind()
+{
+    heap.clear();
+    for (uint16_t i = 0; i < cursors.size(); ++i)
+    {
+        cursors[i].track.rewind();
+        prime(i);
+    }
+}
+
+void SmfSequence::seek(uint32_t tick)
+{
+    auto point = std::upper_bound(seekTicks.begin(), seekTicks.end(), tick);
+    if (point == seekTicks.begin())
+    {
+        rewind();
+    }
+    else
+    {
+        size_t base = (point - seekTicks.begin() - 1) * cursors.size();
+        heap.clear();
+        for (uint16_t i = 0; i < cursors.size(); ++i)
+        {
+            cursors[i].track.restore(seekStates[base + i]);
+            prime(i);
+        }
+    }
+
+    SmfTrackEvent event;
+    uint16_t track;
+    while (!heap.empty() && cursors[heap.front()].peeked.tick < tick)
+        pop(event, track);
+}
+
+bool SmfSequence::next(SmfEvent &out)
+{
+    SmfTrackEvent event;
+    uint16_t track;
+    while (pop(event, track))
+    {
+        if (event.kind != SmfTrackEvent::Kind::Message)
+            continue;
+        out.tick = event.tick;
+        out.track = track;
+        out.data[0] = event.data[0];
+        out.data[1] = event.data[1];
+        out.data[2] = event.data[2];
+        out.length = event.length;
+        return true;
+    }
+    return false;
+}
+
+uint32_t SmfSequence::position() const
+{
+    return heap.empty() ? length : cursors[heap.front()].peeked.tick;
+}
@@ -0,0 +1,250 @@
+#include "smf_writer.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr uint32_t kDefaultTempoUs = 500000;
+    constexpr uint32_t kMaxDeltaTicks = 0x0FFFFFFF; // Largest 4-byte SMF delta
+
+    // Microseconds since the start of the take to ticks, along the tempo
+    // map as it is read. A tempo change lands on a whole tick, and the new
+    // segment starts at that tick's time in the file (kept in 1/division
+    // us, as a reader computes it), so rounding never adds up across
+    // changes: every event is within one tick of its recorded time.
+    class TempoClock
+    {
+    public:
+        TempoClock(uint16_t division, uint32_t tempo_us) : division(division), tempo_us(tempo_us) {}
+
+        uint64_t tick(uint64_t time_us) const
+        {
+            return segmentTick + (time_us * division - segmentStart) / tempo_us;
+        }
+
+        // False if `tempo` is already in effect
+        bool setTempo(uint64_t time_us, uint32_t tempo)
+        {
+            if (tempo == tempo_us)
+                return false;
+            uint64_t at = tick(time_us);
+            segmentStart += (at - segmentTick) * tempo_us;
+            segmentTick = at;
+            tempo_us = tempo;
+            return true;
+        }
+
+    private:
+        uint16_t division;
+        uint32_t tempo_us;
+        uint64_t segmentStart = 0; // In 1/division us
+        uint64_t segmentTick = 0;
+    };
+
+    // Track byte output: counting only, or buffered into the sink
+    class TrackOut
+    {
+    public:
+        explicit TrackOut(const SmfSink *sink = nullptr) : sink(sink) {}
+
+        void put(uint8_t byte)
+        {
+            count++;
+            if (!sink)
+                return;
+            buffer[used++] = byte;
+            if (used == sizeof(buffer))
+                flush();
+        }
+
+        void putDelta(uint64_t &previousTick, uint64_t tick)
+        {
+            uint64_t delta = tick - previousTick;
+            uint32_t value = delta > kMaxDeltaTicks ? kMaxDeltaTicks : static_cast<uint32_t>(delta);
+            previousTick += value;
+            uint8_t groups[4];
+            size_t n = 0;
+            do
+            {
+                groups[n++] = value & 0x7F;
+                value >>= 7;
+            } while (value);
+            while (n > 1)
+                put(groups[--n] | 0x80);
+            put(groups[0]);
+        }
+
+        void putTempo(uint32_t tempo_us)
+        {
+            put(0xFF);
+            put(0x51);
+            put(3);
+            put(static_cast<uint8_t>(tempo_us >> 16));
+            put(static_cast<uint8_t>(tempo_us >> 8));
+            put(static_cast<uint8_t>(tempo_us));
+        }
+
+        void putEnd()
+        {
+            put(0xFF);
+            put(0x2F);
+            put(0);
+        }
+
+        bool flush()
+        {
+            if (sink && used && ok)
+                ok = (*sink)(buffer, used);
+            used = 0;
+            return ok;
+        }
+
+        uint32_t length() const { return count; }
+
+    private:
+        const SmfSink *sink;
+        uint8_t buffer[64];
+        size_t used = 0;
+        uint32_t count = 0;
+        bool ok = true;
+    };
+
+    struct Take
+    {
+        const MidiRecorder &recorder;
+        size_t bytes;           // Arena bytes covered
+        uint16_t division;
+        uint32_t firstTempo_us; // In effect from the start
+        uint64_t endTick;
+    };
+
+    // Track 0: tempo map; track 1: messages. Both end at the same tick.
+    void encodeTrack(const Take &take, int track, TrackOut &out)
+    {
+        TempoClock clock(take.division, take.firstTempo_us);
+        MidiRecorder::Reader reader(take.recorder, take.bytes);
+        MidiRecorder::Entry entry;
+        uint64_t previousTick = 0;
+        uint8_t runningStatus = 0;
+
+        if (track == 0)
+        {
+            out.put(0);
+            out.putTempo(take.firstTempo_us);
+        }
+        while (reader.next(entry))
+        {
+            if (entry.tempo)
+            {
+                if (clock.setTempo(entry.time_us, entry.tempo_us) && track == 0)
+                {
+                    out.putDelta(previousTick, clock.tick(entry.time_us));
+                    out.putTempo(entry.tempo_us);
+                }
+                continue;
+            }
+            if (track != 1)
+                continue;
+            out.putDelta(previousTick, clock.tick(entry.time_us));
+            if (entry.data[0] != runningStatus)
+            {
+                out.put(entry.data[0]);
+                runningStatus = entry.data[0];
+            }
+            for (uint8_t i = 1; i < entry.length; ++i)
+                out.put(entry.data[i]);
+        }
+        out.putDelta(previousTick, take.endTick);
+        out.putEnd();
+    }
+}
+
+bool midi::writeSmf(const MidiRecorder &recorder, const SmfSink &sink, uint16_t division)
+{
+    if (!division || division & 0x8000)
+        return false;
+
+    // First tempo and last tick
+    Take take{recorder, recorder.bytesUsed(), division, kDefaultTempoUs, 0};
+    TempoClock clock(division, kDefaultTempoUs);
+    MidiRecorder::Reader reader(recorder, take.bytes);
+    MidiRecorder::Entry entry;
+    bool haveTempo = false;
+    uint64_t last_us = 0;
+    while (reader.next(entry))
+    {
+        if (entry.tempo && !haveTempo)
+        {
+            take.firstTempo_us = entry.tempo_us;
+            clock = TempoClock(division, entry.tempo_us);
+            haveTempo = true;
+        }
+        else if (entry.tempo)
+        {
+            clock.setTempo(entry.time_us, entry.tempo_us);
+        }
+        last_us = entry.time_us;
+    }
+    take.endTick = clock.tick(last_us);
+
+    const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2,
+                              static_cast<uint8_t>(division >> 8), static_cast<uint8_t>(division)};
+    if (!sink(header, sizeof(header)))
+        return false;
+
+    for (int track = 0; track < 2; ++track)
+    {
+        TrackOut counter;
+        encodeTrack(take, track, counter);
+        uint32_t length = counter.length();
+        const uint8_t chunk[] = {'M', 'T', 'r', 'k', static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+                                 static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length)};
+        if (!sink(chunk, sizeof(chunk)))
+            return false;
+
+        TrackOut out(&sink);
+        encodeTrack(take, track, out);
+        if (!out.flush())
+            return false;
+    }
+    return true;
+}
+
+void SmfExporter::start(unsigned priority, uint32_t stack_bytes)
+{
+    if (task)
+        return;
+    task = hal::startTask([](void *arg)
+                          { static_cast<SmfExporter *>(arg)->taskLoop(); },
+                          this, "smf_export", stack_bytes, priority);
+}
+
+bool SmfExporter::request(const MidiRecorder &recorder, SmfSink output, DoneCallback callback, uint16_t ppq)
+{
+    if (!task || running.exchange(true, std::memory_order_acq_rel))
+        return false;
+    source = &recorder;
+    sink = std::move(output);
+    done = std::move(callback);
+    division = ppq;
+    hal::notify(task);
+    return true;
+}
+
+void SmfExporter::taskLoop()
+{
+    while (true)
+    {
+        hal::waitForNotify(hal::kForever);
+        if (!running.load(std::memory_order_acquire))
+            continue;
+
+        bool ok = writeSmf(*source, sink, division);
+        DoneCallback callback = std::move(done);
+        sink = nullptr;
+        done = nullptr;
+        running.store(false, std::memory_order_release);
+        if (callback)
+            callback(ok);
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace midi
+{
+    namespace bench
+    {
+        // Heap allocations made by this process so far. Counted by the
+        // replacement operator new in bench_alloc.cpp, linked into every
+        // benchmark.
+        uint64_t allocations();
+
+        // Keeps a result alive so the optimiser can't drop the work behind it
+        inline void keep(uint64_t value)
+        {
+            static volatile uint64_t sink;
+            sink = sink + value;
+        }
+
+        struct Result
+        {
+            std::string workload;
+            std::string stage;
+            size_t bytes = 0;    // Input bytes per pass (0 when the stage has no byte input)
+            size_t messages = 0; // Messages per pass
+            uint32_t passes = 0;
+            double median_ns = 0; // Per pass
+            double best_ns = 0;
+            double allocs_per_message = 0;
+            double bytes_per_read = 0; // MidiIn stages: MidiInStats::bytesPerRead()
+
+            double nsPerByte() const { return bytes ? median_ns / bytes : 0.0; }
+            double nsPerMessage() const { return messages ? median_ns / messages : 0.0; }
+        };
+
+        // Runs `pass` once to warm up and count allocations, then repeatedly
+        // until `min_time_ms` has passed (at least 5 passes). Reports the
+        // median and best pass.
+        template <typename Pass>
+        Result measure(const std::string &workload, const std::string &stage,
+                       size_t bytes, size_t messages, uint32_t min_time_ms, Pass &&pass)
+        {
+            using Clock = std::chrono::steady_clock;
+
+            Result result;
+            result.workload = workload;
+            result.stage = stage;
+            result.bytes = bytes;
+            result.messages = messages;
+
+            uint64_t before = allocations();
+            pass();
+            uint64_t allocated = allocations() - before;
+            result.allocs_per_message = messages ? static_cast<double>(allocated) / messages : 0.0;
+
+            std::vector<double> times;
+            Clock::time_point start = Clock::now();
+            while (times.size() < 5 || Clock::now() - start < std::chrono::milliseconds(min_time_ms))
+            {
+                Clock::time_point begin = Clock::now();
+                pass();
+                times.push_back(std::chrono::duration<double, std::nano>(Clock::now() - begin).count());
+            }
+
+            std::sort(times.begin(), times.end());
+            result.passes = static_cast<uint32_t>(times.size());
+            result.median_ns = times[times.size() / 2];
+            result.best_ns = times.front();
+            return result;
+        }
+
+        // Human-readable table, one line per result
+        inline void printTable(std::FILE *out, const std::vector<Result> &results)
+        {
+            std::fprintf(out, "%-16s %-20s %9s %9s %10s %12s %10s %10s\n",
+                         "workload", "stage", "bytes", "messages", "ns/byte", "ns/message", "allocs/msg", "bytes/read");
+            for (const Result &r : results)
+            {
+                std::fprintf(out, "%-16s %-20s %9zu %9zu %10.2f %12.2f %10.3f",
+                             r.workload.c_str(), r.stage.c_str(), r.bytes, r.messages,
+                             r.nsPerByte(), r.nsPerMessage(), r.allocs_per_message);
+                if (r.bytes_per_read > 0)
+                    std::fprintf(out, " %10.1f\n", r.bytes_per_read);
+                else
+                    std::fprintf(out, " %10s\n", "-");
+            }
+        }
+
+        // Machine-readable results for regression tracking. Names are plain
+        // identifiers, so no string escaping is needed.
+        inline void writeJson(std::FILE *out, const char *suite, const std::vector<Result> &results)
+        {
+            std::fprintf(out, "{\n  \"suite\": \"%s\",\n  \"schema\": 1,\n", suite);
+#ifdef MIDI_BENCH_BUILD_TYPE
+            std::fprintf(out, "  \"build_type\": \"%s\",\n", MIDI_BENCH_BUILD_TYPE);
+#endif
+            std::fprintf(out, "  \"compiler\": \"%s\",\n  \"results\": [\n", __VERSION__);
+            for (size_t i = 0; i < results.size(); ++i)
+            {
+                const Result &r = results[i];
+                std::fprintf(out,
+                             "    {\"workload\": \"%s\", \"stage\": \"%s\", \"bytes\": %zu, \"messages\": %zu, "
+                             "\"passes\": %u, \"median_ns\": %.0f, \"best_ns\": %.0f, "
+                             "\"ns_per_byte\": %.3f, \"ns_per_message\": %.3f, \"allocs_per_message\": %.4f, "
+                             "\"bytes_per_read\": %.2f}%s\n",
+                             r.workload.c_str(), r.stage.c_str(), r.bytes, r.messages,
+                             r.passes, r.median_ns, r.best_ns,
+                             r.nsPerByte(), r.nsPerMessage(), r.allocs_per_message, r.bytes_per_read,
+                             i + 1 < results.size() ? "," : "");
+            }
+            std::fprintf(out, "  ]\n}\n");
+        }
+    }
+}
@@ -0,0 +1,50 @@
+// Counting replacements for the global allocation functions, so benchmarks
+// can report allocations per message. Only the throwing forms are replaced:
+// the others forward to them.
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "bench.hpp"
+
+namespace
+{
+    std::atomic<uint64_t> allocationCount{0};
+}
+
+uint64_t midi::bench::allocations()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
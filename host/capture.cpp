@@ -0,0 +1,67 @@
+#include "capture.hpp"
+#include <cstdio>
+#include <cstring>
+#include "midi_protocol.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr char kMagic[8] = {'M', 'I', 'D', 'I', 'C', 'A', 'P', '1'};
+}
+
+bool midi::loadCapture(const std::string &path, Capture &out)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + read);
+    std::fclose(file);
+
+    out.clear();
+    uint64_t time_us = 0;
+    if (data.size() >= sizeof(kMagic) && std::memcmp(data.data(), kMagic, sizeof(kMagic)) == 0)
+    {
+        size_t offset = sizeof(kMagic);
+        for (; offset + 5 <= data.size(); offset += 5)
+        {
+            const uint8_t *record = &data[offset];
+            time_us += static_cast<uint32_t>(record[0]) | static_cast<uint32_t>(record[1]) << 8 |
+                       static_cast<uint32_t>(record[2]) << 16 | static_cast<uint32_t>(record[3]) << 24;
+            out.push_back(hal::WireByte{record[4], time_us});
+        }
+        return offset == data.size();
+    }
+
+    for (uint8_t byte : data)
+    {
+        time_us += MIDI_BYTE_TIME_US;
+        out.push_back(hal::WireByte{byte, time_us});
+    }
+    return true;
+}
+
+bool midi::saveCapture(const std::string &path, const Capture &capture)
+{
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = std::fwrite(kMagic, 1, sizeof(kMagic), file) == sizeof(kMagic);
+    uint64_t previous_us = capture.empty() ? 0 : capture.front().time_us;
+    for (const hal::WireByte &byte : capture)
+    {
+        uint64_t delta = byte.time_us - previous_us;
+        uint32_t delta_us = delta > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(delta);
+        uint8_t record[5] = {static_cast<uint8_t>(delta_us), static_cast<uint8_t>(delta_us >> 8),
+                             static_cast<uint8_t>(delta_us >> 16), static_cast<uint8_t>(delta_us >> 24), byte.byte};
+        ok = ok && std::fwrite(record, 1, sizeof(record), file) == sizeof(record);
+        previous_us = byte.time_us;
+    }
+    return std::fclose(file) == 0 && ok;
+}
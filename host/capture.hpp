@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "virtual_uart.hpp"
+
+namespace midi
+{
+    // Recorded MIDI byte streams, for replaying a workload exactly.
+    //
+    // A capture file starts with the 8-byte magic "MIDICAP1", followed by
+    // one record per byte: the time since the previous byte in microseconds
+    // (uint32, little endian) and the byte itself. Any other file is taken
+    // as a raw byte dump (e.g. from `amidi --receive`), and its bytes are
+    // stamped back to back at wire speed.
+    using Capture = std::vector<hal::WireByte>;
+
+    // False when the file can't be opened or a record is cut short
+    bool loadCapture(const std::string &path, Capture &out);
+    bool saveCapture(const std::string &path, const Capture &capture);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+
+namespace midi
+{
+    namespace check
+    {
+        struct Counts
+        {
+            uint32_t checks = 0;
+            uint32_t failed = 0;
+        };
+
+        inline Counts &counts()
+        {
+            static Counts c;
+            return c;
+        }
+
+        inline bool expect(bool ok, const char *what, const char *file, int line)
+        {
+            counts().checks++;
+            if (!ok)
+            {
+                counts().failed++;
+                std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+            }
+            return ok;
+        }
+
+        inline bool expectEqual(uint64_t actual, uint64_t expected, const char *what, const char *file, int line)
+        {
+            counts().checks++;
+            if (actual != expected)
+            {
+                counts().failed++;
+                std::fprintf(stderr, "%s:%d: check failed: %s is %" PRIu64 ", expected %" PRIu64 "\n",
+                             file, line, what, actual, expected);
+            }
+            return actual == expected;
+        }
+
+        // Summary line on stderr; the process exit code (0 = all passed)
+        inline int finish(const char *name)
+        {
+            std::fprintf(stderr, "%s: %u checks, %u failed\n", name, counts().checks, counts().failed);
+            return counts().failed ? 1 : 0;
+        }
+    }
+}
+
+// Host tests: a failed check is reported and counted, the test carries on
+#define CHECK(condition) ::midi::check::expect((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) ::midi::check::expectEqual((actual), (expected), #actual, __FILE__, __LINE__)
@@ -0,0 +1,144 @@
+// Clock regeneration under input jitter: upstream 0xF8 ticks at 120 BPM,
+// each off its ideal time by up to +-1.5 ms and stamped at a byte time.
+//
+// ClockPll alone: the smoothed time of every tick, taken before the tick
+// arrives as MidiClockFollower aims its timer, must be steadier than the
+// input once the loop has narrowed. MidiClockFollower end to end: the
+// regenerated ticks read back from the virtual UART must beat the input
+// too. The host timer wakes late now and then, so that half compares
+// medians, not worst cases.
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "check.hpp"
+#include "clock_pll.hpp"
+#include "midi_clock_follower.hpp"
+#include "midi_hal.hpp"
+#include "midi_out.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr hal::UartPort kOutPort = 0;
+    constexpr double kPeriodUs = 60e6 / (120.0 * MIDI_CLOCKS_PER_BEAT);
+    constexpr int32_t kJitterUs = 1500;
+
+    // `count` jittered, byte-quantized tick times from `start_us`
+    std::vector<uint64_t> clockTicks(uint32_t count, uint64_t start_us)
+    {
+        std::mt19937 random(17);
+        std::uniform_int_distribution<int32_t> jitter(-kJitterUs, kJitterUs);
+        std::vector<uint64_t> ticks;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            int64_t at = static_cast<int64_t>(start_us + i * kPeriodUs) + jitter(random);
+            ticks.push_back(static_cast<uint64_t>(at) / MIDI_BYTE_TIME_US * MIDI_BYTE_TIME_US);
+        }
+        return ticks;
+    }
+
+    // Deviation of each interval from the ideal period, sorted
+    std::vector<double> intervalErrors(const std::vector<uint64_t> &times)
+    {
+        std::vector<double> errors;
+        for (size_t i = 1; i < times.size(); ++i)
+            errors.push_back(std::fabs(static_cast<double>(times[i] - times[i - 1]) - kPeriodUs));
+        std::sort(errors.begin(), errors.end());
+        return errors;
+    }
+
+    double mean(const std::vector<double> &values)
+    {
+        double sum = 0;
+        for (double value : values)
+            sum += value;
+        return values.empty() ? 0 : sum / values.size();
+    }
+
+    void pllSmoothsTicks()
+    {
+        const uint32_t kSettle = 4 * ClockPll::kDefaultTimeConstant;
+        std::vector<uint64_t> ticks = clockTicks(kSettle + 480, 1000000);
+        ClockPll pll;
+        std::vector<uint64_t> input;
+        std::vector<uint64_t> output;
+        for (uint32_t i = 0; i < ticks.size(); ++i)
+        {
+            if (i >= kSettle && pll.locked())
+            {
+                output.push_back(pll.tickTime(pll.ticksReceived()));
+                input.push_back(ticks[i]);
+            }
+            pll.addTick(ticks[i]);
+        }
+
+        std::vector<double> in = intervalErrors(input);
+        std::vector<double> out = intervalErrors(output);
+        std::fprintf(stderr, "pll       interval error  input mean %6.1f us max %6.1f us  output mean %6.1f us max %6.1f us\n",
+                     mean(in), in.back(), mean(out), out.back());
+        CHECK_EQ(pll.relockCount(), 0);
+        CHECK(mean(out) * 10 < mean(in));
+        CHECK(out.back() * 10 < in.back());
+    }
+
+    void followerSmoothsWire()
+    {
+        // Never destroyed: its tasks outlive main() (see hal::startTask)
+        static MidiOut &out = *new MidiOut(MidiOutConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = kOutPort});
+        out.init();
+        MidiClockFollower follower(out, 24);
+        follower.begin();
+
+        // 5 s of upstream clock; the first two seconds let the loop settle
+        const uint64_t start_us = hal::nowUs() + 10000;
+        const uint64_t settle_us = start_us + 2000000;
+        std::vector<uint64_t> ticks = clockTicks(240, start_us);
+        std::vector<uint64_t> input;
+        for (uint64_t tick_us : ticks)
+        {
+            while (hal::nowUs() < tick_us)
+                hal::sleepMs(1);
+            follower.onClockTick(tick_us);
+            if (tick_us >= settle_us)
+                input.push_back(tick_us);
+        }
+        hal::sleepMs(100);
+        follower.end();
+
+        std::vector<uint64_t> output;
+        hal::WireByte wire[256];
+        size_t n;
+        while ((n = hal::captureUart(kOutPort, wire, 256)) > 0)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (wire[i].byte == 0xF8 && wire[i].time_us >= settle_us)
+                    output.push_back(wire[i].time_us);
+            }
+        }
+
+        std::vector<double> in = intervalErrors(input);
+        std::vector<double> regenerated = intervalErrors(output);
+        MidiClockFollowStats stats = follower.getStats();
+        if (!CHECK(!in.empty() && !regenerated.empty()))
+            return;
+        std::fprintf(stderr, "follower  interval error  input p50 %6.1f us  output p50 %6.1f us p90 %6.1f us  "
+                             "(%zu ticks out, %u skipped, %u relocks)\n",
+                     in[in.size() / 2], regenerated[regenerated.size() / 2], regenerated[regenerated.size() * 9 / 10],
+                     output.size(), stats.skipped, stats.relocks);
+        CHECK(stats.locked);
+        CHECK(output.size() + 2 >= input.size());
+        CHECK(regenerated[regenerated.size() / 2] * 2 < in[in.size() / 2]);
+    }
+}
+
+int main()
+{
+    pllSmoothsTicks();
+    followerSmoothsWire();
+    return check::finish("clock_pll_test");
+}
@@ -0,0 +1,133 @@
+// ClockTickScheduler against the closed form: at a constant tempo, tick k
+// must land at origin + floor(k * kTickNumerator / bpm) >> 16 exactly, for
+// millions of ticks at fractional tempos, so nothing accumulates. After a
+// tempo change the same holds from the tick it took effect on.
+//
+// MidiClockMaster on the virtual UART: Start and Continue go out right
+// ahead of a clock byte, never on their own between ticks.
+#include <vector>
+#include "check.hpp"
+#include "midi_clock.hpp"
+#include "midi_clock_master.hpp"
+#include "midi_hal.hpp"
+#include "midi_out.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr hal::UartPort kOutPort = 0;
+
+    // Ideal time of tick `k` after `origin_q16`, in Q16.16 microseconds
+    uint64_t idealQ16(uint64_t origin_q16, uint64_t k, BpmQ16 bpm)
+    {
+        unsigned __int128 offset = static_cast<unsigned __int128>(k) * ClockTickScheduler::kTickNumerator / bpm;
+        return origin_q16 + static_cast<uint64_t>(offset);
+    }
+
+    // Ticks [from, from + count) of `scheduler` against the closed form
+    // from `origin_q16`, where tick `from` is k = 0. Returns the mismatches.
+    uint32_t follow(ClockTickScheduler &scheduler, uint64_t origin_q16, uint64_t count, BpmQ16 bpm)
+    {
+        uint32_t mismatches = 0;
+        for (uint64_t k = 0; k < count; ++k)
+        {
+            uint64_t expected_us = idealQ16(origin_q16, k, bpm) >> 16;
+            if (scheduler.advance() != expected_us && mismatches++ < 5)
+                std::fprintf(stderr, "tick %llu at %.4f BPM is off\n", static_cast<unsigned long long>(k), bpmFromQ16(bpm));
+        }
+        return mismatches;
+    }
+
+    void noDrift()
+    {
+        constexpr uint64_t kTicks = 4000000; // about 11.5 hours at 120 BPM
+        constexpr uint64_t kOrigin_us = 1234567;
+        for (float bpm : {120.0f, 133.33f, 97.5f, 60.001f, 300.0f})
+        {
+            BpmQ16 q16 = bpmToQ16(bpm);
+            ClockTickScheduler scheduler;
+            scheduler.reset(kOrigin_us, q16);
+            CHECK_EQ(follow(scheduler, kOrigin_us << 16, kTicks, q16), 0);
+            CHECK_EQ(scheduler.tickCount(), kTicks);
+            CHECK_EQ(scheduler.nextTick(), idealQ16(kOrigin_us << 16, kTicks, q16) >> 16);
+        }
+    }
+
+    // 133.33 BPM for a million ticks, then 97.5 BPM: the new tempo counts
+    // from the tick that was next when it was set
+    void tempoChange()
+    {
+        constexpr uint64_t kBefore = 1000000;
+        constexpr uint64_t kAfter = 2000000;
+        BpmQ16 first = bpmToQ16(133.33f);
+        BpmQ16 second = bpmToQ16(97.5f);
+        ClockTickScheduler scheduler;
+        scheduler.reset(0, first);
+        CHECK_EQ(follow(scheduler, 0, kBefore, first), 0);
+
+        uint64_t change_q16 = idealQ16(0, kBefore, first);
+        scheduler.setBpm(second);
+        CHECK_EQ(scheduler.bpm(), second);
+        CHECK_EQ(scheduler.nextTick(), change_q16 >> 16);
+        CHECK_EQ(follow(scheduler, change_q16, kAfter, second), 0);
+    }
+
+    // Wire bytes until `until_us`
+    std::vector<hal::WireByte> capture(uint64_t until_us)
+    {
+        std::vector<hal::WireByte> wire;
+        hal::WireByte bytes[256];
+        while (hal::nowUs() < until_us)
+        {
+            hal::sleepMs(5);
+            size_t n;
+            while ((n = hal::captureUart(kOutPort, bytes, 256)) > 0)
+                wire.insert(wire.end(), bytes, bytes + n);
+        }
+        return wire;
+    }
+
+    // Start, then Continue, each set halfway between two ticks at 120 BPM
+    void quantizedTransport()
+    {
+        // Never destroyed: its tasks outlive main() (see hal::startTask)
+        static MidiOut &out = *new MidiOut(MidiOutConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = kOutPort});
+        out.init();
+        MidiClockMaster master(out);
+        master.begin(bpmToQ16(120.0f));
+        constexpr uint32_t kPeriodMs = 60000 / (120 * MIDI_CLOCKS_PER_BEAT);
+
+        for (TransportCommand command : {TransportCommand::Start, TransportCommand::Continue})
+        {
+            hal::sleepMs(10 * kPeriodMs + kPeriodMs / 2);
+            master.setTransport(command);
+            std::vector<hal::WireByte> wire = capture(hal::nowUs() + 10 * kPeriodMs * 1000);
+
+            uint32_t seen = 0;
+            for (size_t i = 0; i < wire.size(); ++i)
+            {
+                if (wire[i].byte != static_cast<uint8_t>(command))
+                    continue;
+                seen++;
+                // The clock byte follows with nothing in between, one byte time later
+                if (CHECK(i + 1 < wire.size()))
+                {
+                    CHECK_EQ(wire[i + 1].byte, 0xF8);
+                    CHECK_EQ(wire[i + 1].time_us - wire[i].time_us, MIDI_BYTE_TIME_US);
+                }
+            }
+            CHECK_EQ(seen, 1);
+        }
+        master.end();
+    }
+}
+
+int main()
+{
+    noDrift();
+    tempoChange();
+    quantizedTransport();
+    return check::finish("clock_scheduler_test");
+}
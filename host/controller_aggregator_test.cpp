@@ -0,0 +1,221 @@
+// ControllerAggregator: 14-bit controller pairs in either order, learning
+// which controllers send an LSB, NRPN and RPN selection with data entry,
+// increment and decrement at the ends of the range, and RPN null.
+#include <vector>
+#include "check.hpp"
+#include "controller_aggregator.hpp"
+
+using namespace midi;
+
+namespace
+{
+    struct Collector
+    {
+        std::vector<HighResController> controllers;
+        std::vector<ParameterChange> parameters;
+        void onHighResController(const HighResController &msg) { controllers.push_back(msg); }
+        void onParameterChange(const ParameterChange &msg) { parameters.push_back(msg); }
+
+        void clear()
+        {
+            controllers.clear();
+            parameters.clear();
+        }
+    };
+
+    struct Feeder
+    {
+        ControllerAggregator aggregator;
+        Collector out;
+
+        bool cc(uint8_t channel, uint8_t controller, uint8_t value)
+        {
+            return aggregator.feed(ControllerChange{channel, controller, value}, out);
+        }
+    };
+
+    bool is(const HighResController &msg, uint8_t channel, uint8_t controller, uint16_t value)
+    {
+        return msg.channel == channel && msg.controller == controller && msg.value == value;
+    }
+
+    bool is(const ParameterChange &msg, uint8_t channel, bool registered, uint16_t parameter, uint16_t value)
+    {
+        return msg.channel == channel && msg.registered == registered && msg.parameter == parameter && msg.value == value;
+    }
+
+    // A controller that never sends an LSB is reported on every MSB; once
+    // one has arrived it is reported once per pair, on the LSB
+    void lsbLearning()
+    {
+        Feeder f;
+        CHECK(f.cc(0, 1, 64));
+        CHECK(f.cc(0, 1, 65));
+        if (CHECK_EQ(f.out.controllers.size(), 2))
+            CHECK(is(f.out.controllers[1], 0, 1, 65 << 7));
+
+        f.out.clear();
+        CHECK(f.cc(0, 33, 10)); // the first LSB completes the pair
+        CHECK(f.cc(0, 1, 66));  // now an MSB waits for its LSB
+        CHECK(f.cc(0, 33, 11));
+        if (CHECK_EQ(f.out.controllers.size(), 2))
+        {
+            CHECK(is(f.out.controllers[0], 0, 1, 65 << 7 | 10));
+            CHECK(is(f.out.controllers[1], 0, 1, 66 << 7 | 11));
+        }
+
+        // Learned per controller and per channel
+        f.out.clear();
+        f.cc(0, 7, 100);
+        f.cc(1, 1, 5);
+        if (CHECK_EQ(f.out.controllers.size(), 2))
+        {
+            CHECK(is(f.out.controllers[0], 0, 7, 100 << 7));
+            CHECK(is(f.out.controllers[1], 1, 1, 5 << 7));
+        }
+
+        // reset() forgets it
+        f.aggregator.reset();
+        f.out.clear();
+        f.cc(0, 1, 70);
+        if (CHECK_EQ(f.out.controllers.size(), 1))
+            CHECK(is(f.out.controllers[0], 0, 1, 70 << 7));
+
+        // Not a 14-bit controller
+        f.out.clear();
+        CHECK(!f.cc(0, 64, 127));
+        CHECK(!f.cc(0, 74, 20));
+        CHECK(f.out.controllers.empty());
+    }
+
+    // An LSB before any MSB pairs with MSB 0, then the MSB waits for the next LSB
+    void lsbBeforeMsb()
+    {
+        Feeder f;
+        CHECK(f.cc(2, 39, 5));
+        CHECK(f.cc(2, 7, 100));
+        CHECK(f.cc(2, 39, 6));
+        if (CHECK_EQ(f.out.controllers.size(), 2))
+        {
+            CHECK(is(f.out.controllers[0], 2, 7, 5));
+            CHECK(is(f.out.controllers[1], 2, 7, 100 << 7 | 6));
+        }
+    }
+
+    void nrpnAndRpn()
+    {
+        Feeder f;
+
+        // Data entry with nothing selected is not a parameter change
+        CHECK(!f.cc(0, 6, 10));
+        CHECK(!f.cc(0, 38, 10));
+        CHECK(!f.cc(0, 96, 0));
+        CHECK(f.out.parameters.empty());
+
+        // NRPN 0x0102: MSB only is reported on CC 6...
+        CHECK(f.cc(0, 99, 1));
+        CHECK(f.cc(0, 98, 2));
+        CHECK(f.out.parameters.empty()); // selecting reports nothing
+        CHECK(f.cc(0, 6, 64));
+        if (CHECK_EQ(f.out.parameters.size(), 1))
+            CHECK(is(f.out.parameters[0], 0, false, 1 << 7 | 2, 64 << 7));
+
+        // ...until the channel sends a CC 38; then once per pair, on CC 38
+        f.out.clear();
+        CHECK(f.cc(0, 38, 3));
+        CHECK(f.cc(0, 6, 65));
+        CHECK(f.cc(0, 38, 4));
+        if (CHECK_EQ(f.out.parameters.size(), 2))
+        {
+            CHECK(is(f.out.parameters[0], 0, false, 1 << 7 | 2, 64 << 7 | 3));
+            CHECK(is(f.out.parameters[1], 0, false, 1 << 7 | 2, 65 << 7 | 4));
+        }
+
+        // Switching to RPN starts a fresh selection: one half is not enough
+        f.out.clear();
+        CHECK(f.cc(0, 101, 0));
+        CHECK(!f.cc(0, 6, 2));
+        CHECK(f.cc(0, 100, 0)); // RPN 0, pitch bend sensitivity
+        CHECK(f.cc(0, 6, 2));
+        CHECK(f.cc(0, 38, 50));
+        if (CHECK_EQ(f.out.parameters.size(), 1))
+            CHECK(is(f.out.parameters[0], 0, true, 0, 2 << 7 | 50));
+
+        // Other channels keep their own selection
+        CHECK(!f.cc(3, 6, 1));
+    }
+
+    void incrementDecrement()
+    {
+        Feeder f;
+        f.cc(0, 101, 0);
+        f.cc(0, 100, 1);
+
+        f.cc(0, 6, 0x7F);
+        f.cc(0, 38, 0x7E);
+        f.out.clear();
+        CHECK(f.cc(0, 96, 0));
+        CHECK(f.cc(0, 96, 0)); // clamps at 16383
+        CHECK(f.cc(0, 97, 0));
+        if (CHECK_EQ(f.out.parameters.size(), 3))
+        {
+            CHECK(is(f.out.parameters[0], 0, true, 1, 0x3FFF));
+            CHECK(is(f.out.parameters[1], 0, true, 1, 0x3FFF));
+            CHECK(is(f.out.parameters[2], 0, true, 1, 0x3FFE));
+        }
+
+        f.cc(0, 6, 0);
+        f.cc(0, 38, 1);
+        f.out.clear();
+        CHECK(f.cc(0, 97, 0));
+        CHECK(f.cc(0, 97, 0)); // clamps at 0
+        CHECK(f.cc(0, 96, 0));
+        if (CHECK_EQ(f.out.parameters.size(), 3))
+        {
+            CHECK(is(f.out.parameters[0], 0, true, 1, 0));
+            CHECK(is(f.out.parameters[1], 0, true, 1, 0));
+            CHECK(is(f.out.parameters[2], 0, true, 1, 1));
+        }
+
+        // Across the MSB boundary
+        f.cc(0, 6, 1);
+        f.cc(0, 38, 0);
+        f.out.clear();
+        f.cc(0, 97, 0);
+        if (CHECK_EQ(f.out.parameters.size(), 1))
+            CHECK(is(f.out.parameters[0], 0, true, 1, 0x7F));
+    }
+
+    void rpnNull()
+    {
+        Feeder f;
+        f.cc(5, 101, 0);
+        f.cc(5, 100, 2);
+        CHECK(f.cc(5, 6, 64));
+        CHECK(f.cc(5, 101, 0x7F));
+        CHECK(f.cc(5, 100, 0x7F));
+        f.out.clear();
+        CHECK(!f.cc(5, 6, 10));
+        CHECK(!f.cc(5, 38, 10));
+        CHECK(!f.cc(5, 96, 0));
+        CHECK(!f.cc(5, 97, 0));
+        CHECK(f.out.parameters.empty());
+
+        // 127/127 is an ordinary NRPN, not a null
+        f.cc(5, 99, 0x7F);
+        f.cc(5, 98, 0x7F);
+        CHECK(f.cc(5, 6, 10));
+        if (CHECK_EQ(f.out.parameters.size(), 1))
+            CHECK(is(f.out.parameters[0], 5, false, 0x3FFF, 10 << 7));
+    }
+}
+
+int main()
+{
+    lsbLearning();
+    lsbBeforeMsb();
+    nrpnAndRpn();
+    incrementDecrement();
+    rpnNull();
+    return check::finish("controller_aggregator_test");
+}
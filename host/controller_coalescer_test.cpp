@@ -0,0 +1,131 @@
+// ControllerCoalescer: which controllers it takes, and 14-bit pairs
+// leaving MSB first and back to back, also while a producer thread
+// races the consumer.
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "controller_coalescer.hpp"
+
+using namespace midi;
+
+namespace
+{
+    struct Cc
+    {
+        uint8_t status, controller, value;
+        bool operator==(const Cc &other) const
+        {
+            return status == other.status && controller == other.controller && value == other.value;
+        }
+    };
+
+    std::vector<Cc> drain(ControllerCoalescer &coalescer)
+    {
+        std::vector<Cc> out;
+        uint8_t msg[3] = {};
+        while (coalescer.pop(msg))
+            out.push_back(Cc{msg[0], msg[1], msg[2]});
+        return out;
+    }
+
+    void filter()
+    {
+        for (uint8_t controller : {1, 2, 7, 10, 11, 16, 70, 74, 91, 93, 102, 119})
+            CHECK(ControllerCoalescer::coalesces(controller));
+        for (uint8_t controller : {33, 39, 42, 43}) // LSBs of coalesced MSBs
+            CHECK(ControllerCoalescer::coalesces(controller));
+        for (uint8_t controller : {0, 6, 32, 38, 64, 65, 66, 67, 68, 69, 84, 88, 96, 97, 98, 99, 100, 101, 120, 121, 123, 127})
+            CHECK(!ControllerCoalescer::coalesces(controller));
+    }
+
+    void pairs()
+    {
+        ControllerCoalescer coalescer;
+
+        // Modulation MSB and LSB, then breath MSB: the pair stays together
+        coalescer.setControllerChange(0, 1, 10);
+        coalescer.setControllerChange(0, 2, 30);
+        coalescer.setControllerChange(0, 33, 20);
+        std::vector<Cc> out = drain(coalescer);
+        CHECK(out == (std::vector<Cc>{{0xB0, 1, 10}, {0xB0, 33, 20}, {0xB0, 2, 30}}));
+
+        // An LSB after its MSB has gone goes alone
+        coalescer.setControllerChange(0, 33, 21);
+        CHECK(drain(coalescer) == (std::vector<Cc>{{0xB0, 33, 21}}));
+
+        // A newer LSB replaces the waiting one
+        coalescer.setControllerChange(3, 7, 100);
+        coalescer.setControllerChange(3, 39, 1);
+        coalescer.setControllerChange(3, 39, 2);
+        CHECK(drain(coalescer) == (std::vector<Cc>{{0xB3, 7, 100}, {0xB3, 39, 2}}));
+
+        // A new MSB drops the LSB that was waiting for the old one
+        uint32_t replaced = coalescer.replaced();
+        coalescer.setControllerChange(0, 1, 11);
+        coalescer.setControllerChange(0, 33, 5);
+        coalescer.setControllerChange(0, 1, 12);
+        CHECK(drain(coalescer) == (std::vector<Cc>{{0xB0, 1, 12}}));
+        CHECK_EQ(coalescer.replaced() - replaced, 1); // the pair MSB 11 + LSB 5
+        CHECK(coalescer.empty());
+    }
+
+    // A producer sweeps a 14-bit value upwards as MSB + LSB pairs while the
+    // consumer pops. The MSBs never go backwards, nor does the value each
+    // LSB completes with the MSB before it, and it ends on the last one set.
+    void racingSweep()
+    {
+        ControllerCoalescer coalescer;
+        constexpr uint32_t kSteps = 1 << 14;
+        std::atomic<bool> done{false};
+        std::thread producer([&]
+                             {
+                                 for (uint32_t i = 0; i < kSteps; ++i)
+                                 {
+                                     coalescer.setControllerChange(0, 1, static_cast<uint8_t>(i >> 7));
+                                     coalescer.setControllerChange(0, 33, static_cast<uint8_t>(i & 0x7F));
+                                     if (i % 16 == 0)
+                                         std::this_thread::yield(); // interleave on a single core too
+                                 }
+                                 done.store(true); });
+
+        uint32_t msb = 0;
+        uint32_t value = 0;
+        uint32_t backwards = 0;
+        uint32_t popped = 0;
+        uint8_t msg[3] = {};
+        bool finished = false;
+        while (!finished)
+        {
+            finished = done.load();
+            while (coalescer.pop(msg))
+            {
+                popped++;
+                if (msg[1] == 1)
+                {
+                    if (msg[2] < msb)
+                        backwards++;
+                    msb = msg[2];
+                    continue;
+                }
+                uint32_t next = msb << 7 | msg[2];
+                if (next < value)
+                    backwards++;
+                value = next;
+            }
+            std::this_thread::yield();
+        }
+        producer.join();
+        std::fprintf(stderr, "sweep: %u of %u pairs' messages popped\n", popped, 2 * kSteps);
+        CHECK_EQ(backwards, 0);
+        CHECK_EQ(value, kSteps - 1);
+    }
+}
+
+int main()
+{
+    filter();
+    pairs();
+    racingSweep();
+    return check::finish("controller_coalescer_test");
+}
@@ -0,0 +1,144 @@
+// How stale are controller values on a saturated output?
+//
+// Sweeps 16 CCs (16-31) far faster than 31.25 kbaud can carry them, through MidiOut
+// with and without coalescing, over a virtual cable into MidiIn. For every
+// received value it measures the age: receive time minus the time the
+// application set it. It also checks that every controller ends on the
+// last value that was set.
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include "midi_hal.hpp"
+#include "midi_in.hpp"
+#include "midi_out.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr uint8_t kControllers = 16;
+    constexpr uint8_t kFirstController = 16; // 16-31: general purpose, all coalesced
+    constexpr uint32_t kUpdateIntervalUs = 100; // All controllers together: 10k updates/s
+    constexpr uint32_t kRunMs = 1000;
+
+    struct Run
+    {
+        const char *name;
+        bool coalesce;
+        hal::UartPort outPort;
+        hal::UartPort inPort;
+
+        std::atomic<uint64_t> setAt_us[kControllers][128] = {};
+        uint8_t lastSet[kControllers] = {};
+        std::atomic<uint8_t> lastReceived[kControllers] = {};
+        uint32_t sent = 0;
+        std::atomic<uint32_t> received{0};
+        std::atomic<uint64_t> totalAge_us{0};
+        std::atomic<uint64_t> maxAge_us{0};
+        uint32_t lost = 0; // Input ring overflows
+    };
+
+    void onReceived(Run &run, const Packet4 &packet, uint64_t timestamp_us)
+    {
+        if ((packet[1] & 0xF0) != 0xB0 || packet[2] < kFirstController || packet[2] >= kFirstController + kControllers)
+            return;
+        uint8_t cc = packet[2] - kFirstController;
+        uint8_t value = packet[3];
+        uint64_t age_us = timestamp_us - run.setAt_us[cc][value].load(std::memory_order_acquire);
+        run.lastReceived[cc].store(value, std::memory_order_relaxed);
+        run.received.fetch_add(1, std::memory_order_relaxed);
+        run.totalAge_us.fetch_add(age_us, std::memory_order_relaxed);
+        if (age_us > run.maxAge_us.load(std::memory_order_relaxed))
+            run.maxAge_us.store(age_us, std::memory_order_relaxed);
+    }
+
+    void simulate(Run &run)
+    {
+        hal::connectUarts(run.outPort, run.inPort);
+
+        // Never destroyed: their tasks outlive the run (see hal::startTask)
+        MidiInConfig inConfig{.receivePin = hal::kNoPin, .uart_num = run.inPort};
+        MidiIn &in = *new MidiIn(inConfig);
+        MidiOutConfig outConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = run.outPort};
+        outConfig.coalesce_controllers = run.coalesce;
+        MidiOut &out = *new MidiOut(outConfig);
+
+        in.init(nullptr);
+        out.init();
+
+        // Drain the input on its own thread, as an application would
+        static Run *current;
+        current = &run;
+        static std::atomic<bool> stop;
+        stop = false;
+        static std::atomic<bool> stopped;
+        stopped = false;
+        hal::startTask([](void *arg)
+                       {
+                           auto *in = static_cast<MidiIn *>(arg);
+                           MidiEvent events[16];
+                           while (!stop.load())
+                           {
+                               size_t count = in->read(events, 16, 10);
+                               for (size_t i = 0; i < count; ++i)
+                                   onReceived(*current, events[i].packet, events[i].timestamp_us);
+                           }
+                           stopped = true; },
+                       &in, "reader", 4096, 1);
+
+        // Like a UI task: wake every millisecond and send whatever is due
+        uint64_t start_us = hal::nowUs();
+        uint32_t step = 0;
+        uint64_t elapsed_us;
+        while ((elapsed_us = hal::nowUs() - start_us) < kRunMs * 1000ULL)
+        {
+            for (uint32_t due = static_cast<uint32_t>(elapsed_us / kUpdateIntervalUs); step < due; ++step)
+            {
+                uint8_t cc = step % kControllers;
+                uint8_t value = static_cast<uint8_t>((step / kControllers) & 0x7F);
+                run.setAt_us[cc][value].store(hal::nowUs(), std::memory_order_release);
+                run.lastSet[cc] = value;
+                out.sendControllerChange({.channel = 0, .controller = static_cast<uint8_t>(kFirstController + cc), .value = value});
+                run.sent++;
+            }
+            hal::sleepMs(1);
+        }
+
+        // Let the backlog drain
+        hal::sleepMs(500);
+        stop = true;
+        while (!stopped.load())
+            hal::sleepMs(1);
+        hal::disconnectUart(run.outPort);
+        run.lost = in.getStats().ring_overflows;
+    }
+
+    void report(const Run &run)
+    {
+        uint32_t received = run.received.load();
+        uint32_t final = 0;
+        for (uint8_t cc = 0; cc < kControllers; ++cc)
+        {
+            if (run.lastReceived[cc].load() == run.lastSet[cc])
+                final++;
+        }
+        std::printf("%-10s sent %6u  received %5u  age avg %7.2f ms  max %7.2f ms  final values %2u/%u  lost %u\n",
+                    run.name, run.sent, received,
+                    received ? run.totalAge_us.load() / 1000.0 / received : 0.0,
+                    run.maxAge_us.load() / 1000.0,
+                    final, kControllers, run.lost);
+    }
+
+    Run fifo{"fifo", false, 10, 11};
+    Run coalesced{"coalesced", true, 12, 13};
+}
+
+int main()
+{
+    simulate(fifo);
+    simulate(coalesced);
+    report(fifo);
+    report(coalesced);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Writes two_tracks.mid and its reference renderings for smf_render.
+
+The references are computed here, independently of the C++ reader: events
+merged by (tick, track), times from the tempo map with exact fractions and
+rounded down to whole microseconds.
+
+    python3 make_two_tracks.py        # from host/data/smf
+"""
+from fractions import Fraction
+import os
+import struct
+
+DIVISION = 96
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def varlen(value):
+    out = [value & 0x7F]
+    value >>= 7
+    while value:
+        out.insert(0, (value & 0x7F) | 0x80)
+        value >>= 7
+    return bytes(out)
+
+
+class Track:
+    def __init__(self):
+        self.data = bytearray()
+        self.tick = 0
+        self.events = []  # (tick, bytes) of channel messages
+        self.tempos = []  # (tick, us per quarter)
+
+    def _delta(self, tick):
+        assert tick >= self.tick
+        self.data += varlen(tick - self.tick)
+        self.tick = tick
+
+    def message(self, tick, *message, running=False):
+        self._delta(tick)
+        self.data += bytes(message[1:] if running else message)
+        self.events.append((tick, bytes(message)))
+
+    def meta(self, tick, kind, payload):
+        self._delta(tick)
+        self.data += bytes([0xFF, kind]) + varlen(len(payload)) + payload
+
+    def tempo(self, tick, us):
+        self.meta(tick, 0x51, us.to_bytes(3, "big"))
+        self.tempos.append((tick, us))
+
+    def sysex(self, tick, payload):
+        self._delta(tick)
+        self.data += b"\xF0" + varlen(len(payload)) + payload
+
+    def chunk(self, end_tick):
+        self.meta(end_tick, 0x2F, b"")
+        return b"MTrk" + struct.pack(">I", len(self.data)) + self.data
+
+
+def build():
+    conductor = Track()
+    conductor.meta(0, 0x03, b"Conductor")
+    conductor.meta(0, 0x58, bytes([4, 2, 24, 8]))
+    conductor.tempo(0, 500000)
+    conductor.tempo(384, 400000)
+    conductor.tempo(960, 600000)
+    conductor.tempo(960, 612345)  # Same tick: this one holds
+    conductor.tempo(2000, 350017)
+
+    lead = Track()
+    lead.meta(0, 0x03, b"Lead")
+    lead.message(0, 0xC0, 5)
+    lead.message(0, 0x90, 0x3C, 0x64)
+    lead.message(96, 0x90, 0x3C, 0x00, running=True)
+    lead.sysex(100, bytes([0x7E, 0x7F, 0x09, 0x01, 0xF7]))
+    lead.message(192, 0x90, 0x40, 0x50)
+    lead.message(288, 0x80, 0x40, 0x40)
+    lead.message(288, 0xB0, 0x07, 0x64)
+    lead.message(300, 0xB0, 0x0A, 0x20, running=True)
+    lead.message(384, 0x90, 0x43, 0x70)  # Same tick as a tempo change
+    lead.message(400, 0xE0, 0x00, 0x48)
+    lead.message(500, 0xD0, 0x30)
+    lead.message(520, 0xD0, 0x10, running=True)
+    lead.message(959, 0x80, 0x43, 0x00)
+    lead.message(960, 0x90, 0x48, 0x7F)
+    lead.message(1200, 0x90, 0x48, 0x00)
+    for i in range(40):
+        tick = 1536 + i * 96
+        lead.message(tick, 0x90, 0x30 + i % 12, 0x60)
+        lead.message(tick + 90, 0x80, 0x30 + i % 12, 0x00)
+
+    drums = Track()
+    drums.meta(0, 0x03, b"Drums")
+    for i in range(320):  # 80 quarter notes of 16ths: the seek index thins out
+        tick = i * 24
+        drums.message(tick, 0x99, 0x2A, 0x50 if i % 4 else 0x7F, running=i > 0)
+        drums.message(tick + 12, 0x99, 0x2A, 0x00, running=True)
+
+    tracks = [conductor, lead, drums]
+    end = max(t.tick for t in tracks)
+    data = b"MThd" + struct.pack(">IHHH", 6, 1, len(tracks), DIVISION)
+    data += b"".join(t.chunk(end) for t in tracks)
+    return data, tracks
+
+
+def tick_to_us(tempos, tick):
+    """Exact time of `tick`, rounded down"""
+    us = Fraction(0)
+    last_tick, rate = 0, 500000
+    for t, r in tempos:
+        if t > tick:
+            break
+        us += Fraction((t - last_tick) * rate, DIVISION)
+        last_tick, rate = t, r
+    us += Fraction((tick - last_tick) * rate, DIVISION)
+    return us.numerator // us.denominator
+
+
+def render(tracks, from_tick):
+    tempos = sorted((t, r) for track in tracks for t, r in track.tempos)
+    # Stable sort: same tick keeps track order, then file order
+    events = sorted(((tick, index, message) for index, track in enumerate(tracks)
+                     for tick, message in track.events), key=lambda e: (e[0], e[1]))
+    lines = []
+    for tick, index, message in events:
+        if tick < from_tick:
+            continue
+        lines.append("%10d %d %s" % (tick_to_us(tempos, tick), index, " ".join("%02X" % b for b in message)))
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    data, tracks = build()
+    with open(os.path.join(HERE, "two_tracks.mid"), "wb") as f:
+        f.write(data)
+    with open(os.path.join(HERE, "two_tracks.txt"), "w") as f:
+        f.write(render(tracks, 0))
+    for beats in (9, 250):
+        with open(os.path.join(HERE, "two_tracks_from%d.txt" % beats), "w") as f:
+            f.write(render(tracks, beats * DIVISION // 4))
+
+
+if __name__ == "__main__":
+    main()
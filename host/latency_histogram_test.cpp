@@ -0,0 +1,167 @@
+// LatencyHistogram: which bucket each value lands in, at every power-of-two
+// edge and past the last one; the percentiles of a known distribution,
+// reported as the upper bound of their bucket and capped at the maximum;
+// and snapshots taken while another thread records, none of them torn.
+#include <atomic>
+#include <thread>
+#include "check.hpp"
+#include "latency_histogram.hpp"
+
+using namespace midi;
+
+namespace
+{
+    using Histogram = LatencyHistogram;
+
+    void bucketEdges()
+    {
+        CHECK_EQ(Histogram::bucketFor(0), 0);
+        CHECK_EQ(Histogram::upperBoundUs(0), 0);
+        uint32_t misplaced = 0;
+        for (size_t i = 1; i < Histogram::kBuckets - 1; ++i)
+        {
+            uint32_t low = 1u << (i - 1);
+            uint32_t high = (1u << i) - 1;
+            if (Histogram::bucketFor(low) != i || Histogram::bucketFor(high) != i || Histogram::upperBoundUs(i) != high)
+            {
+                misplaced++;
+                std::fprintf(stderr, "bucket %zu: [%u, %u] misplaced\n", i, low, high);
+            }
+        }
+        CHECK_EQ(misplaced, 0);
+
+        // Everything from 2^22 us up shares the last bucket
+        constexpr size_t kOverflow = Histogram::kBuckets - 1;
+        CHECK_EQ(Histogram::bucketFor((1u << (kOverflow - 1)) - 1), kOverflow - 1);
+        CHECK_EQ(Histogram::bucketFor(1u << (kOverflow - 1)), kOverflow);
+        CHECK_EQ(Histogram::bucketFor(1u << 31), kOverflow);
+        CHECK_EQ(Histogram::bucketFor(UINT32_MAX), kOverflow);
+
+        // record() saturates at 32 bits; the total carries past them
+        Histogram histogram;
+        histogram.record(0);
+        histogram.record(1ull << 40);
+        histogram.record(UINT32_MAX);
+        Histogram::Snapshot s;
+        if (CHECK(histogram.trySnapshot(s)))
+        {
+            CHECK_EQ(s.buckets[0], 1);
+            CHECK_EQ(s.buckets[kOverflow], 2);
+            CHECK_EQ(s.count, 3);
+            CHECK_EQ(s.max_us, UINT32_MAX);
+            CHECK_EQ(s.total_us, 2ull * UINT32_MAX);
+        }
+    }
+
+    void percentiles()
+    {
+        Histogram empty;
+        Histogram::Snapshot s;
+        if (CHECK(empty.trySnapshot(s)))
+        {
+            CHECK_EQ(s.percentileUs(50), 0);
+            CHECK_EQ(s.averageUs(), 0);
+        }
+
+        // 100 values: 10 x 0, 40 x 5, 40 x 100, 9 x 3000 and one 5 s stall
+        Histogram histogram;
+        for (int i = 0; i < 10; ++i)
+            histogram.record(0);
+        for (int i = 0; i < 40; ++i)
+        {
+            histogram.record(5);
+            histogram.record(100);
+        }
+        for (int i = 0; i < 9; ++i)
+            histogram.record(3000);
+        histogram.record(5000000);
+        if (!CHECK(histogram.trySnapshot(s)))
+            return;
+        CHECK_EQ(s.count, 100);
+        CHECK_EQ(s.averageUs(), (40 * 5 + 40 * 100 + 9 * 3000 + 5000000) / 100);
+        CHECK_EQ(s.percentileUs(0), 0);
+        CHECK_EQ(s.percentileUs(10), 0);
+        CHECK_EQ(s.percentileUs(11), 7); // 5 is in [4, 8)
+        CHECK_EQ(s.percentileUs(50), 7);
+        CHECK_EQ(s.percentileUs(51), 127); // 100 is in [64, 128)
+        CHECK_EQ(s.percentileUs(90), 127);
+        CHECK_EQ(s.percentileUs(91), 4095); // 3000 is in [2048, 4096)
+        CHECK_EQ(s.percentileUs(99), 4095);
+        CHECK_EQ(s.percentileUs(100), 5000000); // the overflow bucket reports the maximum
+
+        // The rank rounds up, and no bound is reported above the maximum
+        Histogram three;
+        three.record(5);
+        three.record(5);
+        three.record(40);
+        if (CHECK(three.trySnapshot(s)))
+        {
+            CHECK_EQ(s.percentileUs(66), 7);
+            CHECK_EQ(s.percentileUs(67), 40); // [32, 64) capped at 40
+        }
+    }
+
+    // Record k is 1 us for even k and 3 s for odd k, so every field of a
+    // snapshot follows from its count; the 3 s values carry the low half
+    // of the total into the high half every few records.
+    constexpr uint32_t kLong_us = 3000000;
+
+    bool consistent(const Histogram::Snapshot &s)
+    {
+        uint32_t odd = s.count / 2;
+        uint32_t even = s.count - odd;
+        uint32_t sum = 0;
+        for (uint32_t bucket : s.buckets)
+            sum += bucket;
+        return sum == s.count && s.buckets[1] == even && s.buckets[Histogram::bucketFor(kLong_us)] == odd &&
+               s.total_us == even + static_cast<uint64_t>(odd) * kLong_us &&
+               s.max_us == (odd ? kLong_us : even ? 1 : 0);
+    }
+
+    void concurrentSnapshots()
+    {
+        constexpr uint32_t kRecords = 40000000;
+        Histogram histogram;
+        std::atomic<bool> done{false};
+        std::thread writer([&]
+                           {
+                               for (uint32_t k = 0; k < kRecords; ++k)
+                                   histogram.record(k % 2 ? kLong_us : 1);
+                               done.store(true); });
+
+        uint32_t taken = 0;
+        uint32_t retried = 0;
+        uint32_t torn = 0;
+        Histogram::Snapshot s;
+        // Neither side yields: on a single core the writer is preempted
+        // inside record() now and then, and the reader spins on it
+        while (!done.load())
+        {
+            if (!histogram.trySnapshot(s))
+            {
+                retried++;
+                continue;
+            }
+            taken++;
+            if (!consistent(s) && torn++ < 5)
+                std::fprintf(stderr, "torn snapshot at count %u\n", s.count);
+        }
+        writer.join();
+        std::fprintf(stderr, "concurrent: %u snapshots, %u caught mid-update and retried\n", taken, retried);
+        CHECK(taken > 0);
+        CHECK_EQ(torn, 0);
+        if (CHECK(histogram.trySnapshot(s)))
+        {
+            CHECK_EQ(s.count, kRecords);
+            CHECK(consistent(s));
+        }
+    }
+}
+
+int main()
+{
+    bucketEdges();
+    percentiles();
+    concurrentSnapshots();
+    return check::finish("latency_histogram_test");
+}
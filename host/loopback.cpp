@@ -0,0 +1,93 @@
+// Host counterpart of main/main.cpp: MidiOut on virtual UART 0 is wired to
+// MidiIn on virtual UART 1, so everything sent goes through the encoder,
+// the 31.25 kbaud wire model, the stream parser and the dispatcher.
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include "midi_hal.hpp"
+#include "midi_in.hpp"
+#include "midi_in_parser.hpp"
+#include "midi_out.hpp"
+#include "midi_trace.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr hal::UartPort kOutPort = 0;
+    constexpr hal::UartPort kInPort = 1;
+
+    // Never destroyed: their tasks outlive main() (see hal::startTask)
+    MidiInParser &parser = *new MidiInParser();
+    MidiIn &midiIn = *new MidiIn(MidiInConfig{.receivePin = hal::kNoPin, .uart_num = kInPort});
+    MidiOut &midiOut = *new MidiOut(MidiOutConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = kOutPort});
+
+    std::atomic<uint32_t> notes{0};
+    std::atomic<uint32_t> controllers{0};
+    uint64_t firstSent_us = 0;
+
+    void printLatency(const char *stage, const LatencyHistogram::Snapshot &h)
+    {
+        std::printf("  %-10s n=%-4u avg %6u us  p50 <=%6u us  p99 <=%6u us  max %6u us\n",
+                    stage, h.count, h.averageUs(), h.percentileUs(50), h.percentileUs(99), h.max_us);
+    }
+}
+
+int main()
+{
+    hal::connectUarts(kOutPort, kInPort);
+
+    parser.setNoteMessageCallback([](const NoteMessage &msg, uint64_t timestamp_us)
+                                  {
+                                      notes++;
+                                      std::printf("note %u %s at +%" PRIu64 " us\n", msg.note, msg.on ? "on" : "off", timestamp_us - firstSent_us); });
+    parser.setControllerCallback([](const ControllerChange &, uint64_t)
+                                 { controllers++; });
+    midiIn.init([](Packet4 packet, uint64_t timestamp_us)
+                { parser.feed(packet.data(), timestamp_us); });
+    midiOut.init();
+
+    firstSent_us = hal::nowUs();
+    for (uint8_t note = 60; note < 64; ++note)
+    {
+        midiOut.setNote({.channel = 0, .on = true, .note = note, .velocity = 100});
+        midiOut.setNote({.channel = 0, .on = false, .note = note, .velocity = 0});
+    }
+    for (uint8_t value = 0; value < 128; ++value)
+        midiOut.sendControllerChange({.channel = 0, .controller = 1, .value = value});
+
+    hal::sleepMs(200);
+
+    MidiInStats stats = midiIn.getStats();
+    std::printf("received %u notes, %u CCs (%u coalesced away), %u bytes in %u reads, %u parse errors\n",
+                notes.load(), controllers.load(), midiOut.coalescedControllers(), stats.bytes, stats.reads, stats.parse_errors);
+
+    MidiOutLatency out = midiOut.getLatency();
+    std::printf("out: %u dropped, queue high water %u\n", out.dropped, out.queue_high_water);
+    printLatency("queue", out.queue);
+    printLatency("wire", out.wire);
+    MidiInLatency in = midiIn.getLatency();
+    std::printf("in:\n");
+    printLatency("parse", in.parse);
+    printLatency("delivery", in.delivery);
+    printLatency("callback", in.callback);
+
+#if MIDI_TRACE_ENABLED
+    // Built with -DMIDI_TRACE=ON: the hot-path records as hex, for trace_decode
+    uint32_t cursor = 0;
+    uint32_t lost = 0;
+    trace::Record records[64];
+    char line[32];
+    size_t count;
+    while ((count = trace::ring.read(cursor, records, 64, lost)) > 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            trace::toHex(records[i], line, sizeof(line));
+            std::printf("%s\n", line);
+        }
+    }
+#endif
+    return notes == 8 && controllers > 0 ? 0 : 1;
+}
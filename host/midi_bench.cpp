@@ -0,0 +1,705 @@
+// Microbenchmarks for the per-byte and per-message hot paths:
+//
+//   stream_parser     MidiStreamParser::feed, wire bytes to packets (SysEx to chunks)
+//   stream_parser_span  the same bytes through the span feed(), 64 at a time as MidiIn reads them
+//   midi_in_per_byte  MidiIn on a virtual UART, reading byte by byte (process CPU time)
+//   midi_in_chunked   the same with chunked_read
+//   get_message_type  getMessageType on every message status
+//   parser_feed       MidiInParser::feed, std::function callbacks
+//   dispatcher_feed   MidiInDispatcher with an inlined handler, for comparison (CIN dispatch)
+//   dispatcher_status the same dispatcher switching on the status byte instead
+//   dispatcher_batch  the same, one feed() call for all packets
+//   to_usb_packet     typed message to USB MIDI packet
+//   to_usb_batch      the workload's notes, encoded with one to_usb_packets() call
+//   running_status    RunningStatusEncoder::encode, the output side
+//   router            MidiRouter::route with a channel remap, velocity curve and CC rules
+//   bpm_counter       BpmCounter::onClockTick on every 0xF8
+//   recorder          MidiRecorder::record on every message, into the arena
+//   smf_export        writeSmf on that recording, into a sink that drops the bytes
+//
+// over generated workloads (dense clock with notes, CC sweeps, a running
+// status stream, SysEx dumps) and any recorded captures given with
+// --replay. Results go to stdout as JSON, a table goes to stderr.
+//
+//   midi_bench [--min-time-ms N] [--filter TEXT] [--replay FILE]... [--record DIR] [--json FILE]
+//
+// --record writes the generated workloads as capture files, so a run can be
+// repeated on exactly the same bytes later or on another machine.
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+#include "bpm_counter.hpp"
+#include "capture.hpp"
+#include "midi_in.hpp"
+#include "midi_in_dispatcher.hpp"
+#include "midi_in_parser.hpp"
+#include "midi_out_parser.hpp"
+#include "midi_running_status.hpp"
+#include "midi_recorder.hpp"
+#include "midi_router.hpp"
+#include "midi_stream_parser.hpp"
+#include "smf_writer.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    struct Workload
+    {
+        std::string name;
+        Capture bytes;
+    };
+
+    // Serialises messages onto a 31.25 kbaud line: a message starts when it
+    // is due or when the line is free, whichever is later
+    class Line
+    {
+    public:
+        explicit Line(Capture &out) : out(out) {}
+
+        void send(uint64_t due_us, std::initializer_list<uint8_t> bytes)
+        {
+            send(due_us, bytes.begin(), bytes.size());
+        }
+
+        void send(uint64_t due_us, const uint8_t *bytes, size_t length)
+        {
+            uint64_t time_us = due_us > free_us ? due_us : free_us;
+            for (size_t i = 0; i < length; ++i)
+            {
+                time_us += MIDI_BYTE_TIME_US;
+                out.push_back(hal::WireByte{bytes[i], time_us});
+            }
+            free_us = time_us;
+        }
+
+        uint64_t freeAt() const { return free_us; }
+
+    private:
+        Capture &out;
+        uint64_t free_us = 0;
+    };
+
+    // Deterministic, so every run sees the same bytes
+    class Random
+    {
+    public:
+        uint32_t next()
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+
+        uint8_t below(uint8_t limit) { return static_cast<uint8_t>(next() % limit); }
+
+    private:
+        uint32_t state = 0x12345678;
+    };
+
+    constexpr uint64_t kClockPeriodUs = 60000000 / (120 * 24); // 120 BPM, 24 PPQN
+    constexpr uint32_t kSeconds = 8;
+
+    // 24 PPQN clock at 120 BPM with four-note chords on every 16th, spread
+    // over four channels, each with its Note Off: about as dense as a
+    // sequencer gets before the wire saturates
+    Workload clockWithNotes()
+    {
+        Workload w{"clock_notes", {}};
+        Line line(w.bytes);
+        Random random;
+        uint8_t held[4][4] = {};
+        for (uint64_t tick = 0; tick * kClockPeriodUs < kSeconds * 1000000ULL; ++tick)
+        {
+            uint64_t now_us = tick * kClockPeriodUs;
+            line.send(now_us, {0xF8});
+            if (tick % 6 != 0)
+                continue;
+            for (uint8_t channel = 0; channel < 4; ++channel)
+            {
+                for (uint8_t voice = 0; voice < 4; ++voice)
+                {
+                    if (held[channel][voice])
+                        line.send(now_us, {static_cast<uint8_t>(0x80 | channel), held[channel][voice], 0x40});
+                    uint8_t note = static_cast<uint8_t>(36 + random.below(48));
+                    line.send(now_us, {static_cast<uint8_t>(0x90 | channel), note, static_cast<uint8_t>(1 + random.below(127))});
+                    held[channel][voice] = note;
+                }
+            }
+        }
+        return w;
+    }
+
+    // Five controllers on eight channels swept up and down continuously,
+    // every message with its status byte
+    Workload controllerSweep()
+    {
+        static constexpr uint8_t kControllers[] = {1, 7, 10, 11, 74};
+        Workload w{"cc_sweep", {}};
+        Line line(w.bytes);
+        uint32_t step = 0;
+        while (line.freeAt() < kSeconds * 1000000ULL)
+        {
+            uint8_t value = static_cast<uint8_t>(step & 0x7F);
+            if (step & 0x80)
+                value = 0x7F - value;
+            for (uint8_t channel = 0; channel < 8; ++channel)
+            {
+                for (uint8_t controller : kControllers)
+                    line.send(0, {static_cast<uint8_t>(0xB0 | channel), controller, value});
+            }
+            step++;
+        }
+        return w;
+    }
+
+    // One channel of notes, CCs and pitch bend as a keyboard sends them:
+    // Note Off as Note On velocity 0 and running status, with the clock
+    // interleaved
+    Workload runningStatusStream()
+    {
+        Workload w{"running_status", {}};
+        Line line(w.bytes);
+        Random random;
+        RunningStatusEncoder encoder;
+        encoder.configure(true, 300000, true);
+
+        uint64_t nextClock_us = 0;
+        while (line.freeAt() < kSeconds * 1000000ULL)
+        {
+            uint64_t now_us = line.freeAt();
+            if (now_us >= nextClock_us)
+            {
+                line.send(now_us, {0xF8});
+                nextClock_us += kClockPeriodUs;
+            }
+
+            uint8_t msg[3];
+            switch (random.below(4))
+            {
+            case 0:
+            case 1:
+                msg[0] = random.below(2) ? 0x90 : 0x80;
+                msg[1] = static_cast<uint8_t>(48 + random.below(24));
+                msg[2] = static_cast<uint8_t>(1 + random.below(127));
+                break;
+            case 2:
+                msg[0] = 0xB0;
+                msg[1] = 1;
+                msg[2] = random.below(128);
+                break;
+            default:
+                msg[0] = 0xE0;
+                msg[1] = random.below(128);
+                msg[2] = random.below(128);
+                break;
+            }
+            // Bursts of one kind, as from a wheel or a chord, let running status work
+            for (uint8_t repeat = random.below(6); repeat < 6; ++repeat)
+            {
+                uint8_t out[3];
+                size_t length = encoder.encode(msg, 3, now_us, out);
+                line.send(now_us, out, length);
+                msg[2] = static_cast<uint8_t>((msg[2] + 3) & 0x7F);
+            }
+        }
+        return w;
+    }
+
+    // Patch bank dump: 1 KiB SysEx messages back to back, with the clock
+    // running (real-time bytes land inside the SysEx)
+    Workload sysexDump()
+    {
+        Workload w{"sysex_dump", {}};
+        Line line(w.bytes);
+        Random random;
+        uint64_t nextClock_us = 0;
+        uint8_t patch = 0;
+        while (line.freeAt() < kSeconds * 1000000ULL)
+        {
+            line.send(0, {0xF0, 0x43, 0x00, 0x09, 0x20, 0x00, patch++});
+            for (size_t i = 0; i < 1024; ++i)
+            {
+                if (line.freeAt() >= nextClock_us)
+                {
+                    line.send(0, {0xF8});
+                    nextClock_us += kClockPeriodUs;
+                }
+                line.send(0, {random.below(128)});
+            }
+            line.send(0, {0xF7});
+        }
+        return w;
+    }
+
+    // What every stage runs on: the workload's bytes decoded once up front
+    struct Decoded
+    {
+        std::vector<MidiEvent> events;
+        std::vector<uint64_t> clockTicks;
+        size_t sysexMessages = 0;
+    };
+
+    Decoded decode(const Capture &bytes)
+    {
+        Decoded decoded;
+        SysExChunkPool pool;
+        MidiStreamParser parser;
+        parser.setSysExHandler(&pool, [&decoded](const SysExChunk &chunk)
+                               {
+                                   if (chunk.isEnd())
+                                       decoded.sysexMessages++; });
+        MidiEvent event;
+        for (const hal::WireByte &byte : bytes)
+        {
+            if (!parser.feed(byte.byte, byte.time_us, event))
+                continue;
+            decoded.events.push_back(event);
+            if (event.packet[1] == 0xF8)
+                decoded.clockTicks.push_back(event.timestamp_us);
+        }
+        return decoded;
+    }
+
+    // Typed message for `packet`, the way an application would build one,
+    // turned into a USB MIDI packet
+    inline void encodeUsb(const Packet4 &packet, uint8_t out[4])
+    {
+        uint8_t status = packet[1];
+        uint8_t channel = status & 0x0F;
+        switch (getMessageType(status))
+        {
+        case MidiMessageType::NoteOn:
+        case MidiMessageType::NoteOff:
+            to_usb_packet(NoteMessage{channel, getMessageType(status) == MidiMessageType::NoteOn, packet[2], packet[3]}, out);
+            break;
+        case MidiMessageType::ControlChange:
+            to_usb_packet(ControllerChange{channel, packet[2], packet[3]}, out);
+            break;
+        case MidiMessageType::PolyAftertouch:
+            to_usb_packet(PolyAftertouch{channel, packet[2], packet[3]}, out);
+            break;
+        case MidiMessageType::ProgramChange:
+            to_usb_packet(ProgramChange{channel, packet[2]}, out);
+            break;
+        case MidiMessageType::ChannelPressure:
+            to_usb_packet(ChannelPressure{channel, packet[2]}, out);
+            break;
+        case MidiMessageType::PitchBend:
+            to_usb_packet(PitchBend{channel, static_cast<uint16_t>(packet[2] | packet[3] << 7)}, out);
+            break;
+        case MidiMessageType::SongPosition:
+            to_usb_packet(SongPosition{static_cast<uint16_t>(packet[2] | packet[3] << 7)}, out);
+            break;
+        case MidiMessageType::Start:
+        case MidiMessageType::Continue:
+        case MidiMessageType::Stop:
+            to_usb_packet(TransportEvent{static_cast<TransportCommand>(status)}, out);
+            break;
+        default:
+            // Clock and the rest of the single-byte messages
+            out[0] = usbHeader(0, status);
+            out[1] = status;
+            out[2] = 0;
+            out[3] = 0;
+            break;
+        }
+    }
+
+    // Counts what the dispatcher hands out, so nothing is optimised away
+    struct CountingHandler
+    {
+        uint64_t total = 0;
+
+        void onNote(const NoteMessage &msg, uint64_t) { total += msg.note; }
+        void onControllerChange(const ControllerChange &msg, uint64_t) { total += msg.value; }
+        void onPitchBend(const PitchBend &msg, uint64_t) { total += msg.value; }
+        void onTimingClock(uint64_t) { total++; }
+        void onTransport(const TransportEvent &, uint64_t) { total++; }
+    };
+
+    uint64_t callbackTotal = 0;
+
+    // MidiIn end to end on the POSIX virtual UART. The wire runs at
+    // 31.25 kbaud whatever the reader does, so wall time says nothing;
+    // this measures the process CPU time (UART task, virtual driver,
+    // dispatch task) spent on the first kUartSlice bytes of a workload
+    // sent back to back. One MidiIn per read mode, kept for the whole run.
+    constexpr size_t kUartSlice = 2048;
+    std::atomic<uint32_t> uartReceived{0};
+
+    MidiIn &uartInput(bool chunked)
+    {
+        auto open = [](hal::UartPort port, bool chunked)
+        {
+            MidiIn *in = new MidiIn(MidiInConfig{.receivePin = hal::kNoPin, .uart_num = port, .chunked_read = chunked,
+                                                 .active_sensing_timeout_ms = 0, .latency_probes = false});
+            in->init([](Packet4, uint64_t)
+                     { uartReceived.fetch_add(1, std::memory_order_relaxed); });
+            return in;
+        };
+        static MidiIn *perByte = open(0, false);
+        static MidiIn *inChunks = open(1, true);
+        return chunked ? *inChunks : *perByte;
+    }
+
+    uint64_t processCpuNs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+    }
+
+    bench::Result measureUart(const std::string &workload, const char *stage, bool chunked, const std::vector<uint8_t> &wire)
+    {
+        MidiIn &in = uartInput(chunked);
+        hal::UartPort port = chunked ? 1 : 0;
+        size_t length = wire.size() < kUartSlice ? wire.size() : kUartSlice;
+        MidiInStats before = in.getStats();
+        uint32_t received = uartReceived.load();
+
+        uint64_t start_ns = processCpuNs();
+        hal::injectUart(port, wire.data(), length);
+        uint64_t until_us = hal::nowUs() + (length + 20) * MIDI_BYTE_TIME_US + 100000;
+        while (in.getStats().bytes - before.bytes < length && hal::nowUs() < until_us)
+            hal::sleepMs(5);
+        hal::sleepMs(20); // Let the dispatch task drain the ring
+        uint64_t cpu_ns = processCpuNs() - start_ns;
+
+        MidiInStats after = in.getStats();
+        bench::Result result;
+        result.workload = workload;
+        result.stage = stage;
+        result.bytes = after.bytes - before.bytes;
+        result.messages = uartReceived.load() - received;
+        result.passes = 1;
+        result.median_ns = static_cast<double>(cpu_ns);
+        result.best_ns = result.median_ns;
+        uint32_t reads = after.reads - before.reads;
+        result.bytes_per_read = reads ? static_cast<double>(result.bytes) / reads : 0.0;
+        return result;
+    }
+
+    struct Options
+    {
+        uint32_t minTimeMs = 200;
+        std::string filter;
+        std::vector<std::string> replay;
+        std::string recordDir;
+        std::string jsonPath;
+    };
+
+    void run(const Workload &workload, const Options &options, std::vector<bench::Result> &results)
+    {
+        const Capture &bytes = workload.bytes;
+        const Decoded decoded = decode(bytes);
+        const std::vector<MidiEvent> &events = decoded.events;
+        const size_t messages = events.size() + decoded.sysexMessages;
+
+        auto add = [&](const char *stage, size_t stageBytes, size_t stageMessages, auto &&pass)
+        {
+            if (!options.filter.empty() &&
+                (workload.name + "/" + stage).find(options.filter) == std::string::npos)
+                return;
+            results.push_back(bench::measure(workload.name, stage, stageBytes, stageMessages, options.minTimeMs, pass));
+        };
+
+        SysExChunkPool pool;
+        uint64_t sysexBytes = 0;
+        MidiStreamParser streamParser;
+        streamParser.setSysExHandler(&pool, [&sysexBytes](const SysExChunk &chunk)
+                                     { sysexBytes += chunk.length; });
+        add("stream_parser", bytes.size(), messages, [&]
+            {
+                streamParser.reset();
+                MidiEvent event;
+                uint64_t total = 0;
+                for (const hal::WireByte &byte : bytes)
+                {
+                    if (streamParser.feed(byte.byte, byte.time_us, event))
+                        total += event.packet[1];
+                }
+                bench::keep(total + sysexBytes); });
+
+        // The stream as MidiIn::readChunked hands it over: up to 64 bytes a
+        // read, stamped with the arrival of the last one
+        constexpr size_t kChunkSize = 64;
+        std::vector<uint8_t> wire;
+        for (const hal::WireByte &byte : bytes)
+            wire.push_back(byte.byte);
+        add("stream_parser_span", bytes.size(), messages, [&]
+            {
+                streamParser.reset();
+                uint64_t total = 0;
+                for (size_t at = 0; at < wire.size(); at += kChunkSize)
+                {
+                    size_t length = wire.size() - at < kChunkSize ? wire.size() - at : kChunkSize;
+                    streamParser.feed(&wire[at], length, bytes[at + length - 1].time_us, [&total](const MidiEvent &event)
+                                      { total += event.packet[1]; });
+                }
+                bench::keep(total + sysexBytes); });
+
+        for (bool chunked : {false, true})
+        {
+            const char *stage = chunked ? "midi_in_chunked" : "midi_in_per_byte";
+            if (options.filter.empty() || (workload.name + "/" + stage).find(options.filter) != std::string::npos)
+                results.push_back(measureUart(workload.name, stage, chunked, wire));
+        }
+
+        add("get_message_type", 0, events.size(), [&]
+            {
+                uint64_t total = 0;
+                for (const MidiEvent &event : events)
+                    total += static_cast<uint8_t>(getMessageType(event.packet[1]));
+                bench::keep(total); });
+
+        MidiInParser parser;
+        parser.setNoteMessageCallback([](const NoteMessage &msg, uint64_t)
+                                      { callbackTotal += msg.note; });
+        parser.setControllerCallback([](const ControllerChange &msg, uint64_t)
+                                     { callbackTotal += msg.value; });
+        parser.setPitchBendCallback([](const PitchBend &msg, uint64_t)
+                                    { callbackTotal += msg.value; });
+        parser.setTimingClockCallback([](uint64_t)
+                                      { callbackTotal++; });
+        parser.setTempoCallback([](BpmQ16 bpm, uint8_t)
+                                { callbackTotal += bpm; });
+        add("parser_feed", 0, events.size(), [&]
+            {
+                for (const MidiEvent &event : events)
+                    parser.feed(event.packet.data(), event.timestamp_us);
+                bench::keep(callbackTotal); });
+
+        CountingHandler handler;
+        MidiInDispatcher<CountingHandler> dispatcher(handler);
+        add("dispatcher_feed", 0, events.size(), [&]
+            {
+                for (const MidiEvent &event : events)
+                    dispatcher.feed(event.packet.data(), event.timestamp_us);
+                bench::keep(handler.total); });
+
+        add("dispatcher_status", 0, events.size(), [&]
+            {
+                for (const MidiEvent &event : events)
+                    dispatcher.feedStatus(event.packet.data(), event.timestamp_us);
+                bench::keep(handler.total); });
+
+        add("dispatcher_batch", 0, events.size(), [&]
+            {
+                dispatcher.feed(events.data(), events.size());
+                bench::keep(handler.total); });
+
+        add("to_usb_packet", 0, events.size(), [&]
+            {
+                uint64_t total = 0;
+                uint8_t out[4];
+                for (const MidiEvent &event : events)
+                {
+                    encodeUsb(event.packet, out);
+                    total += out[0] + out[3];
+                }
+                bench::keep(total); });
+
+        std::vector<NoteMessage> notes;
+        for (const MidiEvent &event : events)
+        {
+            MidiMessageType type = getMessageType(event.packet[1]);
+            if (type == MidiMessageType::NoteOn || type == MidiMessageType::NoteOff)
+                notes.push_back(NoteMessage{static_cast<uint8_t>(event.packet[1] & 0x0F), type == MidiMessageType::NoteOn,
+                                            event.packet[2], event.packet[3]});
+        }
+        std::vector<Packet4> notePackets(notes.size());
+        if (!notes.empty())
+            add("to_usb_batch", 0, notes.size(), [&]
+                {
+                    to_usb_packets(notes.data(), notes.size(), notePackets.data());
+                    bench::keep(notePackets.back()[0] + notePackets.back()[3]); });
+
+        RunningStatusEncoder encoder;
+        encoder.configure(true, 300000, true);
+        add("running_status", 0, events.size(), [&]
+            {
+                encoder.reset();
+                uint64_t total = 0;
+                uint8_t out[3];
+                for (const MidiEvent &event : events)
+                {
+                    const uint8_t *msg = &event.packet[1];
+                    size_t length = static_cast<size_t>(getMidiMessageSize(getMessageType(msg[0])));
+                    total += encoder.encode(msg, length ? length : 1, event.timestamp_us, out);
+                }
+                bench::keep(total); });
+
+        // A typical thru setup: two channels swapped, a velocity range, the
+        // mod wheel moved to CC 74 through a curve and CC 7 dropped
+        static uint8_t velocity[128];
+        static uint8_t brightness[128];
+        MidiRouter::scaleCurve(velocity, 40, 110);
+        for (int i = 0; i < 128; ++i)
+            brightness[i] = static_cast<uint8_t>(127 - i);
+        const MidiCcRule rules[] = {
+            {MidiCcRule::kAllChannels, 1, 74, brightness},
+            {MidiCcRule::kAllChannels, 7, MidiCcRule::kDrop},
+        };
+        MidiRouteConfig routeConfig;
+        routeConfig.channel_map[0] = 1;
+        routeConfig.channel_map[1] = 0;
+        routeConfig.velocity_curve = velocity;
+        routeConfig.cc_rules = rules;
+        routeConfig.cc_rule_count = 2;
+        MidiRouter router;
+        router.compile(routeConfig);
+        add("router", 0, events.size(), [&]
+            {
+                uint64_t total = 0;
+                uint8_t out[3] = {};
+                for (const MidiEvent &event : events)
+                {
+                    const uint8_t *msg = &event.packet[1];
+                    size_t length = static_cast<size_t>(getMidiMessageSize(getMessageType(msg[0])));
+                    total += router.route(msg, length ? length : 1, out) + out[0];
+                }
+                bench::keep(total); });
+
+        // Arena big enough for the worst case, so nothing is dropped
+        std::vector<uint8_t> arena(events.size() * MidiRecorder::kMaxRecordBytes + 1);
+        MidiRecorder recorder(arena.data(), arena.size());
+        add("recorder", 0, events.size(), [&]
+            {
+                recorder.start(events.empty() ? 0 : events.front().timestamp_us);
+                for (const MidiEvent &event : events)
+                    recorder.record(event);
+                bench::keep(recorder.bytesUsed()); });
+
+        recorder.start(events.empty() ? 0 : events.front().timestamp_us);
+        for (const MidiEvent &event : events)
+            recorder.record(event);
+        if (recorder.events())
+        {
+            uint64_t fileBytes = 0;
+            SmfSink sink = [&fileBytes](const uint8_t *, size_t length)
+            {
+                fileBytes += length;
+                return true;
+            };
+            add("smf_export", 0, recorder.events(), [&]
+                {
+                    writeSmf(recorder, sink);
+                    bench::keep(fileBytes); });
+        }
+
+        if (!decoded.clockTicks.empty())
+        {
+            BpmCounter counter;
+            uint64_t tempoTotal = 0;
+            counter.setTempoCallback([&tempoTotal](BpmQ16 bpm, uint8_t)
+                                     { tempoTotal += bpm; });
+            add("bpm_counter", 0, decoded.clockTicks.size(), [&]
+                {
+                    counter.start();
+                    for (uint64_t tick_us : decoded.clockTicks)
+                        counter.onClockTick(tick_us);
+                    bench::keep(tempoTotal); });
+        }
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--min-time-ms" && hasValue)
+                options.minTimeMs = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            else if (arg == "--filter" && hasValue)
+                options.filter = argv[++i];
+            else if (arg == "--replay" && hasValue)
+                options.replay.push_back(argv[++i]);
+            else if (arg == "--record" && hasValue)
+                options.recordDir = argv[++i];
+            else if (arg == "--json" && hasValue)
+                options.jsonPath = argv[++i];
+            else
+                return false;
+        }
+        return true;
+    }
+
+    std::string baseName(const std::string &path)
+    {
+        size_t slash = path.find_last_of('/');
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+        return dot == std::string::npos ? name : name.substr(0, dot);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr, "usage: %s [--min-time-ms N] [--filter TEXT] [--replay FILE]... [--record DIR] [--json FILE]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Workload> workloads;
+    if (options.replay.empty())
+    {
+        workloads.push_back(clockWithNotes());
+        workloads.push_back(controllerSweep());
+        workloads.push_back(runningStatusStream());
+        workloads.push_back(sysexDump());
+    }
+    for (const std::string &path : options.replay)
+    {
+        Workload w{baseName(path), {}};
+        if (!loadCapture(path, w.bytes))
+        {
+            std::fprintf(stderr, "can't read capture %s\n", path.c_str());
+            return 1;
+        }
+        workloads.push_back(std::move(w));
+    }
+
+    if (!options.recordDir.empty())
+    {
+        for (const Workload &w : workloads)
+        {
+            std::string path = options.recordDir + "/" + w.name + ".midicap";
+            if (!saveCapture(path, w.bytes))
+            {
+                std::fprintf(stderr, "can't write capture %s\n", path.c_str());
+                return 1;
+            }
+        }
+    }
+
+    std::vector<bench::Result> results;
+    for (const Workload &w : workloads)
+        run(w, options, results);
+
+    bench::printTable(stderr, results);
+    if (options.jsonPath.empty())
+    {
+        bench::writeJson(stdout, "midi_bench", results);
+    }
+    else
+    {
+        std::FILE *json = std::fopen(options.jsonPath.c_str(), "w");
+        if (!json)
+        {
+            std::fprintf(stderr, "can't write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        bench::writeJson(json, "midi_bench", results);
+        std::fclose(json);
+    }
+    return 0;
+}
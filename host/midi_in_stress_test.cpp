@@ -0,0 +1,84 @@
+// MidiIn at line rate with a slow consumer: a steady 31.25 kbaud stream of
+// 3-byte messages is injected into virtual UART 1 while the callback
+// works 200 us on each message and stalls for 40 ms every 100 messages
+// (60 ms of the 96 ms those take on the wire). The SPSC ring has to
+// absorb the stalls: every message must arrive, in order, with nothing
+// dropped anywhere on the way.
+#include <atomic>
+#include <cinttypes>
+#include <vector>
+#include "check.hpp"
+#include "midi_hal.hpp"
+#include "midi_in.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr hal::UartPort kInPort = 1;
+    constexpr uint32_t kMessages = 3000;   // ~2.9 s of wire time
+    constexpr uint32_t kWorkUs = 200;      // Per message
+    constexpr uint32_t kStallEvery = 100;
+    constexpr uint32_t kStallMs = 40;      // ~42 messages pile up meanwhile
+
+    std::atomic<uint32_t> received{0};
+    std::atomic<uint32_t> outOfOrder{0};
+
+    void busyWait(uint32_t us)
+    {
+        uint64_t until = hal::nowUs() + us;
+        while (hal::nowUs() < until)
+        {
+        }
+    }
+}
+
+int main()
+{
+    // Never destroyed: its tasks outlive main() (see hal::startTask)
+    static MidiIn &midiIn = *new MidiIn(MidiInConfig{.receivePin = hal::kNoPin, .uart_num = kInPort, .latency_probes = false});
+    midiIn.init([](Packet4 packet, uint64_t)
+                {
+                    // The sequence number is in the data bytes
+                    uint32_t index = received.load(std::memory_order_relaxed);
+                    uint32_t sequence = static_cast<uint32_t>(packet[2]) << 7 | packet[3];
+                    if (sequence != (index & 0x3FFF) || packet[1] != (0xB0 | (index & 0x0F)))
+                        outOfOrder.fetch_add(1, std::memory_order_relaxed);
+                    received.store(index + 1, std::memory_order_relaxed);
+
+                    busyWait(kWorkUs);
+                    if ((index + 1) % kStallEvery == 0)
+                        hal::sleepMs(kStallMs); });
+
+    // A new status on every message, so none of them rides on running status
+    std::vector<uint8_t> wire;
+    for (uint32_t i = 0; i < kMessages; ++i)
+    {
+        wire.push_back(static_cast<uint8_t>(0xB0 | (i & 0x0F)));
+        wire.push_back(static_cast<uint8_t>((i >> 7) & 0x7F));
+        wire.push_back(static_cast<uint8_t>(i & 0x7F));
+    }
+    uint64_t start_us = hal::nowUs();
+    hal::injectUart(kInPort, wire.data(), wire.size());
+
+    uint64_t wireTime_us = wire.size() * MIDI_BYTE_TIME_US;
+    while (received.load() < kMessages && hal::nowUs() - start_us < wireTime_us + 2000000)
+        hal::sleepMs(10);
+    uint64_t elapsed_us = hal::nowUs() - start_us;
+
+    MidiInStats stats = midiIn.getStats();
+    std::fprintf(stderr, "%u of %u messages in %" PRIu64 " ms (wire %" PRIu64 " ms), ring high water %u of 128, "
+                         "%u bytes in %u reads\n",
+                 received.load(), kMessages, elapsed_us / 1000, wireTime_us / 1000, stats.ring_high_water,
+                 stats.bytes, stats.reads);
+
+    CHECK_EQ(received.load(), kMessages);
+    CHECK_EQ(outOfOrder.load(), 0);
+    CHECK_EQ(stats.bytes, wire.size());
+    CHECK_EQ(stats.ring_overflows, 0);
+    CHECK_EQ(stats.uart_overflows, 0);
+    CHECK_EQ(stats.parse_errors, 0);
+    CHECK(stats.ring_high_water >= kStallMs * 1000 / (3 * MIDI_BYTE_TIME_US) / 2); // the stalls did back up the ring
+    return check::finish("midi_in_stress_test");
+}
@@ -0,0 +1,218 @@
+// MidiRouter: channel filter and remap, the velocity curve, CC remap and
+// drop with value curves, which CC rule wins, and compile() refusing more
+// curves than it has slots for.
+#include <vector>
+#include "check.hpp"
+#include "midi_router.hpp"
+
+using namespace midi;
+
+namespace
+{
+    struct Routed
+    {
+        size_t length;
+        uint8_t bytes[3];
+    };
+
+    Routed route(const MidiRouter &router, std::initializer_list<uint8_t> message)
+    {
+        std::vector<uint8_t> in(message);
+        Routed out = {0, {0, 0, 0}};
+        out.length = router.route(in.data(), in.size(), out.bytes);
+        return out;
+    }
+
+    bool is(const Routed &routed, std::initializer_list<uint8_t> expected)
+    {
+        if (routed.length != expected.size())
+            return false;
+        size_t i = 0;
+        for (uint8_t byte : expected)
+        {
+            if (routed.bytes[i++] != byte)
+                return false;
+        }
+        return true;
+    }
+
+    void passesByDefault()
+    {
+        MidiRouter router;
+        CHECK(router.compile(MidiRouteConfig{}));
+        CHECK(is(route(router, {0x93, 60, 100}), {0x93, 60, 100}));
+        CHECK(is(route(router, {0xC5, 7}), {0xC5, 7}));
+        CHECK(is(route(router, {0xF8}), {0xF8}));
+        CHECK(is(route(router, {0xF0}), {}));   // SysEx never routes
+        CHECK(is(route(router, {0x40}), {}));   // nor does a data byte
+    }
+
+    void channels()
+    {
+        MidiRouteConfig config;
+        config.channels = 0xFFFF & ~(1u << 2); // channel 2 filtered
+        config.channel_map[0] = 9;
+        config.channel_map[9] = 0;
+        config.voice_types = 0x7F & ~(1u << 5); // Channel Pressure filtered
+        config.realtime = false;
+        MidiRouter router;
+        CHECK(router.compile(config));
+
+        CHECK(is(route(router, {0x90, 60, 100}), {0x99, 60, 100}));
+        CHECK(is(route(router, {0x89, 60, 0}), {0x80, 60, 0}));
+        CHECK(is(route(router, {0xE0, 0, 64}), {0xE9, 0, 64}));
+        CHECK(is(route(router, {0xC0, 5}), {0xC9, 5}));
+        CHECK(is(route(router, {0x92, 60, 100}), {}));
+        CHECK(is(route(router, {0xB2, 7, 100}), {}));
+        CHECK(is(route(router, {0xD1, 40}), {}));
+        CHECK(is(route(router, {0xF8}), {}));
+        CHECK(is(route(router, {0xF2, 0, 0}), {0xF2, 0, 0}));
+    }
+
+    // However the curve is drawn, a Note On with a velocity stays a Note
+    // On; velocity 0 (a Note Off) stays 0, and Note Off velocities are left alone
+    void velocityCurve()
+    {
+        static uint8_t silent[128] = {};
+        static uint8_t inverted[128];
+        for (int i = 0; i < 128; ++i)
+            inverted[i] = static_cast<uint8_t>(127 - i);
+        for (const uint8_t *curve : {static_cast<const uint8_t *>(silent), static_cast<const uint8_t *>(inverted)})
+        {
+            MidiRouteConfig config;
+            config.velocity_curve = curve;
+            MidiRouter router;
+            CHECK(router.compile(config));
+            uint32_t zeroed = 0;
+            for (uint8_t velocity = 1; velocity < 128; ++velocity)
+            {
+                Routed out = route(router, {0x90, 60, velocity});
+                if (out.length != 3 || out.bytes[2] == 0)
+                    zeroed++;
+                else if (curve == inverted && velocity < 127 && out.bytes[2] != 127 - velocity)
+                    zeroed++;
+            }
+            CHECK_EQ(zeroed, 0);
+            CHECK(is(route(router, {0x90, 60, 0}), {0x90, 60, 0}));
+            CHECK(is(route(router, {0x80, 60, 64}), {0x80, 60, 64}));
+        }
+
+        uint8_t range[128];
+        MidiRouter::scaleCurve(range, 40, 110);
+        CHECK_EQ(range[0], 0);
+        CHECK_EQ(range[1], 40);
+        CHECK_EQ(range[127], 110);
+    }
+
+    void controllers()
+    {
+        static uint8_t halve[128];
+        for (int i = 0; i < 128; ++i)
+            halve[i] = static_cast<uint8_t>(i / 2);
+        const MidiCcRule rules[] = {
+            {MidiCcRule::kAllChannels, 1, 74, halve},
+            {MidiCcRule::kAllChannels, 7, MidiCcRule::kDrop},
+            {3, 10, 11},
+        };
+        MidiRouteConfig config;
+        config.channel_map[3] = 4;
+        config.cc_rules = rules;
+        config.cc_rule_count = 3;
+        MidiRouter router;
+        CHECK(router.compile(config));
+
+        CHECK(is(route(router, {0xB0, 1, 100}), {0xB0, 74, 50}));
+        CHECK(is(route(router, {0xB5, 1, 127}), {0xB5, 74, 63}));
+        CHECK(is(route(router, {0xB0, 7, 100}), {}));
+        CHECK(is(route(router, {0xBF, 7, 100}), {}));
+        CHECK(is(route(router, {0xB3, 10, 20}), {0xB4, 11, 20})); // channel 3 only, remapped to 4 after
+        CHECK(is(route(router, {0xB0, 10, 20}), {0xB0, 10, 20}));
+        CHECK(is(route(router, {0xB0, 2, 20}), {0xB0, 2, 20}));
+        // Only controllers: the same numbers in other messages pass as they are
+        CHECK(is(route(router, {0x90, 7, 100}), {0x90, 7, 100}));
+        CHECK(is(route(router, {0xA0, 1, 100}), {0xA0, 1, 100}));
+    }
+
+    // Later rules win, whether they name one channel or all of them
+    void rulePrecedence()
+    {
+        {
+            const MidiCcRule rules[] = {
+                {MidiCcRule::kAllChannels, 1, 2},
+                {5, 1, 3},
+            };
+            MidiRouteConfig config;
+            config.cc_rules = rules;
+            config.cc_rule_count = 2;
+            MidiRouter router;
+            CHECK(router.compile(config));
+            CHECK(is(route(router, {0xB5, 1, 9}), {0xB5, 3, 9}));
+            CHECK(is(route(router, {0xB6, 1, 9}), {0xB6, 2, 9}));
+        }
+        {
+            const MidiCcRule rules[] = {
+                {5, 1, 3},
+                {MidiCcRule::kAllChannels, 1, MidiCcRule::kDrop},
+            };
+            MidiRouteConfig config;
+            config.cc_rules = rules;
+            config.cc_rule_count = 2;
+            MidiRouter router;
+            CHECK(router.compile(config));
+            CHECK(is(route(router, {0xB5, 1, 9}), {}));
+            CHECK(is(route(router, {0xB6, 1, 9}), {}));
+        }
+    }
+
+    // kMaxCurves - 1 distinct tables fit (slot 0 is the identity); one more
+    // fails and leaves the router passing everything unchanged. A table
+    // used twice takes one slot.
+    void tooManyCurves()
+    {
+        static uint8_t tables[MidiRouter::kMaxCurves][128];
+        for (size_t t = 0; t < MidiRouter::kMaxCurves; ++t)
+        {
+            for (int i = 0; i < 128; ++i)
+                tables[t][i] = static_cast<uint8_t>(t + 1);
+        }
+
+        std::vector<MidiCcRule> rules;
+        for (size_t t = 0; t + 1 < MidiRouter::kMaxCurves; ++t)
+            rules.push_back(MidiCcRule{MidiCcRule::kAllChannels, static_cast<uint8_t>(20 + t), static_cast<uint8_t>(20 + t), tables[t]});
+        rules.push_back(MidiCcRule{MidiCcRule::kAllChannels, 40, 41, tables[0]}); // shared
+        MidiRouteConfig config;
+        config.channel_map[0] = 1;
+        config.cc_rules = rules.data();
+        config.cc_rule_count = rules.size();
+        MidiRouter router;
+        CHECK(router.compile(config));
+        CHECK(is(route(router, {0xB0, 26, 100}), {0xB1, 26, MidiRouter::kMaxCurves - 1}));
+        CHECK(is(route(router, {0xB0, 40, 100}), {0xB1, 41, 1}));
+
+        rules.push_back(MidiCcRule{MidiCcRule::kAllChannels, 50, 50, tables[MidiRouter::kMaxCurves - 1]});
+        config.cc_rules = rules.data();
+        config.cc_rule_count = rules.size();
+        CHECK(!router.compile(config));
+        CHECK(is(route(router, {0xB0, 26, 100}), {0xB0, 26, 100}));
+        CHECK(is(route(router, {0xB0, 50, 100}), {0xB0, 50, 100}));
+
+        // A velocity curve takes a slot too
+        rules.pop_back();
+        config.cc_rules = rules.data();
+        config.cc_rule_count = rules.size();
+        config.velocity_curve = tables[MidiRouter::kMaxCurves - 1];
+        CHECK(!router.compile(config));
+        CHECK(is(route(router, {0x90, 60, 100}), {0x90, 60, 100}));
+    }
+}
+
+int main()
+{
+    passesByDefault();
+    channels();
+    velocityCurve();
+    controllers();
+    rulePrecedence();
+    tooManyCurves();
+    return check::finish("midi_router_test");
+}
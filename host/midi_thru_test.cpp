@@ -0,0 +1,247 @@
+// MidiIn -> MidiThru -> MidiOut on virtual UARTs, merged with local sends.
+//
+// Step by step first: one input burst or local send at a time, and the
+// output compared byte for byte with what a single running-status
+// encoder makes of the merged stream (shared status across sources,
+// real-time bytes that arrived inside a message going out ahead of it,
+// System Common clearing the status, the channel mask).
+//
+// Then interleaved: a note stream with clocks between its bytes comes in
+// while the application sends notes and clocks of its own. Each source
+// must come out whole and in order, the stream with its real-time bytes
+// removed must be exactly the running-status encoding of the messages
+// in it, and every real-time byte must arrive, some of them between the
+// bytes of a message.
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "midi_hal.hpp"
+#include "midi_in.hpp"
+#include "midi_out.hpp"
+#include "midi_running_status.hpp"
+#include "midi_stream_parser.hpp"
+#include "midi_thru.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr hal::UartPort kOutPort = 0;
+    constexpr hal::UartPort kInPort = 1;
+    constexpr uint32_t kRefreshMs = 60000; // No status refresh within the test
+
+    std::vector<uint8_t> wire; // Output so far
+
+    // Waits until the output holds `length` bytes, or a second went by
+    void collect(size_t length)
+    {
+        hal::WireByte bytes[256];
+        uint64_t until = hal::nowUs() + 1000000;
+        while (hal::nowUs() < until)
+        {
+            size_t n;
+            while ((n = hal::captureUart(kOutPort, bytes, 256)) > 0)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    wire.push_back(bytes[i].byte);
+            }
+            if (wire.size() >= length)
+                break;
+            hal::sleepMs(2);
+        }
+    }
+
+    void inject(std::initializer_list<uint8_t> bytes)
+    {
+        std::vector<uint8_t> data(bytes);
+        hal::injectUart(kInPort, data.data(), data.size());
+    }
+
+    void stepByStep(MidiOut &out, MidiThru &thru)
+    {
+        std::vector<uint8_t> expected;
+        auto expect = [&expected](std::initializer_list<uint8_t> bytes)
+        {
+            expected.insert(expected.end(), bytes);
+            collect(expected.size());
+        };
+
+        inject({0x90, 0x3C, 0x64, 0x3E, 0x64});          // running status on the input
+        expect({0x90, 0x3C, 0x64, 0x3E, 0x64});
+        out.setNote(NoteMessage{0, true, 0x40, 0x64});    // local, same status
+        expect({0x40, 0x64});
+        out.setNote(NoteMessage{1, true, 0x3C, 0x64});
+        expect({0x91, 0x3C, 0x64});
+        inject({0x90, 0x3C, 0xF8, 0x00});                // clock inside a Note On
+        expect({0xF8, 0x90, 0x3C, 0x00});
+        inject({0xB0, 0x07, 0x64});
+        expect({0xB0, 0x07, 0x64});
+        out.sendControllerChange(ControllerChange{0, 0x0A, 0x40});
+        expect({0x0A, 0x40});
+        inject({0xF2, 0x10, 0x02});                      // System Common ends running status
+        expect({0xF2, 0x10, 0x02});
+        out.sendControllerChange(ControllerChange{0, 0x07, 0x10});
+        expect({0xB0, 0x07, 0x10});
+        inject({0xFA, 0xB0, 0x07, 0x11});                // real-time does not
+        expect({0xFA, 0x07, 0x11});
+        out.sendRealtime(0xFC);
+        expect({0xFC});
+        inject({0x92, 0x3C, 0x64, 0x90, 0x30, 0x40});    // channel 2 is masked out
+        expect({0x90, 0x30, 0x40});
+
+        CHECK_EQ(wire.size(), expected.size());
+        CHECK(wire == expected);
+        CHECK_EQ(thru.filtered(), 1);
+    }
+
+    struct Message
+    {
+        uint8_t status, data1, data2;
+        bool operator==(const Message &other) const
+        {
+            return status == other.status && data1 == other.data1 && data2 == other.data2;
+        }
+    };
+
+    void mergedUnderLoad(MidiOut &out)
+    {
+        wire.clear();
+
+        // 200 Note Ons on channel 0 with running status, a clock after
+        // every 7th byte, so most clocks land inside a message
+        std::vector<uint8_t> input = {0x90};
+        std::vector<Message> thruNotes;
+        uint32_t clocks = 0;
+        for (uint32_t i = 0; i < 200; ++i)
+        {
+            Message note = {0x90, static_cast<uint8_t>(i & 0x7F), static_cast<uint8_t>((i >> 7) + 1)};
+            thruNotes.push_back(note);
+            for (uint8_t byte : {note.data1, note.data2})
+            {
+                input.push_back(byte);
+                if (input.size() % 7 == 0)
+                {
+                    input.push_back(0xF8);
+                    clocks++;
+                }
+            }
+        }
+
+        // The input in 50 slices cut anywhere, 8 ms apart, each with a local
+        // Note On on channel 1 and a local clock after every 5th: about
+        // half the output wire, so forward() never finds the queue full
+        constexpr size_t kRounds = 50;
+        std::vector<Message> localNotes;
+        size_t sliceStart = 0;
+        for (uint32_t i = 0; i < kRounds; ++i)
+        {
+            size_t sliceEnd = input.size() * (i + 1) / kRounds;
+            hal::injectUart(kInPort, input.data() + sliceStart, sliceEnd - sliceStart);
+            sliceStart = sliceEnd;
+
+            localNotes.push_back(Message{0x91, static_cast<uint8_t>(i), 100});
+            out.setNote(NoteMessage{1, true, static_cast<uint8_t>(i), 100});
+            if (i % 5 == 4)
+            {
+                out.sendRealtime(0xF8);
+                clocks++;
+            }
+            hal::sleepMs(8);
+        }
+
+        // A local backlog of Note On/Off pairs, 3 bytes each, and clocks
+        // sent while it drains: with only tx_lookahead_bytes handed to the
+        // UART ahead, they cut into messages
+        for (uint32_t i = 0; i < 30; ++i)
+        {
+            bool on = i % 2 == 0;
+            localNotes.push_back(Message{static_cast<uint8_t>(on ? 0x91 : 0x81), static_cast<uint8_t>(i / 2), 100});
+            out.setNote(NoteMessage{1, on, static_cast<uint8_t>(i / 2), 100});
+        }
+        for (uint32_t i = 0; i < 10; ++i)
+        {
+            out.sendRealtime(0xF8);
+            clocks++;
+            hal::sleepMs(2);
+        }
+
+        uint64_t quietSince = hal::nowUs();
+        size_t seen = 0;
+        while (hal::nowUs() - quietSince < 200000) // until the output has been idle for 200 ms
+        {
+            collect(seen + 1);
+            if (wire.size() != seen)
+            {
+                seen = wire.size();
+                quietSince = hal::nowUs();
+            }
+        }
+
+        // Split by source; count real-time bytes, and those inside a message
+        MidiStreamParser parser;
+        std::vector<Message> fromThru;
+        std::vector<Message> fromLocal;
+        std::vector<Message> messages;
+        std::vector<uint8_t> plain;
+        uint32_t realtime = 0;
+        uint32_t realtimeInside = 0;
+        size_t messageStart = 0;
+        MidiEvent event;
+        for (size_t i = 0; i < wire.size(); ++i)
+        {
+            if (wire[i] >= 0xF8)
+            {
+                realtime++;
+                if (plain.size() > messageStart)
+                    realtimeInside++;
+                continue;
+            }
+            plain.push_back(wire[i]);
+            if (parser.feed(wire[i], 0, event))
+            {
+                Message message = {event.packet[1], event.packet[2], event.packet[3]};
+                messages.push_back(message);
+                (message.status == 0x90 ? fromThru : fromLocal).push_back(message);
+                messageStart = plain.size();
+            }
+        }
+
+        RunningStatusEncoder encoder;
+        encoder.configure(true, kRefreshMs * 1000, false);
+        std::vector<uint8_t> encoded;
+        for (const Message &message : messages)
+        {
+            uint8_t bytes[3] = {message.status, message.data1, message.data2};
+            uint8_t out[3];
+            size_t n = encoder.encode(bytes, 3, 0, out);
+            encoded.insert(encoded.end(), out, out + n);
+        }
+
+        std::fprintf(stderr, "merged: %zu wire bytes, %zu thru + %zu local messages, %u real-time bytes, %u inside a message\n",
+                     wire.size(), fromThru.size(), fromLocal.size(), realtime, realtimeInside);
+        CHECK(fromThru == thruNotes);
+        CHECK(fromLocal == localNotes);
+        CHECK(plain == encoded);
+        CHECK_EQ(realtime, clocks);
+        CHECK(realtimeInside > 0);
+        CHECK_EQ(parser.parseErrors(), 0);
+    }
+}
+
+int main()
+{
+    // Never destroyed: their tasks outlive main() (see hal::startTask)
+    static MidiOut &out = *new MidiOut(MidiOutConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = kOutPort,
+                                                     .running_status_refresh_ms = kRefreshMs, .track_notes = false});
+    out.init();
+    static MidiThru &thru = *new MidiThru(out, MidiThruConfig{.channel_mask = 0xFFFB});
+    static MidiIn &midiIn = *new MidiIn(MidiInConfig{.receivePin = hal::kNoPin, .uart_num = kInPort, .latency_probes = false});
+    midiIn.setThruHook([](const MidiEvent &event)
+                       { thru.feed(event); });
+    midiIn.init([](Packet4, uint64_t) {});
+
+    stepByStep(out, thru);
+    mergedUnderLoad(out);
+    return check::finish("midi_thru_test");
+}
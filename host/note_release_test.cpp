@@ -0,0 +1,149 @@
+// Held notes on the input side. The dispatcher follows a Stop with a Note
+// Off for each note it handed out and did not see released. MidiIn runs
+// the sensing-lost callback on its dispatch task, after the messages that
+// came before the silence, where it can release the parser's notes.
+//
+// Held notes on the output side: with note_off_as_note_on set, the Note
+// Offs MidiOut sends for them are Note Ons with velocity 0, like any other
+// Note Off it sends.
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "midi_hal.hpp"
+#include "midi_in.hpp"
+#include "midi_in_parser.hpp"
+#include "midi_out.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr hal::UartPort kOutPort = 0;
+    constexpr hal::UartPort kInPort = 1;
+
+    struct NoteHandler
+    {
+        std::vector<NoteMessage> notes;
+        std::vector<TransportCommand> transport;
+        void onNote(const NoteMessage &msg, uint64_t) { notes.push_back(msg); }
+        void onTransport(const TransportEvent &event, uint64_t) { transport.push_back(event.command); }
+    };
+
+    void stopReleasesHeldNotes()
+    {
+        NoteHandler handler;
+        MidiInDispatcher<NoteHandler> dispatcher(handler);
+        const Packet4 packets[] = {
+            {0x09, 0x90, 60, 100}, {0x09, 0x91, 64, 100}, {0x09, 0x90, 67, 100},
+            {0x08, 0x80, 60, 0},   // released by a Note Off
+            {0x09, 0x90, 67, 0},   // and by a Note On with velocity 0
+            {0x0F, 0xFC, 0, 0},    // Stop
+        };
+        dispatcher.feed(packets, 6, 0);
+
+        if (CHECK_EQ(handler.transport.size(), 1))
+            CHECK(handler.transport[0] == TransportCommand::Stop);
+        if (CHECK_EQ(handler.notes.size(), 6))
+        {
+            const NoteMessage &off = handler.notes[5];
+            CHECK(!off.on && off.channel == 1 && off.note == 64 && off.velocity == 0);
+        }
+
+        // Nothing left to release the second time
+        handler.notes.clear();
+        dispatcher.feed(packets[5].data(), 0);
+        dispatcher.releaseHeldNotes(0);
+        CHECK_EQ(handler.notes.size(), 0);
+    }
+
+    // Never destroyed: the MidiIn task below feeds it after main() (see hal::startTask)
+    MidiInParser &parser = *new MidiInParser();
+    std::atomic<uint32_t> noteOffs{0};
+    std::atomic<uint32_t> received{0};
+    std::atomic<bool> onDispatchTask{false};
+    std::thread::id dispatchThread;
+
+    void sensingLostReleasesInput()
+    {
+        parser.setNoteMessageCallback([](const NoteMessage &msg, uint64_t)
+                                      {
+                                          if (!msg.on)
+                                              noteOffs.fetch_add(1);
+                                      });
+        // Never destroyed: its tasks outlive main() (see hal::startTask)
+        static MidiIn &midiIn = *new MidiIn(MidiInConfig{.receivePin = hal::kNoPin, .uart_num = kInPort, .latency_probes = false});
+        midiIn.setSensingLostCallback([](uint64_t timestamp_us)
+                                      {
+                                          onDispatchTask.store(std::this_thread::get_id() == dispatchThread);
+                                          parser.releaseHeldNotes(timestamp_us); });
+        midiIn.init([](Packet4 packet, uint64_t timestamp_us)
+                    {
+                        dispatchThread = std::this_thread::get_id();
+                        received.fetch_add(1);
+                        parser.feed(packet.data(), timestamp_us); });
+
+        // Active Sensing, three notes held, one released, then silence
+        const uint8_t wire[] = {0xFE, 0x90, 60, 100, 62, 100, 64, 100, 0x80, 62, 0};
+        hal::injectUart(kInPort, wire, sizeof(wire));
+        hal::sleepMs(ActiveSensingWatch::kDefaultTimeoutUs / 1000 + 200);
+
+        CHECK_EQ(received.load(), 5);
+        CHECK_EQ(midiIn.getStats().sensing_lost, 1);
+        CHECK_EQ(noteOffs.load(), 1 + 2);
+        CHECK(onDispatchTask.load());
+    }
+
+    // Wire bytes written within `wait_ms`
+    std::vector<uint8_t> captureWire(uint32_t wait_ms)
+    {
+        hal::sleepMs(wait_ms);
+        std::vector<uint8_t> wire;
+        hal::WireByte bytes[64];
+        size_t n;
+        while ((n = hal::captureUart(kOutPort, bytes, 64)) > 0)
+        {
+            for (size_t i = 0; i < n; ++i)
+                wire.push_back(bytes[i].byte);
+        }
+        return wire;
+    }
+
+    void releaseAsNoteOn()
+    {
+        // Never destroyed: its tasks outlive main() (see hal::startTask)
+        static MidiOut &out = *new MidiOut(MidiOutConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = kOutPort,
+                                                         .running_status = false, .note_off_as_note_on = true});
+        out.init();
+
+        out.setNote({.channel = 0, .on = true, .note = 60, .velocity = 100});
+        out.setNote({.channel = 2, .on = true, .note = 70, .velocity = 100});
+        out.setNote({.channel = 0, .on = false, .note = 60, .velocity = 64});
+        std::vector<uint8_t> sent = captureWire(50);
+        const std::vector<uint8_t> expected = {0x90, 60, 100, 0x92, 70, 100, 0x90, 60, 0};
+        CHECK(sent == expected);
+
+        // Note 70 is still held; its release takes the same form
+        out.releaseHeldNotes();
+        std::vector<uint8_t> released = captureWire(50);
+        const std::vector<uint8_t> expectedRelease = {0x92, 70, 0};
+        CHECK(released == expectedRelease);
+
+        // So does the release that follows a Stop
+        out.setNote({.channel = 5, .on = true, .note = 40, .velocity = 90});
+        captureWire(50);
+        out.setTransportEvent(TransportEvent{TransportCommand::Stop});
+        std::vector<uint8_t> stopped = captureWire(50);
+        const std::vector<uint8_t> expectedStop = {0xFC, 0x95, 40, 0};
+        CHECK(stopped == expectedStop);
+    }
+}
+
+int main()
+{
+    stopReleasesHeldNotes();
+    sensingLostReleasesInput();
+    releaseAsNoteOn();
+    return check::finish("note_release_test");
+}
@@ -0,0 +1,309 @@
+// sendAt scheduling error, measured on the wire.
+//
+// The TimingWheel part checks that nothing is released early or held back
+// under random schedules and advance steps, that nextDue() names the
+// earliest message, how late messages go out when the wheel is serviced
+// every tick or at nextDue(), and that the first message after a long
+// idle spell costs one advance() rather than a walk through every slot
+// that went by.
+//
+// The MidiOut part schedules Note Ons 5-6 ms apart, each 20 ms ahead of
+// its time, and reads their start times back from the virtual UART: first
+// on a quiet port after an idle second, then with a second task filling
+// half the wire with immediate notes while busy threads load every core.
+// Prints the error distribution; fails on an early or missing message, or
+// when the median quiet-port error exceeds a millisecond of timer slack.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "midi_hal.hpp"
+#include "midi_out.hpp"
+#include "timing_wheel.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    constexpr hal::UartPort kOutPort = 0;
+
+    // A message that waits in the wheel, keyed by the id in its data bytes
+    struct Pending
+    {
+        uint64_t due_us;
+        int step; // Scheduled right before this step's advance()
+    };
+
+    ScheduledMessage tagged(uint64_t due_us, uint32_t id)
+    {
+        return ScheduledMessage{due_us, {static_cast<uint8_t>(id), static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id >> 16)}, 3};
+    }
+
+    uint32_t idOf(const ScheduledMessage &msg)
+    {
+        return msg.data[0] | msg.data[1] << 8 | static_cast<uint32_t>(msg.data[2]) << 16;
+    }
+
+    // Random schedules and advance() steps of up to 3 ms. Every message goes
+    // out at or after its due time, and in the first advance() that
+    // reached its due time after it was scheduled, never a later one.
+    // nextDue() always names the earliest message waiting.
+    void wheelNeverEarly()
+    {
+        TimingWheel<64> wheel;
+        wheel.clear(0);
+        std::mt19937 random(7);
+        std::map<uint32_t, Pending> pending;
+        uint32_t id = 0;
+        uint64_t now_us = 0;
+        uint32_t released = 0;
+        uint32_t scheduled = 0;
+        uint32_t early = 0;
+        uint32_t heldBack = 0;
+        uint32_t wrongNext = 0;
+        for (int step = 0; step < 20000; ++step)
+        {
+            if (wheel.size() < 48)
+            {
+                // Mostly near, some seconds out (beyond both levels), some already past
+                uint64_t ahead = random() % 10 == 0 ? random() % 20000000 : random() % 100000;
+                uint64_t due = random() % 20 == 0 && now_us > 1000 ? now_us - random() % 1000 : now_us + ahead;
+                if (wheel.schedule(tagged(due, id), now_us))
+                {
+                    pending[id] = Pending{due, step};
+                    scheduled++;
+                }
+                id++;
+            }
+            uint64_t earliest = UINT64_MAX;
+            for (const auto &entry : pending)
+                earliest = std::min(earliest, entry.second.due_us);
+            if (wheel.nextDue() != earliest)
+                wrongNext++;
+
+            uint64_t previous_us = now_us;
+            now_us += random() % 3000;
+            wheel.advance(now_us, [&](const ScheduledMessage &msg)
+                          {
+                              released++;
+                              auto it = pending.find(idOf(msg));
+                              if (it == pending.end())
+                                  return;
+                              if (now_us < it->second.due_us)
+                                  early++;
+                              // The previous advance() had reached it already
+                              if (it->second.step < step && previous_us >= it->second.due_us)
+                                  heldBack++;
+                              pending.erase(it); });
+        }
+        wheel.advance(now_us + 30000000, [&](const ScheduledMessage &msg)
+                      {
+                          released++;
+                          pending.erase(idOf(msg)); });
+        CHECK(pending.empty());
+        CHECK_EQ(released, scheduled);
+        CHECK_EQ(early, 0);
+        CHECK_EQ(heldBack, 0);
+        CHECK_EQ(wrongNext, 0);
+        CHECK_EQ(wheel.nextDue(), UINT64_MAX);
+    }
+
+    // Serviced every wheel tick, as a periodic timer would, a message goes
+    // out less than a tick after its due time. Serviced at nextDue(), as
+    // MidiOut's one-shot timer does, it goes out exactly at its due time.
+    void wheelLateness()
+    {
+        constexpr uint64_t kTickUs = TimingWheel<64>::kTickUs;
+        std::mt19937 random(13);
+        for (bool atDeadline : {false, true})
+        {
+            TimingWheel<64> wheel;
+            wheel.clear(0);
+            uint64_t now_us = 0;
+            uint64_t worst_us = 0;
+            uint32_t early = 0;
+            uint32_t released = 0;
+            bool lostTrack = false;
+            for (int step = 0; step < 20000; ++step)
+            {
+                if (wheel.size() < 48)
+                    wheel.schedule(ScheduledMessage{now_us + random() % 200000, {0x90, 0, 0}, 3}, now_us);
+                uint64_t next_us = atDeadline ? wheel.nextDue() : now_us + kTickUs;
+                if (next_us == UINT64_MAX)
+                {
+                    lostTrack = true; // advancing that far would walk slots for ever
+                    break;
+                }
+                now_us = next_us;
+                wheel.advance(now_us, [&](const ScheduledMessage &msg)
+                              {
+                                  released++;
+                                  if (now_us < msg.due_us)
+                                      early++;
+                                  else
+                                      worst_us = std::max(worst_us, now_us - msg.due_us); });
+            }
+            std::fprintf(stderr, "wheel serviced %s: %u released, worst %" PRIu64 " us late\n",
+                         atDeadline ? "at nextDue()" : "every tick", released, worst_us);
+            CHECK(!lostTrack);
+            CHECK(released > 0);
+            CHECK_EQ(early, 0);
+            if (atDeadline)
+                CHECK_EQ(worst_us, 0);
+            else
+                CHECK(worst_us < kTickUs);
+        }
+    }
+
+    void wheelIdleFastForward()
+    {
+        const uint64_t idle_us = 600ull * 1000000; // Ten minutes without an advance()
+        auto best = std::chrono::steady_clock::duration::max();
+        for (int run = 0; run < 5; ++run) // best of five, so a preemption doesn't count
+        {
+            TimingWheel<16> wheel;
+            wheel.clear(0);
+            ScheduledMessage msg = {idle_us + 1000, {0x90, 60, 100}, 3};
+            CHECK(wheel.schedule(msg, idle_us));
+
+            uint32_t released = 0;
+            auto start = std::chrono::steady_clock::now();
+            wheel.advance(idle_us + 500, [&](const ScheduledMessage &)
+                          { released++; });
+            best = std::min(best, std::chrono::steady_clock::now() - start);
+            CHECK_EQ(released, 0);
+
+            wheel.advance(idle_us + 1300, [&](const ScheduledMessage &)
+                          { released++; });
+            CHECK_EQ(released, 1);
+        }
+        CHECK(best < std::chrono::microseconds(100)); // a walk over 2.3 M slots takes milliseconds
+    }
+
+    struct Errors
+    {
+        std::vector<int64_t> us; // Wire start minus due time, per message
+        uint32_t missing = 0;
+    };
+
+    // Schedules `count` notes on channel 0 and matches them on the wire.
+    // Each note carries its index in note and velocity.
+    Errors measure(MidiOut &out, uint32_t count, std::atomic<bool> *loadRunning)
+    {
+        std::vector<uint64_t> due(count);
+        std::mt19937 random(11);
+        uint64_t at = hal::nowUs() + 30000;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            due[i] = at;
+            at += 5000 + random() % 1000;
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            while (hal::nowUs() + 20000 < due[i])
+                hal::sleepMs(1);
+            out.sendAt(due[i], NoteMessage{0, true, static_cast<uint8_t>(i & 0x7F), static_cast<uint8_t>((i >> 7) + 1)});
+        }
+        hal::sleepMs(100);
+        if (loadRunning)
+            loadRunning->store(false);
+        hal::sleepMs(100);
+
+        // Every message starts with its status byte (running status is off)
+        Errors errors;
+        std::vector<int64_t> start(count, -1);
+        hal::WireByte wire[512];
+        std::vector<hal::WireByte> bytes;
+        size_t n;
+        while ((n = hal::captureUart(kOutPort, wire, 512)) > 0)
+            bytes.insert(bytes.end(), wire, wire + n);
+        for (size_t i = 0; i + 2 < bytes.size(); ++i)
+        {
+            if (bytes[i].byte != 0x90)
+                continue;
+            uint32_t index = bytes[i + 1].byte | static_cast<uint32_t>(bytes[i + 2].byte - 1) << 7;
+            if (index < count)
+                start[index] = static_cast<int64_t>(bytes[i].time_us - MIDI_BYTE_TIME_US);
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (start[i] < 0)
+                errors.missing++;
+            else
+                errors.us.push_back(start[i] - static_cast<int64_t>(due[i]));
+        }
+        return errors;
+    }
+
+    void report(const char *name, Errors &errors)
+    {
+        std::vector<int64_t> &e = errors.us;
+        std::sort(e.begin(), e.end());
+        if (e.empty())
+            return;
+        std::fprintf(stderr, "%-8s n=%zu missing %u  error min %" PRId64 " us, p50 %" PRId64 " us, p99 %" PRId64
+                             " us, max %" PRId64 " us\n",
+                     name, e.size(), errors.missing, e.front(), e[e.size() / 2], e[e.size() * 99 / 100], e.back());
+    }
+}
+
+int main()
+{
+    wheelNeverEarly();
+    wheelLateness();
+    wheelIdleFastForward();
+
+    // Never destroyed: its tasks outlive main() (see hal::startTask)
+    static MidiOut &out = *new MidiOut(MidiOutConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = kOutPort,
+                                                     .running_status = false, .track_notes = false});
+    out.init();
+
+    // The wheel has been empty, and its timer stopped, since init()
+    hal::sleepMs(1000);
+    Errors quiet = measure(out, 200, nullptr);
+    report("quiet", quiet);
+    CHECK_EQ(quiet.missing, 0);
+    if (!quiet.us.empty())
+    {
+        // The tail is the host scheduler's (timer wake-ups run late by up
+        // to milliseconds on a busy machine); the median is ours
+        CHECK(quiet.us.front() >= 0);
+        CHECK(quiet.us[quiet.us.size() / 2] < 1000);
+    }
+
+    // Half the wire taken by immediate notes on channel 1, every core busy
+    std::atomic<bool> loadRunning{true};
+    std::thread traffic([&loadRunning]
+                        {
+                            uint8_t note = 0;
+                            while (loadRunning.load())
+                            {
+                                out.setNote(NoteMessage{1, true, note, 64});
+                                note = (note + 1) & 0x7F;
+                                hal::sleepMs(2); // 3 bytes (0.96 ms) every ~2 ms
+                            } });
+    std::vector<std::thread> hogs;
+    for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency()); ++i)
+        hogs.emplace_back([&loadRunning]
+                          {
+                              volatile uint64_t spin = 0;
+                              while (loadRunning.load(std::memory_order_relaxed))
+                                  spin = spin + 1; });
+    Errors loaded = measure(out, 200, &loadRunning);
+    traffic.join();
+    for (std::thread &hog : hogs)
+        hog.join();
+    report("loaded", loaded);
+    CHECK_EQ(loaded.missing, 0);
+    if (!loaded.us.empty())
+        CHECK(loaded.us.front() >= 0);
+
+    return check::finish("send_at_test");
+}
@@ -0,0 +1,228 @@
+// Renders a Standard MIDI File to a timestamped event list, one line per
+// channel message:
+//
+//   time_us track status data1 [data2]      e.g. "   1250000 1 90 3C 64"
+//
+// The file is mmap()ed and read through SmfSequence's per-track windows,
+// as on the device.
+//
+//   smf_render song.mid                     print the list
+//   smf_render song.mid --from 16           start at Song Position 16 (MIDI beats)
+//   smf_render song.mid --reference ref.txt exit 1 unless the list matches
+//   smf_render song.mid --play              play it through SmfPlayer on the
+//                                           virtual UART loopback and report
+//                                           how late each message arrived
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "midi_hal.hpp"
+#include "midi_in.hpp"
+#include "midi_out.hpp"
+#include "smf_player.hpp"
+#include "virtual_uart.hpp"
+
+using namespace midi;
+
+namespace
+{
+    struct Rendered
+    {
+        uint64_t time_us;
+        SmfEvent event;
+    };
+
+    std::string formatLine(const Rendered &r)
+    {
+        char line[64];
+        int n = std::snprintf(line, sizeof(line), "%10" PRIu64 " %u %02X %02X", r.time_us, r.event.track,
+                              r.event.data[0], r.event.data[1]);
+        if (r.event.length == 3)
+            std::snprintf(line + n, sizeof(line) - n, " %02X", r.event.data[2]);
+        return line;
+    }
+
+    std::vector<Rendered> render(SmfSequence &sequence, uint16_t fromBeats)
+    {
+        std::vector<Rendered> events;
+        sequence.seek(sequence.songPositionTick(fromBeats));
+        SmfEvent event;
+        while (sequence.next(event))
+            events.push_back({sequence.tickToUs(event.tick), event});
+        return events;
+    }
+
+    int compare(const std::vector<Rendered> &events, const char *path)
+    {
+        std::FILE *file = std::fopen(path, "r");
+        if (!file)
+        {
+            std::fprintf(stderr, "can't open %s\n", path);
+            return 1;
+        }
+        char line[128];
+        size_t index = 0;
+        int result = 0;
+        while (std::fgets(line, sizeof(line), file))
+        {
+            line[std::strcspn(line, "\r\n")] = 0;
+            if (!line[0] || line[0] == '#')
+                continue;
+            if (index >= events.size())
+            {
+                std::fprintf(stderr, "line %zu: expected \"%s\", rendering ended\n", index + 1, line);
+                result = 1;
+                break;
+            }
+            std::string rendered = formatLine(events[index]);
+            if (rendered != line)
+            {
+                std::fprintf(stderr, "event %zu: expected \"%s\", rendered \"%s\"\n", index + 1, line, rendered.c_str());
+                result = 1;
+                break;
+            }
+            index++;
+        }
+        std::fclose(file);
+        if (!result && index != events.size())
+        {
+            std::fprintf(stderr, "rendered %zu events, reference has %zu\n", events.size(), index);
+            result = 1;
+        }
+        if (!result)
+            std::fprintf(stderr, "%zu events match %s\n", index, path);
+        return result;
+    }
+
+    // Plays through MidiOut on virtual UART 0, looped back into MidiIn on
+    // virtual UART 1, and compares arrival times with the rendered ones
+    int play(const SmfSource &source, const std::vector<Rendered> &expected, uint16_t fromBeats, uint64_t from_us)
+    {
+        static auto &received = *new std::vector<std::pair<Packet4, uint64_t>>();
+        received.reserve(expected.size());
+
+        hal::connectUarts(0, 1);
+        // Never destroyed: their tasks outlive main() (see hal::startTask)
+        static MidiIn &midiIn = *new MidiIn(MidiInConfig{.receivePin = hal::kNoPin, .uart_num = 1});
+        static MidiOut &midiOut = *new MidiOut(MidiOutConfig{.sendPin = hal::kNoPin, .receivePin = hal::kNoPin, .uart_num = 0});
+        static hal::Mutex &receivedLock = *new hal::Mutex();
+        receivedLock.create();
+        midiIn.init([](Packet4 packet, uint64_t timestamp_us)
+                    {
+                        receivedLock.lock();
+                        received.push_back({packet, timestamp_us});
+                        receivedLock.unlock(); });
+        midiOut.init();
+
+        SmfPlayer player(midiOut);
+        if (!player.load(source))
+            return 1;
+        uint64_t start_us = hal::nowUs();
+        player.seek(fromBeats);
+        player.resume();
+        uint64_t length_us = expected.empty() ? 0 : expected.back().time_us - from_us;
+        hal::sleepMs(static_cast<uint32_t>(length_us / 1000) + 200);
+
+        receivedLock.lock();
+        size_t count = received.size() < expected.size() ? received.size() : expected.size();
+        size_t mismatched = 0;
+        int64_t minLate = INT64_MAX;
+        int64_t maxLate = INT64_MIN;
+        int64_t totalLate = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Packet4 &packet = received[i].first;
+            const SmfEvent &event = expected[i].event;
+            if (packet[1] != event.data[0] || packet[2] != event.data[1] ||
+                (event.length == 3 && packet[3] != event.data[2]))
+                mismatched++;
+            int64_t late = static_cast<int64_t>(received[i].second - start_us) -
+                           static_cast<int64_t>(expected[i].time_us - from_us);
+            minLate = late < minLate ? late : minLate;
+            maxLate = late > maxLate ? late : maxLate;
+            totalLate += late;
+        }
+        std::printf("played %zu of %zu events, %zu differ; arrival after start vs file time: "
+                    "min %" PRId64 " us, avg %" PRId64 " us, max %" PRId64 " us (spread %" PRId64 " us)\n",
+                    received.size(), expected.size(), mismatched, count ? minLate : 0,
+                    count ? totalLate / static_cast<int64_t>(count) : 0, count ? maxLate : 0,
+                    count ? maxLate - minLate : 0);
+        bool ok = received.size() == expected.size() && mismatched == 0;
+        receivedLock.unlock();
+        return ok ? 0 : 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    const char *reference = nullptr;
+    uint16_t fromBeats = 0;
+    bool playback = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--reference") && i + 1 < argc)
+            reference = argv[++i];
+        else if (!std::strcmp(argv[i], "--from") && i + 1 < argc)
+            fromBeats = static_cast<uint16_t>(std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--play"))
+            playback = true;
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            std::fprintf(stderr, "usage: smf_render FILE.mid [--from BEATS] [--reference REF.txt] [--play]\n");
+            return 2;
+        }
+    }
+    if (!path)
+    {
+        std::fprintf(stderr, "usage: smf_render FILE.mid [--from BEATS] [--reference REF.txt] [--play]\n");
+        return 2;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        std::fprintf(stderr, "can't open %s\n", path);
+        return 1;
+    }
+    void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        std::fprintf(stderr, "can't map %s\n", path);
+        return 1;
+    }
+    SmfMemorySource source(static_cast<const uint8_t *>(mapped), static_cast<uint32_t>(info.st_size));
+
+    SmfSequence sequence;
+    if (!sequence.open(source))
+    {
+        std::fprintf(stderr, "%s is not a format 0/1 Standard MIDI File\n", path);
+        return 1;
+    }
+    std::fprintf(stderr, "format %u, %zu tracks, division %u, %u ticks (%" PRIu64 " us), %u SysEx skipped, %u malformed tracks\n",
+                 sequence.format(), sequence.trackCount(), sequence.division(), sequence.lengthTicks(),
+                 sequence.tickToUs(sequence.lengthTicks()), sequence.sysExSkipped(), sequence.malformedTracks());
+
+    std::vector<Rendered> events = render(sequence, fromBeats);
+    int result = 0;
+    if (reference)
+        result = compare(events, reference);
+    else if (playback)
+        result = play(source, events, fromBeats, sequence.tickToUs(sequence.songPositionTick(fromBeats)));
+    else
+        for (const Rendered &r : events)
+            std::printf("%s\n", formatLine(r).c_str());
+
+    munmap(mapped, info.st_size);
+    return result;
+}
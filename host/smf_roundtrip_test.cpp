@@ -0,0 +1,124 @@
+// Record, export, play back: a known stream with tempo changes goes into
+// MidiRecorder, out through writeSmf and back through SmfSequence. Every
+// message must come back in order with its bytes, at its recorded time
+// to within one tick of the tempo it was recorded under.
+#include <algorithm>
+#include <cinttypes>
+#include <vector>
+#include "check.hpp"
+#include "midi_recorder.hpp"
+#include "smf_sequence.hpp"
+#include "smf_source.hpp"
+#include "smf_writer.hpp"
+
+using namespace midi;
+
+namespace
+{
+    struct Sent
+    {
+        uint64_t time_us;
+        uint8_t data[3];
+        uint8_t length;
+        uint32_t tempo_us; // In effect when it was recorded
+    };
+
+    // 120 BPM, 93.7 BPM from 2.0005 s, 174 BPM from 4.2 s; notes at uneven
+    // times, one right on a tempo change, and a Program Change in between
+    std::vector<Sent> recordTake(MidiRecorder &recorder)
+    {
+        std::vector<Sent> sent;
+        uint32_t tempo_us = 500000;
+        auto tempo = [&](uint64_t at_us, float bpm)
+        {
+            CHECK(recorder.recordTempo(at_us, bpmToQ16(bpm)));
+            tempo_us = static_cast<uint32_t>((60000000ull << 16) / bpmToQ16(bpm));
+        };
+        auto send = [&](uint64_t at_us, uint8_t status, uint8_t data1, uint8_t data2)
+        {
+            uint8_t length = (status & 0xE0) == 0xC0 ? 2 : 3;
+            Sent message = {at_us, {status, data1, data2}, length, tempo_us};
+            if (length == 2)
+                message.data[2] = 0;
+            if (CHECK(recorder.record(at_us, message.data, length)))
+                sent.push_back(message);
+        };
+
+        tempo(0, 120.0f);
+        uint64_t at = 0;
+        for (uint32_t i = 0; i < 24; ++i, at += 83117 + i * 97)
+            send(at, i % 2 ? 0x80 : 0x90, static_cast<uint8_t>(48 + i / 2), i % 2 ? 0 : 100);
+        send(1950003, 0xC1, 12, 0);
+        tempo(2000500, 93.7f);
+        send(2000500, 0x91, 60, 90);
+        for (at = 2011111; at < 4200000; at += 142857)
+            send(at, 0xB0, 1, static_cast<uint8_t>(at / 20000 % 128));
+        tempo(4200000, 174.0f);
+        for (at = 4200001; at < 6000000; at += 61031)
+            send(at, 0x90, static_cast<uint8_t>(at / 10000 % 128), 64);
+        send(6000000, 0x81, 60, 0);
+        return sent;
+    }
+
+    void roundTrip(uint16_t division)
+    {
+        static uint8_t arena[4096];
+        MidiRecorder recorder(arena, sizeof(arena));
+        recorder.start(0);
+        std::vector<Sent> sent = recordTake(recorder);
+        recorder.stop();
+
+        std::vector<uint8_t> file;
+        bool written = writeSmf(recorder, [&file](const uint8_t *data, size_t length)
+                                {
+                                    file.insert(file.end(), data, data + length);
+                                    return true; },
+                                division);
+        if (!CHECK(written))
+            return;
+
+        SmfMemorySource source(file.data(), static_cast<uint32_t>(file.size()));
+        SmfSequence sequence;
+        if (!CHECK(sequence.open(source)))
+            return;
+        CHECK_EQ(sequence.format(), 1);
+        CHECK_EQ(sequence.trackCount(), 2);
+        CHECK_EQ(sequence.division(), division);
+
+        size_t count = 0;
+        uint32_t late = 0;
+        int64_t worst_us = 0;
+        SmfEvent event;
+        while (sequence.next(event))
+        {
+            if (!CHECK(count < sent.size()))
+                break;
+            const Sent &expected = sent[count++];
+            CHECK_EQ(event.length, expected.length);
+            CHECK(event.data[0] == expected.data[0] && event.data[1] == expected.data[1] &&
+                  (expected.length < 3 || event.data[2] == expected.data[2]));
+
+            int64_t error_us = static_cast<int64_t>(sequence.tickToUs(event.tick)) - static_cast<int64_t>(expected.time_us);
+            int64_t tick_us = (expected.tempo_us + division - 1) / division;
+            if (error_us > tick_us || error_us < -tick_us)
+            {
+                late++;
+                std::fprintf(stderr, "message %zu at %" PRIu64 " us played at %" PRIu64 " us (tick %u)\n", count - 1,
+                             expected.time_us, sequence.tickToUs(event.tick), event.tick);
+            }
+            worst_us = std::max(worst_us, error_us < 0 ? -error_us : error_us);
+        }
+        std::fprintf(stderr, "division %3u: %zu of %zu messages back, %zu file bytes, worst error %" PRId64 " us\n",
+                     division, count, sent.size(), file.size(), worst_us);
+        CHECK_EQ(count, sent.size());
+        CHECK_EQ(late, 0);
+        CHECK_EQ(sequence.malformedTracks(), 0);
+    }
+}
+
+int main()
+{
+    roundTrip(480);
+    roundTrip(96);
+    return check::finish("smf_roundtrip_test");
+}
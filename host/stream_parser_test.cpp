@@ -0,0 +1,191 @@
+// MidiStreamParser on hand-written wire streams: running status, real-time
+// bytes inside messages, stray data bytes and what counts as a parse error.
+#include <vector>
+#include "check.hpp"
+#include "midi_stream_parser.hpp"
+
+using namespace midi;
+
+namespace
+{
+    // Feeds `bytes` one at a time, byte i arriving at i * 320 us
+    std::vector<MidiEvent> parse(MidiStreamParser &parser, std::initializer_list<uint8_t> bytes)
+    {
+        std::vector<MidiEvent> events;
+        MidiEvent event;
+        uint64_t timestamp_us = 0;
+        for (uint8_t byte : bytes)
+        {
+            if (parser.feed(byte, timestamp_us, event))
+                events.push_back(event);
+            timestamp_us += MIDI_BYTE_TIME_US;
+        }
+        return events;
+    }
+
+    bool is(const MidiEvent &event, uint8_t header, uint8_t status, uint8_t data1, uint8_t data2, uint64_t timestamp_us)
+    {
+        return event.packet == Packet4{header, status, data1, data2} && event.timestamp_us == timestamp_us;
+    }
+
+    void runningStatus()
+    {
+        MidiStreamParser parser;
+        auto events = parse(parser, {0x90, 0x3C, 0x64, 0x3E, 0x64, 0x3C, 0x00, 0xC1, 0x05, 0x06});
+        if (!CHECK_EQ(events.size(), 5))
+            return;
+        CHECK(is(events[0], 0x09, 0x90, 0x3C, 0x64, 0));
+        CHECK(is(events[1], 0x09, 0x90, 0x3E, 0x64, 3 * MIDI_BYTE_TIME_US)); // stamped at its first data byte
+        CHECK(is(events[2], 0x09, 0x90, 0x3C, 0x00, 5 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[3], 0x0C, 0xC1, 0x05, 0x00, 7 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[4], 0x0C, 0xC1, 0x06, 0x00, 9 * MIDI_BYTE_TIME_US));
+        CHECK_EQ(parser.parseErrors(), 0);
+    }
+
+    void realtimeInsideMessages()
+    {
+        MidiStreamParser parser;
+        auto events = parse(parser, {0xB0, 0xF8, 0x07, 0xFE, 0x64, 0x0A, 0xFA, 0x40, 0xF2, 0x10, 0xFC, 0x02});
+        if (!CHECK_EQ(events.size(), 7))
+            return;
+        CHECK(is(events[0], 0x0F, 0xF8, 0, 0, 1 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[1], 0x0F, 0xFE, 0, 0, 3 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[2], 0x0B, 0xB0, 0x07, 0x64, 0)); // the clock did not restart it
+        CHECK(is(events[3], 0x0F, 0xFA, 0, 0, 6 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[4], 0x0B, 0xB0, 0x0A, 0x40, 5 * MIDI_BYTE_TIME_US)); // running status carried across it
+        CHECK(is(events[5], 0x0F, 0xFC, 0, 0, 10 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[6], 0x03, 0xF2, 0x10, 0x02, 8 * MIDI_BYTE_TIME_US)); // Song Position around the Stop
+        CHECK_EQ(parser.parseErrors(), 0);
+    }
+
+    void strayDataBytes()
+    {
+        MidiStreamParser parser;
+        // Before any status, after System Common (which clears running status)
+        // and after SysEx
+        auto events = parse(parser, {0x3C, 0x64, 0xF3, 0x01, 0x02, 0xF0, 0x7E, 0xF7, 0x40, 0x90, 0x3C, 0x64});
+        if (!CHECK_EQ(events.size(), 2))
+            return;
+        CHECK(is(events[0], 0x02, 0xF3, 0x01, 0x00, 2 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[1], 0x09, 0x90, 0x3C, 0x64, 9 * MIDI_BYTE_TIME_US));
+        CHECK_EQ(parser.parseErrors(), 4);
+    }
+
+    void parseErrors()
+    {
+        MidiStreamParser parser;
+        auto events = parse(parser, {
+                                        0x90, 0x3C, 0x80, 0x3C, 0x00, // Note On cut short by Note Off
+                                        0xF4, 0xF9, 0xFD,             // undefined System Common and Real-Time
+                                        0xF7,                         // EOX with no SysEx open
+                                        0xF0, 0x01, 0x02, 0xA0, 0x3C, 0x10, // SysEx cut short by a status byte
+                                    });
+        if (!CHECK_EQ(events.size(), 2))
+            return;
+        CHECK(is(events[0], 0x08, 0x80, 0x3C, 0x00, 2 * MIDI_BYTE_TIME_US));
+        CHECK(is(events[1], 0x0A, 0xA0, 0x3C, 0x10, 12 * MIDI_BYTE_TIME_US));
+        CHECK_EQ(parser.parseErrors(), 6);
+
+        // reset() forgets running status, so the next data byte is stray too
+        parser.reset();
+        events = parse(parser, {0x3C, 0x10});
+        CHECK_EQ(events.size(), 0);
+        CHECK_EQ(parser.parseErrors(), 8);
+    }
+
+    void cableNumber()
+    {
+        MidiStreamParser parser;
+        parser.setCable(5);
+        auto events = parse(parser, {0x91, 0x3C, 0x64, 0xF8, 0xF6, 0xE2, 0x00, 0x40});
+        if (!CHECK_EQ(events.size(), 4))
+            return;
+        CHECK_EQ(events[0].packet[0], 0x59);
+        CHECK_EQ(events[1].packet[0], 0x5F);
+        CHECK_EQ(events[2].packet[0], 0x55);
+        CHECK_EQ(events[3].packet[0], 0x5E);
+    }
+
+    // A SysEx longer than one chunk while the pool has a single chunk
+    // left: the chunk in hand ends the message as aborted
+    void sysExPoolDry()
+    {
+        SysExChunkPool pool;
+        std::vector<SysExChunk> chunks;
+        MidiStreamParser parser;
+        parser.setSysExHandler(&pool, [&chunks](const SysExChunk &chunk)
+                               { chunks.push_back(chunk); });
+        SysExChunk *held[SysExChunkPool::kChunkCount - 1];
+        for (SysExChunk *&chunk : held)
+            chunk = pool.acquire();
+
+        MidiEvent event;
+        parser.feed(0xF0, 0, event);
+        for (size_t i = 0; i < 3 * SysExChunk::kCapacity; ++i)
+            parser.feed(static_cast<uint8_t>(i & 0x7F), 0, event);
+        parser.feed(0xF7, 0, event);
+        if (CHECK_EQ(chunks.size(), 1))
+        {
+            CHECK_EQ(chunks[0].length, SysExChunk::kCapacity);
+            CHECK_EQ(chunks[0].flags, SysExStart | SysExEnd | SysExAborted);
+        }
+        CHECK_EQ(parser.sysExDropped(), 1);
+
+        // With chunks back in the pool the next message arrives whole
+        for (SysExChunk *chunk : held)
+            pool.release(chunk);
+        chunks.clear();
+        parser.feed(0xF0, 0, event);
+        for (size_t i = 0; i < SysExChunk::kCapacity + 10; ++i)
+            parser.feed(0x01, 0, event);
+        parser.feed(0xF7, 0, event);
+        if (CHECK_EQ(chunks.size(), 2))
+        {
+            CHECK_EQ(chunks[0].flags, SysExStart);
+            CHECK_EQ(chunks[1].flags, SysExEnd);
+            CHECK_EQ(chunks[1].length, 10);
+        }
+        CHECK_EQ(parser.sysExDropped(), 1);
+    }
+
+    // The span feed() gives the same messages as feeding byte by byte, with
+    // earlier bytes stamped one byte time apart back from the last
+    void spanMatchesBytes()
+    {
+        const uint8_t bytes[] = {0x90, 0x3C, 0x64, 0xF8, 0x3E, 0x64, 0xB0, 0x01, 0x7F, 0xF0, 0x01, 0xF7, 0xC0, 0x05};
+        MidiStreamParser byByte;
+        MidiStreamParser bySpan;
+        std::vector<MidiEvent> expected;
+        MidiEvent event;
+        for (size_t i = 0; i < sizeof(bytes); ++i)
+        {
+            if (byByte.feed(bytes[i], i * MIDI_BYTE_TIME_US, event))
+                expected.push_back(event);
+        }
+
+        std::vector<MidiEvent> events;
+        bySpan.feed(bytes, 5, 4 * MIDI_BYTE_TIME_US, [&](const MidiEvent &e)
+                    { events.push_back(e); });
+        bySpan.feed(bytes + 5, sizeof(bytes) - 5, (sizeof(bytes) - 1) * MIDI_BYTE_TIME_US, [&](const MidiEvent &e)
+                    { events.push_back(e); });
+
+        if (!CHECK_EQ(events.size(), expected.size()))
+            return;
+        for (size_t i = 0; i < events.size(); ++i)
+            CHECK(is(events[i], expected[i].packet[0], expected[i].packet[1], expected[i].packet[2], expected[i].packet[3],
+                     expected[i].timestamp_us));
+        CHECK_EQ(bySpan.parseErrors(), byByte.parseErrors());
+    }
+}
+
+int main()
+{
+    runningStatus();
+    realtimeInsideMessages();
+    strayDataBytes();
+    parseErrors();
+    cableNumber();
+    sysExPoolDry();
+    spanMatchesBytes();
+    return check::finish("stream_parser_test");
+}
@@ -0,0 +1,153 @@
+// TempoEstimator on synthetic clocks: each tick lands on its ideal time
+// plus uniform jitter, rounded down to a byte time as a UART would stamp
+// it. Prints, per tempo and jitter, how many ticks the estimate takes to
+// come within 0.5 % and stay there, and the worst error once a full
+// window is in; fails when either leaves its bound.
+//
+// Also checks that a late spike barely moves the estimate, that a tempo
+// jump re-locks within a few ticks, and that the dispatcher starts a
+// fresh estimate on Start and Continue rather than carrying the old one.
+#include <cinttypes>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "check.hpp"
+#include "midi_in_dispatcher.hpp"
+#include "tempo_estimator.hpp"
+
+using namespace midi;
+
+namespace
+{
+    double tickPeriodUs(double bpm) { return 60e6 / (bpm * MIDI_CLOCKS_PER_BEAT); }
+
+    double toBpm(BpmQ16 bpm) { return bpm / 65536.0; }
+
+    // Jittered, byte-quantized tick times from `start_us`, `count` ticks at `bpm`
+    std::vector<uint64_t> clockTicks(double bpm, uint32_t jitter_us, uint32_t count, uint64_t start_us, std::mt19937 &random)
+    {
+        std::vector<uint64_t> ticks;
+        std::uniform_int_distribution<int32_t> jitter(-static_cast<int32_t>(jitter_us), static_cast<int32_t>(jitter_us));
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            int64_t at = static_cast<int64_t>(start_us + i * tickPeriodUs(bpm)) + jitter(random);
+            ticks.push_back(static_cast<uint64_t>(at) / MIDI_BYTE_TIME_US * MIDI_BYTE_TIME_US);
+        }
+        return ticks;
+    }
+
+    struct Run
+    {
+        uint32_t lockTicks = 0; // First tick from which the error stays within 0.5 %
+        double worstError = 0;  // Percent, after the first full window
+    };
+
+    Run track(TempoEstimator &estimator, const std::vector<uint64_t> &ticks, double bpm)
+    {
+        Run run;
+        for (uint32_t i = 0; i < ticks.size(); ++i)
+        {
+            estimator.addTick(ticks[i]);
+            double error = std::fabs(toBpm(estimator.bpm()) - bpm) * 100 / bpm;
+            if (error > 0.5 || !estimator.locked())
+                run.lockTicks = i + 2;
+            if (i >= TempoEstimator::kWindow)
+                run.worstError = std::max(run.worstError, error);
+        }
+        return run;
+    }
+
+    void jitteredClocks()
+    {
+        std::mt19937 random(3);
+        for (double bpm : {60.0, 120.0, 128.5, 174.0, 300.0})
+        {
+            for (uint32_t jitter_us : {0u, 250u, 500u, 1000u})
+            {
+                if (jitter_us * 10 > tickPeriodUs(bpm))
+                    continue; // beyond a tenth of a tick no 24-tick window gets within 0.5 %
+                TempoEstimator estimator;
+                Run run = track(estimator, clockTicks(bpm, jitter_us, 480, 1000000, random), bpm);
+                std::fprintf(stderr, "%6.1f BPM  jitter +-%4u us: within 0.5 %% from tick %2u, steady error %.3f %%\n", bpm,
+                             jitter_us, run.lockTicks, run.worstError);
+                CHECK(run.lockTicks <= TempoEstimator::kWindow);
+                CHECK(run.worstError < 0.5);
+            }
+        }
+    }
+
+    // One tick 5 ms late in a steady 120 BPM clock
+    void lateSpike()
+    {
+        TempoEstimator estimator;
+        uint64_t period_us = static_cast<uint64_t>(tickPeriodUs(120));
+        for (uint32_t i = 0; i < 48; ++i)
+            estimator.addTick(i * period_us);
+        estimator.addTick(48 * period_us + 5000);
+        CHECK(std::fabs(toBpm(estimator.bpm()) - 120) < 0.1);
+        estimator.addTick(49 * period_us);
+        CHECK(std::fabs(toBpm(estimator.bpm()) - 120) < 0.1);
+    }
+
+    // 120 -> 128.5 -> 300 BPM without a stop in between
+    void tempoJumps()
+    {
+        std::mt19937 random(5);
+        TempoEstimator estimator;
+        uint64_t at = 1000000;
+        for (double bpm : {120.0, 128.5, 300.0})
+        {
+            std::vector<uint64_t> ticks = clockTicks(bpm, 200, 96, at, random);
+            Run run = track(estimator, ticks, bpm);
+            std::fprintf(stderr, "jump to %5.1f BPM: within 0.5 %% from tick %2u\n", bpm, run.lockTicks);
+            CHECK(run.lockTicks <= 8);
+            at = ticks.back() + static_cast<uint64_t>(tickPeriodUs(bpm));
+        }
+    }
+
+    struct TempoHandler
+    {
+        std::vector<BpmQ16> tempos;
+        void onTempo(BpmQ16 bpm, uint8_t) { tempos.push_back(bpm); }
+    };
+
+    // A clock stopped at 120 BPM and started again at 90: the first
+    // estimate after Start (or Continue) is built from new ticks only
+    void restartForgetsTempo()
+    {
+        const uint8_t clock[4] = {0x0F, 0xF8, 0, 0};
+        const uint8_t stop[4] = {0x0F, 0xFC, 0, 0};
+        for (uint8_t resume : {uint8_t{0xFA}, uint8_t{0xFB}})
+        {
+            TempoHandler handler;
+            MidiInDispatcher<TempoHandler> dispatcher(handler);
+            uint64_t at = 0;
+            for (uint32_t i = 0; i < 48; ++i, at += static_cast<uint64_t>(tickPeriodUs(120)))
+                dispatcher.feed(clock, at);
+            dispatcher.feed(stop, at);
+            size_t beforeStop = handler.tempos.size();
+            at += 2000000;
+            dispatcher.feed(clock, at); // clock running while stopped
+            CHECK_EQ(handler.tempos.size(), beforeStop);
+
+            const uint8_t start[4] = {0x0F, resume, 0, 0};
+            dispatcher.feed(start, at);
+            for (uint32_t i = 0; i < TempoEstimator::kMinTicks; ++i)
+            {
+                at += static_cast<uint64_t>(tickPeriodUs(90));
+                dispatcher.feed(clock, at);
+            }
+            if (CHECK_EQ(handler.tempos.size(), beforeStop + 1))
+                CHECK(std::fabs(toBpm(handler.tempos.back()) - 90) < 0.1);
+        }
+    }
+}
+
+int main()
+{
+    jitteredClocks();
+    lateSpike();
+    tempoJumps();
+    restartForgetsTempo();
+    return check::finish("tempo_estimator_test");
+}
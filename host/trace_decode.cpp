@@ -0,0 +1,76 @@
+// Decodes a MIDI trace dumped in hex (midi::trace::startDumper with
+// DumpFormat::Hex) from a console log, e.g.
+//
+//   idf.py monitor | tee monitor.log
+//   trace_decode monitor.log
+//
+// Every line holding an "MT " record is printed as time since the first
+// record, time since the previous one, and the decoded event. Other lines
+// are skipped. Reads stdin without arguments.
+#include <cstdio>
+#include <cstring>
+#include "midi_trace.hpp"
+
+using namespace midi;
+
+namespace
+{
+    struct Decoder
+    {
+        bool started = false;
+        uint32_t previous_us = 0;
+        uint64_t elapsed_us = 0; // Since the first record, across 32-bit wraps
+        uint32_t records = 0;
+
+        void decode(std::FILE *in)
+        {
+            char line[512];
+            while (std::fgets(line, sizeof(line), in))
+            {
+                const char *text = std::strstr(line, "MT ");
+                trace::Record record;
+                if (!text || !trace::fromHex(text, record))
+                    continue;
+
+                if (!started)
+                {
+                    started = true;
+                    previous_us = record.time_us;
+                }
+                uint32_t delta_us = record.time_us - previous_us; // wraps correctly
+                elapsed_us += delta_us;
+                previous_us = record.time_us;
+                records++;
+
+                char event[64];
+                trace::format(record, event, sizeof(event));
+                std::printf("%12.3f ms  +%8u us  %s\n", elapsed_us / 1000.0, delta_us, event);
+            }
+        }
+    };
+}
+
+int main(int argc, char **argv)
+{
+    Decoder decoder;
+    if (argc < 2)
+    {
+        decoder.decode(stdin);
+    }
+    else
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::FILE *in = std::fopen(argv[i], "r");
+            if (!in)
+            {
+                std::fprintf(stderr, "can't open %s\n", argv[i]);
+                return 1;
+            }
+            decoder.decode(in);
+            std::fclose(in);
+        }
+    }
+    std::fprintf(stderr, "%u records\n", decoder.records);
+    return 0;
+}
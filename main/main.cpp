@@ -1,8 +1,11 @@
 #include "midi_in.hpp"
 #include "midi_in_parser.hpp"
 #include "midi_out.hpp"
+#include "midi_trace.hpp"
+#include <atomic>
 #include <functional>
 #include <cstdint>
+#include <cinttypes>
 #include "esp_log.h"
 
 static const char *TAG = "Main";
@@ -15,32 +18,40 @@ MidiOutConfig outConfig = {.sendPin = GPIO_NUM_10, .receivePin = GPIO_NUM_0, .ua
 MidiIn midiIn(inConfig);
 MidiOut midiOut(outConfig);
 
-auto controllerCallback = [](const ControllerChange event)
+auto controllerCallback = [](const ControllerChange event, uint64_t timestamp_us)
 {
-    ESP_LOGI(TAG, "ControllerChange value %u", event.value);
+    ESP_LOGI(TAG, "ControllerChange value %u at %" PRIu64, event.value, timestamp_us);
 };
 
-auto positionCallback = [](const SongPosition event)
+auto positionCallback = [](const SongPosition event, uint64_t timestamp_us)
 {
-    ESP_LOGI(TAG, "SongPosition position %u", event.position);
+    ESP_LOGI(TAG, "SongPosition position %u at %" PRIu64, event.position, timestamp_us);
 };
-auto noteCallback = [](const NoteMessage event)
+auto noteCallback = [](const NoteMessage event, uint64_t timestamp_us)
 {
-    ESP_LOGI(TAG, "NoteMessage note %u", event.note);
+    ESP_LOGI(TAG, "NoteMessage note %u at %" PRIu64, event.note, timestamp_us);
 };
 
-auto transportCallback = [](const TransportEvent event)
+auto transportCallback = [](const TransportEvent event, uint64_t timestamp_us)
 {
-    ESP_LOGI(TAG, "TransportEvent note %u", static_cast<uint8_t>(event.command));
+    ESP_LOGI(TAG, "TransportEvent note %u at %" PRIu64, static_cast<uint8_t>(event.command), timestamp_us);
 };
 auto bpmCallback = [](const uint8_t bpm)
 {
     ESP_LOGI(TAG, "BpmEvent value %u", bpm);
 };
 
-auto midiInCallback = [](const Packet4 midiPacket)
+// Runs on the UART task: count and trace only, the main loop reports
+std::atomic<uint32_t> sysExBytes{0};
+auto sysExCallback = [](const SysExChunk &chunk)
 {
-    parser.feed(midiPacket.data());
+    sysExBytes.fetch_add(chunk.length, std::memory_order_relaxed);
+    MIDI_TRACE(RxSysEx, static_cast<uint8_t>(chunk.length), static_cast<uint8_t>(chunk.length >> 8), chunk.flags);
+};
+
+auto midiInCallback = [](const Packet4 midiPacket, uint64_t timestamp_us)
+{
+    parser.feed(midiPacket.data(), timestamp_us);
 };
 void setup_gpio_for_midi_out()
 {
@@ -60,12 +71,19 @@ extern "C" void app_main()
     parser.setTransportCallback(transportCallback);
     parser.setBpmCallback(bpmCallback);
     parser.setSongPositionCallback(positionCallback);
+    midiIn.setSysExCallback(sysExCallback);
+    midiIn.setSensingLostCallback([](uint64_t timestamp_us)
+                                  {
+                                      midiOut.releaseHeldNotes();
+                                      parser.releaseHeldNotes(timestamp_us); });
     midiIn.init(midiInCallback);
     midiOut.init();
+    midi::trace::startDumper(); // Only with CONFIG_MIDI_TRACE
 
     while (1)
     {
         vTaskDelay(pdMS_TO_TICKS(3000));
+        ESP_LOGI(TAG, "SysEx received: %" PRIu32 " bytes", sysExBytes.load(std::memory_order_relaxed));
         midiOut.setNote({
             .channel = 1,
             .on = true,